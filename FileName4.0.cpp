@@ -7,13 +7,50 @@
 #include <wx/splitter.h>
 #include <wx/dcbuffer.h>
 #include <wx/graphics.h>
+#include <wx/dcgraph.h>
 #include <vector>
 #include <stack>
 #include <wx/clipbrd.h>
 #include <wx/txtstrm.h>
 #include <wx/wfstream.h>
+#include <wx/mstream.h>
+#include <wx/zstream.h>
+#include <wx/numdlg.h>
+#include <wx/dir.h>
+#include <wx/stdpaths.h>
 #include <map>
+#include <set>
+#include <queue>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <cstring>
+#include <limits>
+#include <cctype>
+#include <cstdio>
+#include <stdexcept>
+#include <cstdarg>
+#ifdef __WXMSW__
+#include <wx/msw/wrapwin.h>
+#include <intrin.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 #include <cmath>
+#include <random>
 #include <fstream>
 #include <wx/propgrid/propgrid.h>
 #include <wx/propgrid/advprops.h>
@@ -30,30 +67,671 @@ wxDEFINE_EVENT(MY_CUSTOM_EVENT, wxCommandEvent);
 enum {
     ID_SHOW_STATUSBAR = wxID_HIGHEST + 1,
     ID_SHOW_GRID,
+    ID_SHOW_POWER,
     ID_DELETE_SELECTED,
     ID_DELETE_WIRE,
-    ID_EDIT_PROPERTIES
+    ID_EDIT_PROPERTIES,
+    ID_CREATE_SUBCIRCUIT,
+    ID_TOGGLE_ANALYSIS,
+    ID_FAULT_SIMULATION,
+    ID_COMPILE_BENCHMARK,
+    ID_EXPORT_KERNEL,
+    ID_EXPORT_NETLIST,
+    ID_IMPORT_NETLIST,
+    ID_AUTO_LAYOUT,
+    ID_AUTO_ROUTE,
+    ID_CLOCK_STEP,
+    ID_CYCLE_SIMULATION,
+    ID_CANCEL_JOB,
+    ID_BULK_EDIT_PROPERTIES,
+    ID_SHOW_PROFILER,
+    ID_EXPORT_TRACE,
+    ID_SAVE_JOB,
+    ID_JOURNAL_TIMER,
+    ID_OPEN_TILED,
+    ID_COMPACT_JSON,
+    ID_EXPORT_IMAGE
 };
 
-// Խṹ
+// ֵַפÿַֻͬһݣϵֻš
+// פʱŶȡѷĿ鲻ƶʱפ׳ std::length_error
+class PropertyStrings {
+public:
+    // ߳פַؼļʱ̷߳פͬ
+    static int Intern(const wxString& s) {
+        thread_local std::map<wxString, int> recent;
+        auto it = recent.find(s);
+        if (it != recent.end()) return it->second;
+        int id = InternLocked(s);
+        if (recent.size() >= RECENT_LIMIT) recent.clear();
+        recent.insert(std::make_pair(s, id));
+        return id;
+    }
+
+    static const wxString& Get(int id) { return Instance().chunks[id / CHUNK][id % CHUNK]; }
+
+private:
+    static const int CHUNK = 1024;
+    static const int MAX_CHUNKS = 4096;
+    static const size_t RECENT_LIMIT = 1024;
+
+    static int InternLocked(const wxString& s) {
+        Table& t = Instance();
+        std::lock_guard<std::mutex> lock(t.mutex);
+        auto it = t.ids.find(s);
+        if (it != t.ids.end()) return it->second;
+        if (t.count == CHUNK * MAX_CHUNKS) throw std::length_error("ַ, ֵͬ");
+        int id = t.count;
+        if (id % CHUNK == 0) t.chunks[id / CHUNK].reset(new wxString[CHUNK]);
+        t.chunks[id / CHUNK][id % CHUNK] = s;
+        t.ids.insert(std::make_pair(s, id));
+        ++t.count;
+        return id;
+    }
+
+    struct Table {
+        std::mutex mutex;
+        std::map<wxString, int> ids;
+        std::unique_ptr<wxString[]> chunks[MAX_CHUNKS];
+        int count = 1;
+
+        //  0 ̶Ϊַ
+        Table() {
+            chunks[0].reset(new wxString[CHUNK]);
+            ids.insert(std::make_pair(wxString(), 0));
+        }
+    };
+
+    static Table& Instance() {
+        static Table table;
+        return table;
+    }
+};
+
+enum class PropertyType : unsigned char { String, Int, Double, Bool };
+
+// Խṹ壺פţֵͱ棬ȡֵʱٽַ
+// ֵַŷ i У d 
 struct Property {
-    wxString name;
-    wxString value;
-    wxString type; // "string", "int", "double", "bool"
+    int name;
+    PropertyType type;
+    union {
+        long long i;
+        double d;
+    };
+
+    Property() : name(0), type(PropertyType::String), i(0) {}
+
+    static Property MakeInt(int name, long long value) {
+        Property p;
+        p.name = name;
+        p.type = PropertyType::Int;
+        p.i = value;
+        return p;
+    }
+
+    static Property MakeDouble(int name, double value) {
+        Property p;
+        p.name = name;
+        p.type = PropertyType::Double;
+        p.d = value;
+        return p;
+    }
+
+    static Property MakeBool(int name, bool value) {
+        Property p;
+        p.name = name;
+        p.type = PropertyType::Bool;
+        p.i = value ? 1 : 0;
+        return p;
+    }
+
+    static Property MakeString(int name, const wxString& value) {
+        Property p;
+        p.name = name;
+        p.i = PropertyStrings::Intern(value);
+        return p;
+    }
+
+    // ļͶԻеıʽֻһΣıǸ͵ֵʱԭַ棬
+    // ضϻ²⣨"10.5"  10"yes"  false
+    static Property Parse(const wxString& name, const wxString& value, const wxString& type) {
+        int id = PropertyStrings::Intern(name);
+        if (type == "int") {
+            long long v;
+            if (value.ToLongLong(&v)) return MakeInt(id, v);
+        }
+        else if (type == "double") {
+            double d;
+            if (value.ToDouble(&d)) return MakeDouble(id, d);
+        }
+        else if (type == "bool") {
+            if (value == "true" || value == "1") return MakeBool(id, true);
+            if (value == "false" || value == "0") return MakeBool(id, false);
+        }
+        return MakeString(id, value);
+    }
+
+    const wxString& GetName() const { return PropertyStrings::Get(name); }
+
+    const char* GetTypeName() const {
+        switch (type) {
+        case PropertyType::Int: return "int";
+        case PropertyType::Double: return "double";
+        case PropertyType::Bool: return "bool";
+        default: return "string";
+        }
+    }
+
+    wxString GetValueString() const {
+        switch (type) {
+        case PropertyType::Int: return wxString::Format("%lld", i);
+        case PropertyType::Bool: return i ? "true" : "false";
+        case PropertyType::Double: {
+            // ȡܻԭͬһֵд
+            wxString s = wxString::Format("%.15g", d);
+            double back;
+            return s.ToDouble(&back) && back == d ? s : wxString::Format("%.17g", d);
+        }
+        default: return PropertyStrings::Get((int)i);
+        }
+    }
+
+    bool SameValue(const Property& other) const {
+        if (type != other.type) return false;
+        return type == PropertyType::Double ? d == other.d : i == other.i;
+    }
 };
 
+// ıƶͣʱʹã
+wxString GuessPropertyType(const wxString& value) {
+    long long v;
+    double d;
+    if (value.ToLongLong(&v)) return "int";
+    if (value.ToDouble(&d)) return "double";
+    if (value == "true" || value == "false") return "bool";
+    return "string";
+}
+
+// õ
+static const int PROP_DELAY = PropertyStrings::Intern("ӳ");
+static const int PROP_CAPACITANCE = PropertyStrings::Intern("");
+static const int PROP_INIT = PropertyStrings::Intern("ʼֵ");
+static const int PROP_SWITCH_STATE = PropertyStrings::Intern("ʼ״̬");
+static const int PROP_FREQUENCY = PropertyStrings::Intern("Ƶ");
+static const int PROP_COLOR = PropertyStrings::Intern("ɫ");
+static const int PROP_VOLTAGE = PropertyStrings::Intern("ѹ");
+
 struct Gate {
     wxString type;
     wxPoint pos;
     std::vector<Property> properties; // Ա
 };
 
+// һߣţֻβ˵ӣмĹյ㲻Ż
 struct Wire {
-    wxPoint start;
-    wxPoint end;
+    std::vector<wxPoint> points;
     bool isSelected = false; // ѡ״̬
+
+    Wire() {}
+    Wire(const wxPoint& start, const wxPoint& end) : points{ start, end } {}
+    explicit Wire(std::vector<wxPoint>&& pts) : points(std::move(pts)) {}
+
+    const wxPoint& Start() const { return points.front(); }
+    const wxPoint& End() const { return points.back(); }
+};
+
+// ===== ܼ =====
+// ơʰȡաļдȽ׶ ScopedTimer ʱÿ̰߳ѺʱǵԼֱͼ¼
+// ¼ʱϵ͵ Chrome trace ڶȡʱϲ̵߳
+enum class ProfileZone { Frame, Grid, Gates, Wires, Overlay, HitTest, Undo, FileIO, Analysis, Background, Count };
+
+inline const char* ProfileZoneName(ProfileZone zone) {
+    static const char* names[] = { "frame", "grid", "gates", "wires", "overlay", "hit_test", "undo_snapshot", "file_io", "analysis", "background_job" };
+    return names[(int)zone];
+}
+
+class Profiler {
+public:
+    static const int ZONES = (int)ProfileZone::Count;
+    static const int BUCKETS = 8 * 32;          // ΢ֵÿ 2 ٷ 8  12.5%
+    static const uint32_t TRACE_CAPACITY = 8192; // ÿ̱߳¼
+
+    struct Histogram {
+        uint64_t count = 0;
+        uint64_t total = 0; // ΢
+        uint64_t max = 0;
+        uint64_t buckets[BUCKETS] = {};
+
+        //  q λڵе㣨΢룩
+        double Percentile(double q) const {
+            if (count == 0) return 0;
+            uint64_t rank = (uint64_t)(q * (count - 1)) + 1, seen = 0;
+            for (int b = 0; b < BUCKETS; ++b) {
+                seen += buckets[b];
+                if (seen >= rank) return std::min((double)max, (BucketLow(b) + BucketLow(b + 1)) * 0.5);
+            }
+            return (double)max;
+        }
+    };
+
+    struct TraceEvent {
+        ProfileZone zone;
+        int tid;
+        uint64_t start;    // Գ΢
+        uint64_t duration;
+    };
+
+    static bool IsEnabled() { return Instance().enabled.load(std::memory_order_relaxed); }
+    static void SetEnabled(bool on) { Instance().enabled = on; }
+
+    static void Record(ProfileZone zone, std::chrono::steady_clock::time_point t0, std::chrono::steady_clock::time_point t1) {
+        Registry& r = Instance();
+        ThreadData& d = Local();
+        int z = (int)zone;
+        uint64_t start = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(t0 - r.epoch).count();
+        uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+        d.count[z].fetch_add(1, std::memory_order_relaxed);
+        d.total[z].fetch_add(us, std::memory_order_relaxed);
+        if (us > d.max[z].load(std::memory_order_relaxed)) d.max[z].store(us, std::memory_order_relaxed);
+        d.buckets[z][BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+
+        uint64_t head = d.traceHead.load(std::memory_order_relaxed);
+        TraceSlot& slot = d.trace[head % TRACE_CAPACITY];
+        slot.start.store(start, std::memory_order_relaxed);
+        slot.duration.store(us, std::memory_order_relaxed);
+        slot.tag.store((uint32_t)d.tid << 8 | (uint32_t)z, std::memory_order_relaxed);
+        d.traceHead.store(head + 1, std::memory_order_release);
+    }
+
+    static Histogram Collect(ProfileZone zone) {
+        Registry& r = Instance();
+        int z = (int)zone;
+        Histogram h;
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto& d : r.threads) {
+            h.count += d->count[z].load(std::memory_order_relaxed);
+            h.total += d->total[z].load(std::memory_order_relaxed);
+            h.max = std::max(h.max, d->max[z].load(std::memory_order_relaxed));
+            for (int b = 0; b < BUCKETS; ++b) h.buckets[b] += d->buckets[z][b].load(std::memory_order_relaxed);
+        }
+        return h;
+    }
+
+    // ߳¼е¼ɵһοǣȡ
+    static std::vector<TraceEvent> CollectTrace() {
+        Registry& r = Instance();
+        std::vector<TraceEvent> events;
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto& d : r.threads) {
+            uint64_t head = d->traceHead.load(std::memory_order_acquire);
+            uint64_t keep = TRACE_CAPACITY - TRACE_CAPACITY / 8;
+            for (uint64_t i = head > keep ? head - keep : 0; i < head; ++i) {
+                const TraceSlot& slot = d->trace[i % TRACE_CAPACITY];
+                uint32_t tag = slot.tag.load(std::memory_order_relaxed);
+                TraceEvent e;
+                e.zone = (ProfileZone)std::min<uint32_t>(tag & 0xff, ZONES - 1);
+                e.tid = (int)(tag >> 8);
+                e.start = slot.start.load(std::memory_order_relaxed);
+                e.duration = slot.duration.load(std::memory_order_relaxed);
+                events.push_back(e);
+            }
+        }
+        std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.start < b.start; });
+        return events;
+    }
+
+    static void Reset() {
+        Registry& r = Instance();
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (auto& d : r.threads) {
+            for (int z = 0; z < ZONES; ++z) {
+                d->count[z] = 0;
+                d->total[z] = 0;
+                d->max[z] = 0;
+                for (int b = 0; b < BUCKETS; ++b) d->buckets[z][b] = 0;
+            }
+            d->traceHead = 0;
+        }
+    }
+
+    // Chrome trace ʽchrome://tracingPerfetto ֱӴ򿪣׶εͳƻ
+    static bool WriteChromeTrace(const wxString& filename, wxString& error) {
+        std::ofstream out(filename.ToStdString(), std::ios::binary);
+        if (!out.is_open()) {
+            error = "޷ļ: " + filename;
+            return false;
+        }
+        std::vector<TraceEvent> events = CollectTrace();
+        out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+        for (size_t i = 0; i < events.size(); ++i) {
+            const TraceEvent& e = events[i];
+            out << (i ? ",\n" : "\n") << "{\"name\":\"" << ProfileZoneName(e.zone) << "\",\"cat\":\"circuit\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << e.tid << ",\"ts\":" << e.start << ",\"dur\":" << e.duration << "}";
+        }
+        out << "\n],\"summary\":{";
+        for (int z = 0; z < ZONES; ++z) {
+            Histogram h = Collect((ProfileZone)z);
+            out << (z ? ",\n" : "\n") << "\"" << ProfileZoneName((ProfileZone)z) << "\":{\"count\":" << h.count << ",\"total_us\":" << h.total
+                << ",\"p50_us\":" << h.Percentile(0.5) << ",\"p99_us\":" << h.Percentile(0.99) << ",\"max_us\":" << h.max << "}";
+        }
+        out << "\n}}\n";
+        out.close();
+        if (out.fail()) {
+            error = "дļʧ: " + filename;
+            return false;
+        }
+        return true;
+    }
+
+    static int BucketOf(uint64_t us) {
+        if (us < 8) return (int)us;
+        int e = HighestBit(us);
+        int b = (e - 2) * 8 + (int)((us >> (e - 3)) & 7);
+        return std::min(b, BUCKETS - 1);
+    }
+
+    static uint64_t BucketLow(int b) {
+        if (b < 8) return (uint64_t)b;
+        int e = b / 8 + 2;
+        return (uint64_t)(8 + b % 8) << (e - 3);
+    }
+
+private:
+    struct TraceSlot {
+        std::atomic<uint64_t> start{ 0 };
+        std::atomic<uint64_t> duration{ 0 };
+        std::atomic<uint32_t> tag{ 0 };
+    };
+
+    // ֻ߳д룻߳˳һ̸߳
+    struct ThreadData {
+        int tid = 0;
+        bool inUse = false;
+        std::atomic<uint64_t> count[ZONES];
+        std::atomic<uint64_t> total[ZONES];
+        std::atomic<uint64_t> max[ZONES];
+        std::atomic<uint64_t> buckets[ZONES][BUCKETS];
+        std::atomic<uint64_t> traceHead{ 0 };
+        TraceSlot trace[TRACE_CAPACITY];
+
+        ThreadData() {
+            for (int z = 0; z < ZONES; ++z) {
+                count[z] = 0;
+                total[z] = 0;
+                max[z] = 0;
+                for (int b = 0; b < BUCKETS; ++b) buckets[z][b] = 0;
+            }
+        }
+    };
+
+    struct Registry {
+        std::atomic<bool> enabled{ true };
+        std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+        std::mutex mutex; // ̵ֻ߳Ǽǡ˳ͻʱʹ
+        std::vector<std::unique_ptr<ThreadData>> threads;
+        int nextTid = 1;
+    };
+
+    struct LocalSlot {
+        ThreadData* data;
+
+        LocalSlot() {
+            Registry& r = Instance();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            auto it = std::find_if(r.threads.begin(), r.threads.end(), [](const std::unique_ptr<ThreadData>& d) { return !d->inUse; });
+            if (it == r.threads.end()) {
+                r.threads.emplace_back(new ThreadData());
+                it = r.threads.end() - 1;
+            }
+            data = it->get();
+            data->inUse = true;
+            data->tid = r.nextTid++;
+        }
+
+        ~LocalSlot() {
+            Registry& r = Instance();
+            std::lock_guard<std::mutex> lock(r.mutex);
+            data->inUse = false;
+        }
+    };
+
+    static Registry& Instance() {
+        static Registry r;
+        return r;
+    }
+
+    static ThreadData& Local() {
+        thread_local LocalSlot slot;
+        return *slot.data;
+    }
+
+    static int HighestBit(uint64_t bits) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, bits);
+        return (int)index;
+#else
+        return 63 - __builtin_clzll(bits);
+#endif
+    }
+};
+
+// ʱرռʱֻһο
+class ScopedTimer {
+public:
+    explicit ScopedTimer(ProfileZone zone) : m_zone(zone), m_active(Profiler::IsEnabled()) {
+        if (m_active) m_start = std::chrono::steady_clock::now();
+    }
+
+    ~ScopedTimer() { Stop(); }
+
+    // ǰʱͬһμƼ׶ʱʹã
+    void Stop() {
+        if (m_active) Profiler::Record(m_zone, m_start, std::chrono::steady_clock::now());
+        m_active = false;
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+private:
+    ProfileZone m_zone;
+    bool m_active;
+    std::chrono::steady_clock::time_point m_start;
+};
+
+// ===== Ŵ洢 =====
+// ϵŰֶηֿţλáͱšԸһ飬ơʰȡͷʱ˳ɨ衣
+// ɾʱһŻλƶԪأŵ˻仯Ҫ༭ĳʱʹþ
+// ¼λʹλͷʱһɾ֮ʧЧ
+// Ŵ洢ֻüա̨涼ȡգһ޸ʱ
+struct GateHandle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+};
+
+class GateStore;
+
+// Ŵ洢޸֪ͨ༭־ͨÿһ޸
+class GateStoreListener {
+public:
+    virtual ~GateStoreListener() {}
+    virtual void GateAdded(const GateStore& gates, size_t i) = 0;
+    virtual void GateMoved(const GateStore& gates, size_t i) = 0;
+    virtual void GateChanged(const GateStore& gates, size_t i) = 0;
+    virtual void GateRemoved(size_t i) = 0;
+    virtual void GatesReplaced(const GateStore& gates) = 0;
+};
+
+class GateStore {
+public:
+    GateStore() : m_data(std::make_shared<Columns>()) {}
+    // ̳мߣ帳ֵʱ֪ͨݱ滻
+    GateStore(const GateStore& other) : m_data(other.m_data) {}
+    GateStore& operator=(const GateStore& other) {
+        if (this != &other) {
+            m_data = other.m_data;
+            if (m_listener) m_listener->GatesReplaced(*this);
+        }
+        return *this;
+    }
+
+    void SetListener(GateStoreListener* listener) { m_listener = listener; }
+
+    size_t size() const { return m_data->pos.size(); }
+    bool empty() const { return m_data->pos.empty(); }
+
+    const wxPoint& Pos(size_t i) const { return m_data->pos[i]; }
+    void SetPos(size_t i, const wxPoint& pos) {
+        Write().pos[i] = pos;
+        if (m_listener) m_listener->GateMoved(*this, i);
+    }
+    // פ PropertyStrings 
+    int TypeId(size_t i) const { return m_data->type[i]; }
+    const wxString& Type(size_t i) const { return PropertyStrings::Get(m_data->type[i]); }
+    const std::vector<Property>& Properties(size_t i) const { return m_data->props[i]; }
+    void SetProperties(size_t i, std::vector<Property> props) {
+        Write().props[i] = std::move(props);
+        if (m_listener) m_listener->GateChanged(*this, i);
+    }
+
+    // ȡ/дţ༭ԡơʱʹã
+    Gate Get(size_t i) const {
+        Gate gate;
+        gate.type = Type(i);
+        gate.pos = m_data->pos[i];
+        gate.properties = m_data->props[i];
+        return gate;
+    }
+
+    void Set(size_t i, const Gate& gate) {
+        Columns& d = Write();
+        d.type[i] = PropertyStrings::Intern(gate.type);
+        d.pos[i] = gate.pos;
+        d.props[i] = gate.properties;
+        if (m_listener) m_listener->GateChanged(*this, i);
+    }
+
+    void Reserve(size_t n) {
+        Columns& d = Write();
+        d.pos.reserve(n);
+        d.type.reserve(n);
+        d.props.reserve(n);
+        d.slotOf.reserve(n);
+    }
+
+    // ׷ӵĩβϲ㣩
+    GateHandle Add(const Gate& gate) {
+        Columns& d = Write();
+        uint32_t slot;
+        if (!d.freeSlots.empty()) {
+            slot = d.freeSlots.back();
+            d.freeSlots.pop_back();
+        }
+        else {
+            slot = (uint32_t)d.generation.size();
+            d.generation.push_back(0);
+            d.indexOf.push_back(0);
+        }
+        d.indexOf[slot] = (uint32_t)d.pos.size();
+        d.slotOf.push_back(slot);
+        d.pos.push_back(gate.pos);
+        d.type.push_back(PropertyStrings::Intern(gate.type));
+        d.props.push_back(gate.properties);
+        if (m_listener) m_listener->GateAdded(*this, d.pos.size() - 1);
+        return GateHandle{ slot, d.generation[slot] };
+    }
+
+    // ɾ i ţһƵλ
+    void SwapRemove(size_t i) {
+        Columns& d = Write();
+        size_t last = d.pos.size() - 1;
+        d.Release(d.slotOf[i]);
+        if (i != last) {
+            d.pos[i] = d.pos[last];
+            d.type[i] = d.type[last];
+            d.props[i] = std::move(d.props[last]);
+            d.slotOf[i] = d.slotOf[last];
+            d.indexOf[d.slotOf[i]] = (uint32_t)i;
+        }
+        d.pos.pop_back();
+        d.type.pop_back();
+        d.props.pop_back();
+        d.slotOf.pop_back();
+        if (m_listener) m_listener->GateRemoved(i);
+    }
+
+    void Clear() {
+        Columns& d = Write();
+        for (uint32_t slot : d.slotOf) d.Release(slot);
+        d.pos.clear();
+        d.type.clear();
+        d.props.clear();
+        d.slotOf.clear();
+        if (m_listener) m_listener->GatesReplaced(*this);
+    }
+
+    void Assign(const std::vector<Gate>& gates) {
+        GateStoreListener* listener = m_listener;
+        m_listener = nullptr;
+        Clear();
+        Reserve(gates.size());
+        for (auto& g : gates) Add(g);
+        m_listener = listener;
+        if (m_listener) m_listener->GatesReplaced(*this);
+    }
+
+    std::vector<Gate> ToGates() const {
+        std::vector<Gate> gates;
+        gates.reserve(size());
+        for (size_t i = 0; i < size(); ++i) gates.push_back(Get(i));
+        return gates;
+    }
+
+    GateHandle Handle(size_t i) const { return GateHandle{ m_data->slotOf[i], m_data->generation[m_data->slotOf[i]] }; }
+
+    // ǰӦţѱɾʱ -1
+    int IndexOf(const GateHandle& h) const {
+        if (h.slot >= m_data->generation.size() || m_data->generation[h.slot] != h.generation) return -1;
+        return (int)m_data->indexOf[h.slot];
+    }
+
+private:
+    struct Columns {
+        std::vector<wxPoint> pos;
+        std::vector<int> type;
+        std::vector<std::vector<Property>> props;
+        std::vector<uint32_t> slotOf;      //  -> λ
+        std::vector<uint32_t> indexOf;     // λ -> 
+        std::vector<uint32_t> generation;  // ÿλĴ
+        std::vector<uint32_t> freeSlots;
+
+        void Release(uint32_t slot) {
+            ++generation[slot];
+            freeSlots.push_back(slot);
+        }
+    };
+
+    // տ߳жȡֻԼʱԭ޸ģȸһ
+    std::shared_ptr<Columns> m_data;
+    GateStoreListener* m_listener = nullptr;
+
+    Columns& Write() {
+        if (m_data.use_count() > 1) m_data = std::make_shared<Columns>(*m_data);
+        else std::atomic_thread_fence(std::memory_order_acquire);
+        return *m_data;
+    }
 };
 
+// ռȺͬʱŴ洢ͨ⼸ͳһȡ
+inline const wxString& GateType(const std::vector<Gate>& gates, size_t i) { return gates[i].type; }
+inline const wxPoint& GatePos(const std::vector<Gate>& gates, size_t i) { return gates[i].pos; }
+inline const std::vector<Property>& GateProperties(const std::vector<Gate>& gates, size_t i) { return gates[i].properties; }
+inline const wxString& GateType(const GateStore& gates, size_t i) { return gates.Type(i); }
+inline const wxPoint& GatePos(const GateStore& gates, size_t i) { return gates.Pos(i); }
+inline const std::vector<Property>& GateProperties(const GateStore& gates, size_t i) { return gates.Properties(i); }
+
 enum class ShapeType { Line, Arc, Circle, Polygon, Text };
 
 struct Shape {
@@ -67,6 +745,10 @@ struct Shape {
 
 static std::map<wxString, std::vector<Shape>> shapeLibrary;
 
+// ӵ·⣺붨ͬʵʵһݱõĶ
+struct SubcircuitDef;
+static std::map<wxString, std::shared_ptr<const SubcircuitDef>> subcircuitLibrary;
+
 // ===== Ա༭Ի =====
 class PropertyDialog : public wxDialog {
 public:
@@ -92,22 +774,17 @@ public:
             m_propertyGrid->Append(new wxPropertyCategory("Զ"));
 
             for (auto& prop : m_gate.properties) {
-                if (prop.type == "int") {
-                    long value;
-                    prop.value.ToLong(&value);
-                    m_propertyGrid->Append(new wxIntProperty(prop.name, wxPG_LABEL, value));
+                if (prop.type == PropertyType::Int) {
+                    m_propertyGrid->Append(new wxIntProperty(prop.GetName(), wxPG_LABEL, (long)prop.i));
                 }
-                else if (prop.type == "double") {
-                    double value;
-                    prop.value.ToDouble(&value);
-                    m_propertyGrid->Append(new wxFloatProperty(prop.name, wxPG_LABEL, value));
+                else if (prop.type == PropertyType::Double) {
+                    m_propertyGrid->Append(new wxFloatProperty(prop.GetName(), wxPG_LABEL, prop.d));
                 }
-                else if (prop.type == "bool") {
-                    bool value = prop.value == "true" || prop.value == "1";
-                    m_propertyGrid->Append(new wxBoolProperty(prop.name, wxPG_LABEL, value));
+                else if (prop.type == PropertyType::Bool) {
+                    m_propertyGrid->Append(new wxBoolProperty(prop.GetName(), wxPG_LABEL, prop.i != 0));
                 }
                 else {
-                    m_propertyGrid->Append(new wxStringProperty(prop.name, wxPG_LABEL, prop.value));
+                    m_propertyGrid->Append(new wxStringProperty(prop.GetName(), wxPG_LABEL, prop.GetValueString()));
                 }
             }
         }
@@ -176,25 +853,28 @@ private:
                 continue;
             }
 
-            Property newProp;
-            newProp.name = name;
-            newProp.value = prop->GetValueAsString();
-
             // ж
+            wxString type = "string";
+            wxString value = prop->GetValueAsString();
             if (prop->IsKindOf(wxCLASSINFO(wxIntProperty))) {
-                newProp.type = "int";
+                type = "int";
             }
             else if (prop->IsKindOf(wxCLASSINFO(wxFloatProperty))) {
-                newProp.type = "double";
+                type = "double";
             }
             else if (prop->IsKindOf(wxCLASSINFO(wxBoolProperty))) {
-                newProp.type = "bool";
-            }
-            else {
-                newProp.type = "string";
+                // ʾı "True"/"False"ֵתļед
+                type = "bool";
+                value = prop->GetValue().GetBool() ? "true" : "false";
             }
 
-            m_gate.properties.push_back(newProp);
+            try {
+                m_gate.properties.push_back(Property::Parse(name, value, type));
+            }
+            catch (const std::exception& e) {
+                wxLogError("%s", e.what());
+                return;
+            }
         }
 
         EndModal(wxID_OK);
@@ -202,14 +882,20 @@ private:
 };
 
 // ===== JSON غ ( C++14) =====
-void LoadShapesFromJson(const std::string& filename) {
+bool LoadShapesFromJson(const std::string& filename) {
     std::ifstream f(filename.c_str());  //  JSON ļ
     if (!f.is_open()) {
         wxLogError("޷ͼοļ: %s", filename);
-        return;
+        return false;
     }
     json j;
-    f >> j;  //  JSON 
+    try {
+        f >> j;  //  JSON 
+    }
+    catch (const std::exception& e) {
+        wxLogError("ͼοļʽ: %s", e.what());
+        return false;
+    }
 
     //  JSON ݣͼϢ shapeLibrary
     for (json::iterator it = j.begin(); it != j.end(); ++it) {
@@ -239,144 +925,6247 @@ void LoadShapesFromJson(const std::string& filename) {
                 shape.center = wxPoint(s["center"][0], s["center"][1]);
             }
             if (s.find("radius") != s.end()) shape.radius = s["radius"];
+            if (s.find("text") != s.end()) shape.text = wxString::FromUTF8(s["text"].get<std::string>().c_str());
             // ... Խ
 
             vec.push_back(shape);
         }
         shapeLibrary[wxString::FromUTF8(gateName.c_str())] = vec;
     }
+    return true;
 }
 
-// ===== ͼ =====
-class MyDrawPanel : public wxPanel {
-public:
-    MyDrawPanel(wxWindow* parent)
-        : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_SIMPLE),
-        m_scale(1.0), m_isDrawingWire(false),
-        m_isDraggingGate(false), m_draggedIndex(-1),
-        m_selectedIndex(-1), m_selectedWireIndex(-1), m_showGrid(true), m_gridSize(20)
-    {
-        SetBackgroundStyle(wxBG_STYLE_PAINT);
-        Bind(wxEVT_PAINT, &MyDrawPanel::OnPaint, this);
-        Bind(wxEVT_LEFT_DOWN, &MyDrawPanel::OnMouseDown, this);
-        Bind(wxEVT_LEFT_UP, &MyDrawPanel::OnMouseUp, this);
-        Bind(wxEVT_RIGHT_DOWN, &MyDrawPanel::OnRightClick, this);
-        Bind(wxEVT_MOTION, &MyDrawPanel::OnMouseMove, this);
-        Bind(wxEVT_KEY_DOWN, &MyDrawPanel::OnKeyDown, this);
+// ===== Ŷ =====
+enum class GateKind { Unknown, And, Or, Not, Xor, Nand, Nor, Xnor, Buffer, Led, Switch, Clock, Dff, Latch, Subcircuit };
+
+// ʱԪD ʱزʹΪ 1 ʱ͸
+bool IsSequential(GateKind kind) { return kind == GateKind::Dff || kind == GateKind::Latch; }
+
+GateKind GetGateKind(const wxString& type) {
+    if (type == "AND") return GateKind::And;
+    if (type == "OR") return GateKind::Or;
+    if (type == "NOT") return GateKind::Not;
+    if (type == "XOR") return GateKind::Xor;
+    if (type == "NAND") return GateKind::Nand;
+    if (type == "NOR") return GateKind::Nor;
+    if (type == "XNOR") return GateKind::Xnor;
+    if (type == "BUFFER") return GateKind::Buffer;
+    if (type == "LED") return GateKind::Led;
+    if (type == "") return GateKind::Switch;
+    if (type == "CLOCK") return GateKind::Clock;
+    if (type == "DFF") return GateKind::Dff;
+    if (type == "LATCH") return GateKind::Latch;
+    if (subcircuitLibrary.count(type)) return GateKind::Subcircuit;
+    return GateKind::Unknown;
+}
 
-        if (shapeLibrary.empty()) {
-            LoadShapesFromJson("D:/code/Project1/x64/Debug/shapes4.0.json");
-        }
+// λã shapes4.0.json ߵĶ˵һ
+struct PinLayout {
+    std::vector<wxPoint> inputs;
+    std::vector<wxPoint> outputs;
+};
 
-        SetFocus(); // ȷԽռ¼
+const PinLayout& GetPinLayout(GateKind kind) {
+    static std::map<GateKind, PinLayout> layouts;
+    if (layouts.empty()) {
+        layouts[GateKind::Unknown] = PinLayout();
+        layouts[GateKind::And] = { { wxPoint(-20, 15), wxPoint(-20, 45) }, { wxPoint(90, 30) } };
+        layouts[GateKind::Nand] = layouts[GateKind::And];
+        layouts[GateKind::Or] = { { wxPoint(-35, 15), wxPoint(-35, 45) }, { wxPoint(90, 30) } };
+        layouts[GateKind::Xor] = layouts[GateKind::Or];
+        layouts[GateKind::Xnor] = layouts[GateKind::Or];
+        layouts[GateKind::Nor] = { { wxPoint(-30, 15), wxPoint(-30, 45) }, { wxPoint(90, 30) } };
+        layouts[GateKind::Buffer] = { { wxPoint(-20, 30) }, { wxPoint(80, 30) } };
+        layouts[GateKind::Not] = layouts[GateKind::Buffer];
+        layouts[GateKind::Led] = { { wxPoint(10, 40) }, {} };
+        layouts[GateKind::Switch] = { {}, { wxPoint(80, 30) } };
+        layouts[GateKind::Clock] = { {}, { wxPoint(80, 30) } };
+        //  0 Ϊ D 1 Ϊ CLK / EN
+        layouts[GateKind::Dff] = { { wxPoint(-20, 20), wxPoint(-20, 60) }, { wxPoint(80, 20) } };
+        layouts[GateKind::Latch] = layouts[GateKind::Dff];
     }
+    return layouts[kind];
+}
 
-    void AddShape(const wxString& shape) {
-        Gate newGate;
-        newGate.type = shape;
-        newGate.pos = wxPoint(50 + (m_gates.size() % 3) * 150, 50 + (m_gates.size() / 3) * 150);
-
-        // ΪͬĬ
-        if (shape == "LED") {
-            Property colorProp;
-            colorProp.name = "ɫ";
-            colorProp.value = "ɫ";
-            colorProp.type = "string";
-            newGate.properties.push_back(colorProp);
-
-            Property voltageProp;
-            voltageProp.name = "ѹ";
-            voltageProp.value = "3.3";
-            voltageProp.type = "double";
-            newGate.properties.push_back(voltageProp);
-        }
-        else if (shape == "") {
-            Property stateProp;
-            stateProp.name = "ʼ״̬";
-            stateProp.value = "ر";
-            stateProp.type = "string";
-            newGate.properties.push_back(stateProp);
-        }
-        else if (shape == "AND" || shape == "OR" || shape == "NOT" ||
-            shape == "XOR" || shape == "NAND" || shape == "NOR" ||
-            shape == "XNOR" || shape == "BUFFER") {
-            Property delayProp;
-            delayProp.name = "ӳ";
-            delayProp.value = "10";
-            delayProp.type = "int";
-            newGate.properties.push_back(delayProp);
-        }
-
-        m_gates.push_back(newGate);
-        m_selectedIndex = (int)m_gates.size() - 1;
-        m_selectedWireIndex = -1; // ȡѡ
-
-        // ֪ͨڱ״̬ڳ
-        wxCommandEvent evt(MY_CUSTOM_EVENT);
-        evt.SetEventObject(this);
-        wxPostEvent(GetParent(), evt);
+// ߶˵ţ߶˵㣩֮룬ȡһ
+static const int PIN_TOLERANCE = 10;
 
-        Refresh();
+const Property* FindProperty(const std::vector<Property>& props, int name) {
+    for (const auto& prop : props) {
+        if (prop.name == name) return &prop;
     }
+    return nullptr;
+}
 
-    void RemoveLastShape() {
-        if (!m_gates.empty()) {
-            m_gates.pop_back();
-            m_selectedIndex = -1;
+// ͬʱǣ׷
+void SetProperty(std::vector<Property>& props, const Property& prop) {
+    for (auto& p : props) {
+        if (p.name == prop.name) {
+            p = prop;
+            return;
         }
-        Refresh();
     }
+    props.push_back(prop);
+}
 
-    void DeleteSelected() {
-        if (m_selectedIndex >= 0 && m_selectedIndex < (int)m_gates.size()) {
-            // ֪ͨڱ״̬ڳ
-            wxCommandEvent evt(MY_CUSTOM_EVENT);
-            evt.SetEventObject(this);
-            wxPostEvent(GetParent(), evt);
+// ȡֵԣڻ޷ʱĬֵַֻ͵ֵҪ
+long GetIntProperty(const std::vector<Property>& props, int name, long defaultValue) {
+    const Property* prop = FindProperty(props, name);
+    if (!prop) return defaultValue;
+    switch (prop->type) {
+    case PropertyType::Int: case PropertyType::Bool: return (long)prop->i;
+    case PropertyType::Double: return (long)prop->d;
+    default: {
+        long value;
+        if (prop->GetValueString().ToLong(&value)) return value;
+        double d;
+        return prop->GetValueString().ToDouble(&d) ? (long)d : defaultValue;
+    }
+    }
+}
 
-            m_gates.erase(m_gates.begin() + m_selectedIndex);
-            m_selectedIndex = -1;
-            Refresh();
-        }
+double GetDoubleProperty(const std::vector<Property>& props, int name, double defaultValue) {
+    const Property* prop = FindProperty(props, name);
+    if (!prop) return defaultValue;
+    switch (prop->type) {
+    case PropertyType::Int: case PropertyType::Bool: return (double)prop->i;
+    case PropertyType::Double: return prop->d;
+    default: {
+        double value;
+        return prop->GetValueString().ToDouble(&value) ? value : defaultValue;
+    }
     }
+}
 
-    void DeleteSelectedWire() {
-        if (m_selectedWireIndex >= 0 && m_selectedWireIndex < (int)m_wires.size()) {
-            // ֪ͨڱ״̬ڳ
-            wxCommandEvent evt(MY_CUSTOM_EVENT);
-            evt.SetEventObject(this);
-            wxPostEvent(GetParent(), evt);
+bool GetBoolProperty(const std::vector<Property>& props, int name, bool defaultValue) {
+    const Property* prop = FindProperty(props, name);
+    if (!prop) return defaultValue;
+    if (prop->type == PropertyType::String) return prop->GetValueString() == "true" || prop->GetValueString() == "1";
+    return prop->type == PropertyType::Double ? prop->d != 0 : prop->i != 0;
+}
 
-            m_wires.erase(m_wires.begin() + m_selectedWireIndex);
-            m_selectedWireIndex = -1;
-            Refresh();
+bool IsSwitchOn(const std::vector<Property>& props) {
+    const Property* prop = FindProperty(props, PROP_SWITCH_STATE);
+    if (!prop) return false;
+    if (prop->type != PropertyType::String) return GetBoolProperty(props, PROP_SWITCH_STATE, false);
+    const wxString& value = prop->GetValueString();
+    return value == "" || value == "" || value == "1" || value == "true";
+}
+
+const Property* FindProperty(const Gate& gate, int name) { return FindProperty(gate.properties, name); }
+void SetProperty(Gate& gate, const Property& prop) { SetProperty(gate.properties, prop); }
+long GetIntProperty(const Gate& gate, int name, long defaultValue) { return GetIntProperty(gate.properties, name, defaultValue); }
+double GetDoubleProperty(const Gate& gate, int name, double defaultValue) { return GetDoubleProperty(gate.properties, name, defaultValue); }
+bool GetBoolProperty(const Gate& gate, int name, bool defaultValue) { return GetBoolProperty(gate.properties, name, defaultValue); }
+bool IsSwitchOn(const Gate& gate) { return IsSwitchOn(gate.properties); }
+
+// ===== ֲ =====
+// Kahn ֲ㣻ϵ󲢼 cyclic
+// D ״̬ڵ룬˵Դ㣬Ļϻ·
+void LevelizeGates(const std::vector<GateKind>& kind, const std::vector<std::vector<int>>& fanin,
+    const std::vector<std::vector<int>>& fanout, std::vector<int>& level, std::vector<int>& cyclic) {
+    size_t n = fanin.size();
+    std::vector<int> indeg(n, 0);
+    for (size_t g = 0; g < n; ++g) {
+        if (kind[g] == GateKind::Dff) continue;
+        for (int d : fanin[g]) if (d >= 0) indeg[g]++;
+    }
+    std::vector<int> queue;
+    level.assign(n, 0);
+    for (size_t g = 0; g < n; ++g) {
+        if (indeg[g] == 0) queue.push_back((int)g);
+    }
+    size_t head = 0;
+    int maxLevel = 0;
+    while (head < queue.size()) {
+        int g = queue[head++];
+        for (int s : fanout[g]) {
+            if (kind[s] == GateKind::Dff) continue;
+            level[s] = std::max(level[s], level[g] + 1);
+            maxLevel = std::max(maxLevel, level[s]);
+            if (--indeg[s] == 0) queue.push_back(s);
         }
     }
-
-    void EditSelectedProperties() {
-        if (m_selectedIndex >= 0 && m_selectedIndex < (int)m_gates.size()) {
-            // ֪ͨڱ״̬ڳ
-            wxCommandEvent evt(MY_CUSTOM_EVENT);
-            evt.SetEventObject(this);
-            wxPostEvent(GetParent(), evt);
-
-            PropertyDialog dialog(this, m_gates[m_selectedIndex]);
-            if (dialog.ShowModal() == wxID_OK) {
-                Refresh();
-            }
+    for (size_t g = 0; g < n; ++g) {
+        if (indeg[g] > 0) {
+            level[g] = maxLevel + 1;
+            cyclic.push_back((int)g);
         }
     }
+}
 
-    void ClearShapes() {
-        // ֪ͨڱ״̬ڳ
-        wxCommandEvent evt(MY_CUSTOM_EVENT);
+// չӵ·ʵgate ʵڶţ 0 ڲŴ base ʼ
+struct NetlistInstance {
+    int gate;
+    int base;
+    std::shared_ptr<const SubcircuitDef> def;
+};
+
+// ֲգ̨ڹ߳ʹ
+struct LevelizedNetlist {
+    std::vector<wxString> type;
+    std::vector<GateKind> kind;
+    std::vector<std::vector<int>> fanin;   // ÿŵţ-1 ʾ
+    std::vector<std::vector<int>> fanout;
+    std::vector<int> order;                // еֵ˳
+    std::vector<int> inputs;               // 루أ
+    std::vector<unsigned char> init;       // ءʱӡĳʼֵ
+    std::vector<int> outputs;              // LEDû LED ʱȡȳţ
+    // ӵ·ʵչƽ̹żں˲Ҫ֣ʱ owner ԭ
+    std::vector<NetlistInstance> instances;
+    std::vector<int> owner;                // ʵ instances еţΪ -1ûʵʱΪ
+};
+
+bool IsOwnedGate(const LevelizedNetlist& net, size_t g) { return !net.owner.empty() && net.owner[g] >= 0; }
+
+// ===== ӵ· =====
+// ڲĿغʱ˿ڣLED ˿ڡֻһΣõڲķֲ
+// ÿʵֻڲʱԪ״̬˿ڵֵֵʱùһ顣
+struct SubcircuitDef {
+    wxString name;
+    int id = 0;                            // ˳Ƕ׵ĶĶ崴
+    std::vector<Gate> gates;
+    std::vector<Wire> wires;
+    LevelizedNetlist net;                  // ڲǶ׵ʵչ
+    std::vector<int> inputs;               // ˿ڶӦڲţλôϵ
+    std::vector<int> outputs;              // ˿ڶӦڲ LED
+    std::vector<int> port;                 // ڲ -> ˿ţΪ -1
+    std::vector<int> stateSlot;            // ڲ -> ʱԪ״̬ţΪ -1
+    std::vector<int> flops;                // ڲ D ±꼴 prevClock / sampled 
+    std::vector<unsigned char> init;       // ʱԪĳʼֵ
+    int delay = 0;                         // ˿ڵ˿ڵ·ӳ
+    bool cyclic = false;                   // ڲϻ·ʱҪȶ
+    PinLayout pins;
+    wxSize size;
+};
+
+// ʵɶȡ̶
+const PinLayout& GetPinLayout(const wxString& type) {
+    GateKind kind = GetGateKind(type);
+    if (kind == GateKind::Subcircuit) return subcircuitLibrary.find(type)->second->pins;
+    return GetPinLayout(kind);
+}
+
+const PinLayout& GetPinLayout(const Gate& gate) { return GetPinLayout(gate.type); }
+
+static int EvaluateKind(GateKind kind, int a, int b) {
+    switch (kind) {
+    case GateKind::And: return a & b;
+    case GateKind::Or: return a | b;
+    case GateKind::Not: return !a;
+    case GateKind::Xor: return a ^ b;
+    case GateKind::Nand: return !(a & b);
+    case GateKind::Nor: return !(a | b);
+    case GateKind::Xnor: return !(a ^ b);
+    case GateKind::Buffer: return a;
+    case GateKind::Led: return a;
+    default: return 0;
+    }
+}
+
+// öڲһʵֵvalues ǵ÷ṩʱÿڲһֽڣ
+// غ˿ڵֵΪ values[def.outputs[k]]
+// edges Ϊ false ʱֻ¼ʱӵƽʵһֵ
+// sampled ǿʱȡǰ D붥ʱӵһ¡
+void RunSubcircuit(const SubcircuitDef& def, const unsigned char* in, unsigned char* state,
+    unsigned char* prevClock, const unsigned char* sampled, bool edges, unsigned char* values) {
+    const LevelizedNetlist& net = def.net;
+    auto input = [&](int g, size_t pin) -> int {
+        const std::vector<int>& fi = net.fanin[g];
+        return pin < fi.size() && fi[pin] >= 0 ? values[fi[pin]] : 0;
+    };
+    std::fill(values, values + net.kind.size(), 0);
+    for (int pass = 0; pass < 16; ++pass) {
+        bool changed = false;
+        for (int g : net.order) {
+            int v;
+            switch (net.kind[g]) {
+            case GateKind::Switch:
+            case GateKind::Clock:
+                v = def.port[g] >= 0 ? in[def.port[g]] : 0;
+                break;
+            case GateKind::Dff:
+                v = state[def.stateSlot[g]];
+                break;
+            case GateKind::Latch:
+                if (input(g, 1)) state[def.stateSlot[g]] = (unsigned char)input(g, 0);
+                v = state[def.stateSlot[g]];
+                break;
+            default:
+                v = EvaluateKind(net.kind[g], input(g, 0), input(g, 1));
+                break;
+            }
+            if (values[g] != v) {
+                values[g] = (unsigned char)v;
+                changed = true;
+            }
+        }
+        // 棬仯Ҫһ飨ڲв
+        bool captured = false;
+        for (size_t f = 0; f < def.flops.size(); ++f) {
+            int g = def.flops[f];
+            int clock = input(g, 1);
+            if (edges && clock && !prevClock[f]) {
+                unsigned char d = sampled ? sampled[f] : (unsigned char)input(g, 0);
+                unsigned char& q = state[def.stateSlot[g]];
+                if (q != d) {
+                    q = d;
+                    captured = true;
+                }
+            }
+            prevClock[f] = (unsigned char)clock;
+        }
+        if (!captured && !(def.cyclic && changed)) break;
+    }
+}
+
+// ===== ·߼ + ʱ =====
+// ӹϵź߶˵λþ PIN_TOLERANCE ڼΪ
+// ȫ֮󣬱༭ֻ½Ӱ磬ӷ仯ų
+// ȳ׶ֱ߼ֵ͵ʱ䲻ٱ仯Ϊֹ
+class CircuitAnalyzer {
+public:
+    CircuitAnalyzer() : m_valid(false), m_maxArrival(0), m_lastEvaluated(0), m_unstable(false), m_nextWireId(0), m_epoch(0) {}
+
+    bool IsValid() const { return m_valid; }
+    void Invalidate() { m_valid = false; }
+
+    // ȫλ硢ֲ㲢ֵgates Ŵ洢
+    template <class Gates>
+    void Build(const Gates& gates, const std::vector<Wire>& wires) {
+        size_t n = gates.size();
+        m_cells.clear();
+        m_kind.assign(n, GateKind::Unknown);
+        m_pos.assign(n, wxPoint());
+        m_delay.assign(n, 0);
+        m_state.assign(n, 0);
+        m_prevClock.assign(n, 0);
+        m_value.assign(n, 0);
+        m_toggles.assign(n, 0);
+        m_clockEdges = 0;
+        m_arrival.assign(n, 0);
+        m_level.assign(n, 0);
+        m_fanin.assign(n, std::vector<int>());
+        m_fanout.assign(n, std::vector<int>());
+        m_inst.assign(n, -1);
+        m_instances.clear();
+        m_faninPort.clear();
+        m_wireIds.clear();
+        m_wireEnds.clear();
+        m_wireDriver.clear();
+        m_nextWireId = 0;
+        m_cells.reserve(n * 3 + wires.size() * 2);
+
+        for (size_t i = 0; i < n; ++i) {
+            LoadGate(GateType(gates, i), GateProperties(gates, i), (int)i, true);
+            m_pos[i] = GatePos(gates, i);
+            InsertPins((int)i);
+        }
+        for (auto& w : wires) {
+            InsertWire(w);
+        }
+
+        // ÿڵֻһ
+        std::vector<wxPoint> seeds;
+        for (size_t i = 0; i < n; ++i) {
+            for (auto& off : Layout((int)i).outputs) {
+                seeds.push_back(m_pos[i] + off);
+            }
+        }
+        std::vector<int> touched;
+        ResolveNets(seeds, touched);
+
+        std::vector<int> cyclic;
+        ComputeLevels(cyclic);
+
+        // ˳ֵһ鼴ɵõȶ
+        std::vector<int> order(n);
+        for (size_t i = 0; i < n; ++i) order[i] = (int)i;
+        std::stable_sort(order.begin(), order.end(), [this](int a, int b) { return m_level[a] < m_level[b]; });
+        for (int g : order) {
+            // ʱûʱأֳʼֵֵټ¼ CLK ƽ
+            if (m_kind[g] == GateKind::Dff) m_prevClock[g] = 1;
+            Evaluate(g);
+        }
+        SyncClockInputs();
+
+        m_valid = true;
+        m_unstable = false;
+        RecomputeMaxArrival();
+        // ·ϵҪٵȶ
+        if (!cyclic.empty()) Propagate(cyclic);
+        m_lastEvaluated = n;
+    }
+
+    // ŵԱ޸ģӳ١״̬ȣӹϵ
+    template <class Gates>
+    void GateChanged(const Gates& gates, int index) {
+        if (!CanUpdate() || index < 0 || index >= (int)m_kind.size()) return;
+        LoadGate(GateType(gates, index), GateProperties(gates, index), index, false);
+        Propagate(std::vector<int>(1, index));
+    }
+
+    // ĩβһ
+    template <class Gates>
+    void GateAdded(const Gates& gates, int index) {
+        if (!CanUpdate() || index != (int)m_kind.size()) { Invalidate(); return; }
+        m_kind.push_back(GateKind::Unknown);
+        m_pos.push_back(GatePos(gates, index));
+        m_delay.push_back(0);
+        m_state.push_back(0);
+        m_prevClock.push_back(0);
+        m_value.push_back(0);
+        m_toggles.push_back(0);
+        m_arrival.push_back(0);
+        m_level.push_back(0);
+        m_fanin.push_back(std::vector<int>());
+        m_fanout.push_back(std::vector<int>());
+        m_inst.push_back(-1);
+        LoadGate(GateType(gates, index), GateProperties(gates, index), index, true);
+        InsertPins(index);
+
+        std::vector<int> touched(1, index);
+        ResolveNets(PinPositions(index), touched);
+        Propagate(touched);
+    }
+
+    // űƶקԶԻ޸꣩
+    template <class Gates>
+    void GateMoved(const Gates& gates, int index) {
+        if (!CanUpdate() || index < 0 || index >= (int)m_kind.size()) return;
+        if (m_pos[index] == GatePos(gates, index)) return;
+
+        std::vector<int> touched(1, index);
+        std::vector<wxPoint> oldPins = PinPositions(index);
+        RemovePins(index);
+        ResolveNets(oldPins, touched);
+
+        m_pos[index] = GatePos(gates, index);
+        InsertPins(index);
+        ResolveNets(PinPositions(index), touched);
+        Propagate(touched);
+    }
+
+    // ĩβһ
+    void WireAdded(const std::vector<Wire>& wires, int index) {
+        if (!CanUpdate() || index != (int)m_wireIds.size()) { Invalidate(); return; }
+        InsertWire(wires[index]);
+        std::vector<wxPoint> seeds;
+        seeds.push_back(wires[index].Start());
+        seeds.push_back(wires[index].End());
+        std::vector<int> touched;
+        ResolveNets(seeds, touched);
+        Propagate(touched);
+    }
+
+    //  index ѱɾ
+    void WireRemoved(int index) {
+        if (!CanUpdate() || index < 0 || index >= (int)m_wireIds.size()) { Invalidate(); return; }
+        int id = m_wireIds[index];
+        m_wireIds.erase(m_wireIds.begin() + index);
+        std::vector<wxPoint> seeds;
+        seeds.push_back(m_wireEnds[id].first);
+        seeds.push_back(m_wireEnds[id].second);
+        RemoveNode(seeds[0], ConnNode::WireEnd, id, 0);
+        RemoveNode(seeds[1], ConnNode::WireEnd, id, 1);
+        std::vector<int> touched;
+        ResolveNets(seeds, touched);
+        Propagate(touched);
+    }
+
+    // ʱһأȲд DٷתʱӲȳ׶
+    // ʱӵģвҲɵǰֵ
+    void ClockEdge() {
+        if (!CanUpdate()) return;
+        size_t n = m_kind.size();
+        m_sampledD.assign(n, 0);
+        std::vector<int> clocks;
+        for (size_t g = 0; g < n; ++g) {
+            if (m_kind[g] == GateKind::Dff) m_sampledD[g] = (unsigned char)InputValue((int)g, 0);
+            if (m_inst[g] >= 0) SampleInstance((int)g);
+            if (m_kind[g] == GateKind::Clock) {
+                m_state[g] ^= 1;
+                clocks.push_back((int)g);
+            }
+        }
+        m_inClockTick = true;
+        Propagate(clocks);
+        m_inClockTick = false;
+        ++m_clockEdges;
+    }
+
+    // ǰӹϵķֲ
+    template <class Gates>
+    void ExportNetlist(const Gates& gates, LevelizedNetlist& out) const {
+        size_t n = m_kind.size();
+        out.type.resize(n);
+        for (size_t i = 0; i < n && i < gates.size(); ++i) out.type[i] = GateType(gates, i);
+        out.kind = m_kind;
+        out.fanin = m_fanin;
+        out.fanout = m_fanout;
+        out.init.assign(m_state.begin(), m_state.end());
+        out.instances.clear();
+        out.owner.clear();
+        if (!m_instances.empty()) FlattenInstances(out);
+
+        // ֲ޸ĺ m_level ܹʱ·ֲ
+        size_t total = out.kind.size();
+        std::vector<int> level, cyclic;
+        LevelizeGates(out.kind, out.fanin, out.fanout, level, cyclic);
+        out.order.resize(total);
+        for (size_t i = 0; i < total; ++i) out.order[i] = (int)i;
+        std::stable_sort(out.order.begin(), out.order.end(), [&level](int a, int b) { return level[a] < level[b]; });
+
+        out.inputs.clear();
+        out.outputs.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (out.kind[i] == GateKind::Switch) out.inputs.push_back((int)i);
+            if (out.kind[i] == GateKind::Led) out.outputs.push_back((int)i);
+        }
+        if (out.outputs.empty()) {
+            for (size_t i = 0; i < n; ++i) {
+                if (out.fanout[i].empty() && out.kind[i] != GateKind::Switch && out.kind[i] != GateKind::Clock) {
+                    out.outputs.push_back((int)i);
+                }
+            }
+        }
+    }
+
+    int GetValue(int index) const { return m_value[index]; }
+    // ϴȫÿķת
+    const std::vector<uint64_t>& GetToggleCounts() const { return m_toggles; }
+    const std::vector<std::vector<int>>& GetFanout() const { return m_fanout; }
+    size_t GetClockEdges() const { return m_clockEdges; }
+    // ţʱΪ -1
+    int GetWireDriver(int index) const { return m_wireDriver[m_wireIds[index]]; }
+    const std::vector<int>& GetFanin(int index) const { return m_fanin[index]; }
+    // Žӵŵĵڼֻӵ·ʵж
+    int GetDriverPort(int index, size_t pin) const { return m_fanin[index][pin] >= 0 ? FaninPort(index, pin) : 0; }
+    int GetArrival(int index) const { return m_arrival[index]; }
+    int GetMaxArrival() const { return m_maxArrival; }
+    size_t GetLastEvaluated() const { return m_lastEvaluated; }
+    bool IsUnstable() const { return m_unstable; }
+
+private:
+    struct ConnNode {
+        enum Kind { InputPin, OutputPin, WireEnd };
+        Kind kind;
+        int id;   // Ż߱
+        int sub;  // Ż߶˵(0/1)
+        wxPoint pos;
+    };
+
+    bool m_valid;
+    std::vector<GateKind> m_kind;
+    std::vector<wxPoint> m_pos;
+    std::vector<int> m_delay;
+    std::vector<unsigned char> m_state;      // 趨ֵʱӵƽ/ֵ
+    std::vector<unsigned char> m_prevClock;  // һֵʱ CLK ƽ
+    std::vector<unsigned char> m_sampledD;   // ʱӵǰ D ֵ
+    bool m_inClockTick = false;
+    std::vector<unsigned char> m_value;
+    std::vector<uint64_t> m_toggles;
+    size_t m_clockEdges = 0;
+    std::vector<int> m_arrival;
+    std::vector<int> m_level;               // ֵֻ˳ֲ޸ĺʱ
+    std::vector<std::vector<int>> m_fanin;  // ÿŵţ-1 ʾ
+    std::vector<std::vector<int>> m_fanout;
+
+    // ӵ·ʵֻڲʱԪ״̬˿ڵֵڲɶ干
+    struct Instance {
+        std::shared_ptr<const SubcircuitDef> def;
+        std::vector<unsigned char> state;
+        std::vector<unsigned char> prevClock;
+        std::vector<unsigned char> sampled;
+        std::vector<unsigned char> outputs;
+        bool primed = false;                // һֵ֮żʱ
+    };
+    std::vector<int> m_inst;                //  -> m_instances еţͨΪ -1
+    std::vector<Instance> m_instances;
+    // ʵ 0 ţΪ ( << 32) | ţֵΪ˿
+    std::unordered_map<long long, int> m_faninPort;
+    std::vector<unsigned char> m_scratch;
+    std::vector<unsigned char> m_portValues;
+
+    int m_maxArrival;
+    size_t m_lastEvaluated;
+    bool m_unstable;
+
+    // ʹڲţɾʱҪ
+    std::vector<int> m_wireIds;
+    std::vector<std::pair<wxPoint, wxPoint>> m_wireEnds;
+    std::vector<int> m_wireDriver;
+    int m_nextWireId;
+
+    // λӱ߳Ϊ PIN_TOLERANCEѯʱ 3x3 
+    std::unordered_map<long long, std::vector<ConnNode>> m_cells;
+
+    // ͨķʱ
+    std::vector<unsigned> m_wireVisit;
+    std::vector<unsigned> m_pinVisit;
+    std::vector<unsigned> m_pinVisitBits;   // ǰ 16 ÿռ/λ
+    std::unordered_set<long long> m_pinVisitExtra;  // ˿ڸӵ·ʵΪ ( << 32) | λ
+    unsigned m_epoch;
+
+    // һδ·δʱֲţɵ÷ȫؽ
+    bool CanUpdate() {
+        if (m_unstable) m_valid = false;
+        return m_valid;
+    }
+
+    static int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+    static long long CellKey(int cx, int cy) { return ((long long)cx << 32) ^ (unsigned int)cy; }
+
+    // initState Ϊ true ʱô/ĳʼֵ༭ʱǰ״̬
+    void LoadGate(const wxString& type, const std::vector<Property>& props, int index, bool initState) {
+        m_kind[index] = GetGateKind(type);
+        if (m_kind[index] == GateKind::Subcircuit) LoadInstance(type, index, initState);
+        const PinLayout& layout = Layout(index);
+        m_fanin[index].resize(layout.inputs.size(), -1);
+        m_delay[index] = (int)GetIntProperty(props, PROP_DELAY, 0);
+        if (m_kind[index] == GateKind::Switch) {
+            m_state[index] = IsSwitchOn(props) ? 1 : 0;
+        }
+        else if (IsSequential(m_kind[index]) && initState) {
+            m_state[index] = GetBoolProperty(props, PROP_INIT, false) ? 1 : 0;
+        }
+    }
+
+    void LoadInstance(const wxString& type, int index, bool initState) {
+        const std::shared_ptr<const SubcircuitDef>& def = subcircuitLibrary.find(type)->second;
+        if (m_inst[index] < 0) {
+            m_inst[index] = (int)m_instances.size();
+            m_instances.push_back(Instance());
+        }
+        Instance& inst = m_instances[m_inst[index]];
+        if (!initState && inst.def == def) return;
+        inst.def = def;
+        inst.state = def->init;
+        inst.prevClock.assign(def->flops.size(), 0);
+        inst.sampled.assign(def->flops.size(), 0);
+        inst.outputs.assign(def->outputs.size(), 0);
+        inst.primed = false;
+    }
+
+    const PinLayout& Layout(int g) const {
+        return m_inst[g] >= 0 ? m_instances[m_inst[g]].def->pins : GetPinLayout(m_kind[g]);
+    }
+
+    static long long PortKey(int g, size_t pin) { return ((long long)g << 32) | (unsigned int)pin; }
+
+    int FaninPort(int g, size_t pin) const {
+        if (m_inst[m_fanin[g][pin]] < 0) return 0;
+        auto it = m_faninPort.find(PortKey(g, pin));
+        return it == m_faninPort.end() ? 0 : it->second;
+    }
+
+    int OutputValue(int d, int port) const {
+        return port == 0 ? m_value[d] : m_instances[m_inst[d]].outputs[port];
+    }
+
+    int InputValue(int g, size_t pin) const {
+        const std::vector<int>& in = m_fanin[g];
+        if (pin >= in.size() || in[pin] < 0) return 0;
+        return m_inst[in[pin]] < 0 ? m_value[in[pin]] : OutputValue(in[pin], FaninPort(g, pin));
+    }
+
+    // ȫֵ󴥷δ CLK ĵǰƽ¼Ϊ
+    void SyncClockInputs() {
+        for (size_t g = 0; g < m_kind.size(); ++g) {
+            if (m_kind[g] == GateKind::Dff) m_prevClock[g] = (unsigned char)InputValue((int)g, 1);
+        }
+    }
+
+    std::vector<wxPoint> PinPositions(int index) const {
+        std::vector<wxPoint> pts;
+        const PinLayout& layout = Layout(index);
+        for (auto& off : layout.inputs) pts.push_back(m_pos[index] + off);
+        for (auto& off : layout.outputs) pts.push_back(m_pos[index] + off);
+        return pts;
+    }
+
+    void InsertNode(const ConnNode& node) {
+        long long key = CellKey(FloorDiv(node.pos.x, PIN_TOLERANCE), FloorDiv(node.pos.y, PIN_TOLERANCE));
+        m_cells[key].push_back(node);
+    }
+
+    void RemoveNode(const wxPoint& pos, ConnNode::Kind kind, int id, int sub) {
+        long long key = CellKey(FloorDiv(pos.x, PIN_TOLERANCE), FloorDiv(pos.y, PIN_TOLERANCE));
+        auto it = m_cells.find(key);
+        if (it == m_cells.end()) return;
+        auto& vec = it->second;
+        for (size_t i = 0; i < vec.size(); ++i) {
+            if (vec[i].kind == kind && vec[i].id == id && vec[i].sub == sub) {
+                vec[i] = vec.back();
+                vec.pop_back();
+                break;
+            }
+        }
+        if (vec.empty()) m_cells.erase(it);
+    }
+
+    void InsertPins(int index) {
+        const PinLayout& layout = Layout(index);
+        for (size_t p = 0; p < layout.inputs.size(); ++p) {
+            InsertNode({ ConnNode::InputPin, index, (int)p, m_pos[index] + layout.inputs[p] });
+        }
+        for (size_t p = 0; p < layout.outputs.size(); ++p) {
+            InsertNode({ ConnNode::OutputPin, index, (int)p, m_pos[index] + layout.outputs[p] });
+        }
+    }
+
+    void RemovePins(int index) {
+        const PinLayout& layout = Layout(index);
+        for (size_t p = 0; p < layout.inputs.size(); ++p) {
+            RemoveNode(m_pos[index] + layout.inputs[p], ConnNode::InputPin, index, (int)p);
+        }
+        for (size_t p = 0; p < layout.outputs.size(); ++p) {
+            RemoveNode(m_pos[index] + layout.outputs[p], ConnNode::OutputPin, index, (int)p);
+        }
+    }
+
+    void InsertWire(const Wire& w) {
+        int id = m_nextWireId++;
+        m_wireIds.push_back(id);
+        m_wireEnds.push_back(std::make_pair(w.Start(), w.End()));
+        m_wireDriver.push_back(-1);
+        InsertNode({ ConnNode::WireEnd, id, 0, w.Start() });
+        InsertNode({ ConnNode::WireEnd, id, 1, w.End() });
+    }
+
+    // Ӹλøÿڵռͨȷŵš
+    // 仯׷ӵ touched С
+    void ResolveNets(const std::vector<wxPoint>& seeds, std::vector<int>& touched) {
+        NewVisitEpoch();
+        std::vector<ConnNode> starts;
+        for (auto& seed : seeds) {
+            starts.clear();
+            CollectNear(seed, starts);
+            for (auto& start : starts) {
+                if (start.kind == ConnNode::WireEnd ? m_wireVisit[start.id] == m_epoch : IsPinVisited(start)) {
+                    continue;
+                }
+                ResolveComponent(start.pos, touched);
+            }
+        }
+    }
+
+    // ʱõִκűʾʱҪ
+    void NewVisitEpoch() {
+        m_wireVisit.resize(m_wireEnds.size(), 0);
+        m_pinVisit.resize(m_kind.size(), 0);
+        m_pinVisitBits.resize(m_kind.size(), 0);
+        m_pinVisitExtra.clear();
+        if (++m_epoch == 0) {
+            std::fill(m_wireVisit.begin(), m_wireVisit.end(), 0);
+            std::fill(m_pinVisit.begin(), m_pinVisit.end(), 0);
+            m_epoch = 1;
+        }
+    }
+
+    static int PinBitIndex(const ConnNode& node) {
+        return node.sub * 2 + (node.kind == ConnNode::OutputPin ? 1 : 0);
+    }
+
+    static long long PinKey(const ConnNode& node) {
+        return ((long long)node.id << 32) | (unsigned)PinBitIndex(node);
+    }
+
+    bool IsPinVisited(const ConnNode& node) const {
+        if (m_pinVisit[node.id] != m_epoch) return false;
+        int bit = PinBitIndex(node);
+        if (bit >= 32) return m_pinVisitExtra.count(PinKey(node)) != 0;
+        return (m_pinVisitBits[node.id] & (1u << bit)) != 0;
+    }
+
+    // ѷʣ֮ǰѷʹʱ false
+    bool VisitPin(const ConnNode& node) {
+        if (m_pinVisit[node.id] != m_epoch) {
+            m_pinVisit[node.id] = m_epoch;
+            m_pinVisitBits[node.id] = 0;
+        }
+        int bit = PinBitIndex(node);
+        if (bit >= 32) return m_pinVisitExtra.insert(PinKey(node)).second;
+        if (m_pinVisitBits[node.id] & (1u << bit)) return false;
+        m_pinVisitBits[node.id] |= 1u << bit;
+        return true;
+    }
+
+    void CollectNear(const wxPoint& p, std::vector<ConnNode>& out) const {
+        int cx = FloorDiv(p.x, PIN_TOLERANCE), cy = FloorDiv(p.y, PIN_TOLERANCE);
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                auto it = m_cells.find(CellKey(cx + dx, cy + dy));
+                if (it == m_cells.end()) continue;
+                for (auto& node : it->second) {
+                    if (std::abs(node.pos.x - p.x) <= PIN_TOLERANCE && std::abs(node.pos.y - p.y) <= PIN_TOLERANCE) {
+                        out.push_back(node);
+                    }
+                }
+            }
+        }
+    }
+
+    void ResolveComponent(const wxPoint& origin, std::vector<int>& touched) {
+        std::vector<wxPoint> stack(1, origin);
+        std::vector<std::pair<int, int>> sinks;
+        std::vector<int> wires;
+        std::vector<ConnNode> nearby;
+        int driver = -1, driverPort = 0;
+        while (!stack.empty()) {
+            wxPoint p = stack.back();
+            stack.pop_back();
+            nearby.clear();
+            CollectNear(p, nearby);
+            for (auto& node : nearby) {
+                if (node.kind == ConnNode::WireEnd) {
+                    if (m_wireVisit[node.id] != m_epoch) {
+                        m_wireVisit[node.id] = m_epoch;
+                        wires.push_back(node.id);
+                        stack.push_back(m_wireEnds[node.id].first);
+                        stack.push_back(m_wireEnds[node.id].second);
+                    }
+                    continue;
+                }
+                if (!VisitPin(node)) continue;
+                stack.push_back(node.pos);
+                if (node.kind == ConnNode::OutputPin) {
+                    if (driver < 0 || node.id < driver || (node.id == driver && node.sub < driverPort)) {
+                        driver = node.id;
+                        driverPort = node.sub;
+                    }
+                }
+                else {
+                    sinks.push_back(std::make_pair(node.id, node.sub));
+                }
+            }
+        }
+
+        for (int w : wires) m_wireDriver[w] = driver;
+        for (auto& s : sinks) {
+            int g = s.first, pin = s.second;
+            int old = m_fanin[g][pin];
+            int oldPort = old >= 0 ? FaninPort(g, pin) : 0;
+            if (old == driver && oldPort == driverPort) continue;
+            if (driverPort != 0) m_faninPort[PortKey(g, pin)] = driverPort;
+            else if (oldPort != 0) m_faninPort.erase(PortKey(g, pin));
+            if (old >= 0) {
+                auto& fo = m_fanout[old];
+                auto pos = std::find(fo.begin(), fo.end(), g);
+                if (pos != fo.end()) fo.erase(pos);
+            }
+            if (driver >= 0) {
+                m_fanout[driver].push_back(g);
+                m_level[g] = std::max(m_level[g], m_level[driver] + 1);
+            }
+            m_fanin[g][pin] = driver;
+            touched.push_back(g);
+        }
+    }
+
+    void ComputeLevels(std::vector<int>& cyclic) {
+        LevelizeGates(m_kind, m_fanin, m_fanout, m_level, cyclic);
+    }
+
+    // ¼һŵֵ͵ʱ䣬б仯ʱ true
+    bool Evaluate(int g) {
+        if (m_kind[g] == GateKind::Dff) return EvaluateFlipFlop(g);
+        if (m_inst[g] >= 0) return EvaluateInstance(g);
+        const std::vector<int>& in = m_fanin[g];
+        int arrival = 0;
+        int a = 0, b = 0;
+        for (size_t i = 0; i < in.size(); ++i) {
+            int v = 0;
+            if (in[i] >= 0) {
+                v = InputValue(g, i);
+                arrival = std::max(arrival, m_arrival[in[i]]);
+            }
+            if (i == 0) a = v;
+            else b = v;
+        }
+        int value = m_value[g];
+        switch (m_kind[g]) {
+        case GateKind::And: value = a & b; break;
+        case GateKind::Or: value = a | b; break;
+        case GateKind::Not: value = !a; break;
+        case GateKind::Xor: value = a ^ b; break;
+        case GateKind::Nand: value = !(a & b); break;
+        case GateKind::Nor: value = !(a | b); break;
+        case GateKind::Xnor: value = !(a ^ b); break;
+        case GateKind::Buffer: value = a; break;
+        case GateKind::Led: value = a; break;
+        case GateKind::Switch: value = m_state[g]; break;
+        case GateKind::Clock: value = m_state[g]; break;
+        case GateKind::Latch:
+            // ʹΪ 1 ʱ͸򱣳
+            if (b) m_state[g] = (unsigned char)a;
+            value = m_state[g];
+            break;
+        default: value = 0; break;
+        }
+        arrival += m_delay[g];
+        bool changed = value != m_value[g] || arrival != m_arrival[g];
+        m_value[g] = (unsigned char)value;
+        m_arrival[g] = arrival;
+        return changed;
+    }
+
+    // D CLK ʱ Dֻ״̬ʱΪʱӵӳ
+    bool EvaluateFlipFlop(int g) {
+        int clock = InputValue(g, 1);
+        if (clock && !m_prevClock[g]) {
+            m_state[g] = m_inClockTick ? m_sampledD[g] : (unsigned char)InputValue(g, 0);
+        }
+        m_prevClock[g] = (unsigned char)clock;
+        int value = m_state[g];
+        int arrival = m_delay[g];
+        bool changed = value != m_value[g] || arrival != m_arrival[g];
+        m_value[g] = (unsigned char)value;
+        m_arrival[g] = arrival;
+        return changed;
+    }
+
+    // ӵ·ʵռ˿ڵֵö干ڲֵʱȡڵ·
+    bool EvaluateInstance(int g) {
+        Instance& inst = m_instances[m_inst[g]];
+        const SubcircuitDef& def = *inst.def;
+        const std::vector<int>& in = m_fanin[g];
+        int arrival = 0;
+        m_portValues.assign(in.size(), 0);
+        for (size_t i = 0; i < in.size(); ++i) {
+            if (in[i] < 0) continue;
+            m_portValues[i] = (unsigned char)InputValue(g, i);
+            arrival = std::max(arrival, m_arrival[in[i]]);
+        }
+        m_scratch.resize(def.net.kind.size());
+        RunSubcircuit(def, m_portValues.data(), inst.state.data(), inst.prevClock.data(),
+            m_inClockTick ? inst.sampled.data() : nullptr, inst.primed, m_scratch.data());
+        inst.primed = true;
+
+        bool changed = false;
+        for (size_t k = 0; k < def.outputs.size(); ++k) {
+            unsigned char v = m_scratch[def.outputs[k]];
+            if (inst.outputs[k] != v) {
+                inst.outputs[k] = v;
+                changed = true;
+            }
+        }
+        int value = inst.outputs.empty() ? 0 : inst.outputs[0];
+        arrival += def.delay;
+        changed = changed || value != m_value[g] || arrival != m_arrival[g];
+        m_value[g] = (unsigned char)value;
+        m_arrival[g] = arrival;
+        return changed;
+    }
+
+    // ʱӵǰʵڲÿ D״̬ĸֵıʵ
+    void SampleInstance(int g) {
+        Instance& inst = m_instances[m_inst[g]];
+        const SubcircuitDef& def = *inst.def;
+        if (def.flops.empty()) return;
+        const std::vector<int>& in = m_fanin[g];
+        m_portValues.assign(in.size(), 0);
+        for (size_t i = 0; i < in.size(); ++i) m_portValues[i] = (unsigned char)InputValue(g, i);
+        std::vector<unsigned char> state = inst.state, prevClock = inst.prevClock;
+        m_scratch.resize(def.net.kind.size());
+        RunSubcircuit(def, m_portValues.data(), state.data(), prevClock.data(), nullptr, false, m_scratch.data());
+        for (size_t f = 0; f < def.flops.size(); ++f) {
+            int d = def.net.fanin[def.flops[f]][0];
+            inst.sampled[f] = d >= 0 ? m_scratch[d] : 0;
+        }
+    }
+
+    // ʵչżڲ׷ڶ֮˿ڱⲿĻ
+    // ˿ LED ɻʵŴ 0 ֤Ų
+    void FlattenInstances(LevelizedNetlist& out) const {
+        size_t n = m_kind.size();
+        out.owner.assign(n, -1);
+        std::vector<int> base(n, -1);
+        for (size_t g = 0; g < n; ++g) {
+            if (m_inst[g] < 0) continue;
+            const Instance& inst = m_instances[m_inst[g]];
+            const LevelizedNetlist& dn = inst.def->net;
+            int b = (int)out.kind.size();
+            base[g] = b;
+            int owner = (int)out.instances.size();
+            out.instances.push_back({ (int)g, b, inst.def });
+            out.owner[g] = owner;
+            for (size_t k = 0; k < dn.kind.size(); ++k) {
+                GateKind kind = dn.kind[k];
+                std::vector<int> fanin = dn.fanin[k];
+                for (int& d : fanin) if (d >= 0) d += b;
+                unsigned char init = dn.init[k];
+                int slot = inst.def->stateSlot[k];
+                if (slot >= 0) init = inst.state[slot];
+                if (kind == GateKind::Led) kind = GateKind::Buffer;
+                out.type.push_back(dn.type[k]);
+                out.kind.push_back(kind);
+                out.fanin.push_back(fanin);
+                out.init.push_back(init);
+                out.owner.push_back(owner);
+            }
+            const std::vector<int>& ins = inst.def->inputs;
+            for (size_t p = 0; p < ins.size(); ++p) {
+                out.kind[b + ins[p]] = GateKind::Buffer;
+                out.fanin[b + ins[p]].assign(1, -1);
+            }
+            const std::vector<int>& outs = inst.def->outputs;
+            out.kind[g] = outs.empty() ? GateKind::Unknown : GateKind::Buffer;
+            out.fanin[g].assign(outs.empty() ? 0 : 1, outs.empty() ? -1 : b + outs[0]);
+        }
+
+        // ʵŸĽӵӦڲţʵ˿ڵĻⲿ
+        auto driverOf = [&](int g, size_t pin) {
+            int d = m_fanin[g][pin];
+            if (d < 0 || m_inst[d] < 0) return d;
+            int port = FaninPort(g, pin);
+            return port == 0 ? d : base[d] + m_instances[m_inst[d]].def->outputs[port];
+        };
+        for (size_t g = 0; g < n; ++g) {
+            if (m_inst[g] >= 0) {
+                const std::vector<int>& ins = m_instances[m_inst[g]].def->inputs;
+                for (size_t p = 0; p < ins.size() && p < m_fanin[g].size(); ++p) {
+                    out.fanin[base[g] + ins[p]][0] = driverOf((int)g, p);
+                }
+            }
+            else {
+                for (size_t p = 0; p < m_fanin[g].size(); ++p) out.fanin[g][p] = driverOf((int)g, p);
+            }
+        }
+
+        out.fanout.assign(out.kind.size(), std::vector<int>());
+        for (size_t g = 0; g < out.kind.size(); ++g) {
+            for (int d : out.fanin[g]) if (d >= 0) out.fanout[d].push_back((int)g);
+        }
+    }
+
+    // ¼δӵ͵ߴֵٱ仯Ų󴫲
+    void Propagate(const std::vector<int>& seeds) {
+        typedef std::pair<int, int> Item; // (, )
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+        std::unordered_set<int> inQueue;
+        for (int g : seeds) {
+            if (inQueue.insert(g).second) queue.push(Item(m_level[g], g));
+        }
+
+        // ϻ·񵴣ֵ
+        size_t limit = 16 * (m_kind.size() + 1);
+        size_t evaluated = 0;
+        bool lostMax = false;
+        while (!queue.empty()) {
+            int g = queue.top().second;
+            queue.pop();
+            inQueue.erase(g);
+            int oldArrival = m_arrival[g];
+            unsigned char oldValue = m_value[g];
+            bool changed = Evaluate(g);
+            if (m_value[g] != oldValue) ++m_toggles[g];
+            if (++evaluated > limit) {
+                m_unstable = true;
+                break;
+            }
+            if (!changed) continue;
+            if (m_arrival[g] > m_maxArrival) m_maxArrival = m_arrival[g];
+            else if (oldArrival == m_maxArrival && m_arrival[g] < oldArrival) lostMax = true;
+            for (int s : m_fanout[g]) {
+                if (inQueue.insert(s).second) queue.push(Item(m_level[s], s));
+            }
+        }
+        m_lastEvaluated = evaluated;
+        if (lostMax || m_unstable) RecomputeMaxArrival();
+    }
+
+    void RecomputeMaxArrival() {
+        m_maxArrival = 0;
+        for (int a : m_arrival) m_maxArrival = std::max(m_maxArrival, a);
+    }
+};
+
+// ===== ӵ· =====
+static int nextSubcircuitId = 0;
+
+// Ķ˿ɷţңż 40 ֤
+static void BuildSubcircuitSymbol(SubcircuitDef& def, const std::vector<Gate>& gates) {
+    int rows = (int)std::max(std::max(def.inputs.size(), def.outputs.size()), (size_t)1);
+    def.size = wxSize(80, rows * 40);
+    std::vector<Shape> symbol;
+    Shape box;
+    box.type = ShapeType::Polygon;
+    box.pts = { wxPoint(0, 0), wxPoint(80, 0), wxPoint(80, rows * 40), wxPoint(0, rows * 40) };
+    symbol.push_back(box);
+    Shape title;
+    title.type = ShapeType::Text;
+    title.text = def.name;
+    title.center = wxPoint(0, -18);
+    symbol.push_back(title);
+
+    for (size_t k = 0; k < def.inputs.size(); ++k) {
+        int y = 20 + 40 * (int)k;
+        def.pins.inputs.push_back(wxPoint(-20, y));
+        Shape lead;
+        lead.type = ShapeType::Line;
+        lead.pts = { wxPoint(-20, y), wxPoint(0, y) };
+        symbol.push_back(lead);
+        Shape label;
+        label.type = ShapeType::Text;
+        label.text = GetGateKind(gates[def.inputs[k]].type) == GateKind::Clock ? wxString("CLK") : wxString::Format("I%zu", k);
+        label.center = wxPoint(4, y - 8);
+        symbol.push_back(label);
+    }
+    for (size_t k = 0; k < def.outputs.size(); ++k) {
+        int y = 20 + 40 * (int)k;
+        def.pins.outputs.push_back(wxPoint(100, y));
+        Shape lead;
+        lead.type = ShapeType::Line;
+        lead.pts = { wxPoint(80, y), wxPoint(100, y) };
+        symbol.push_back(lead);
+        Shape label;
+        label.type = ShapeType::Text;
+        label.text = wxString::Format("O%zu", k);
+        label.center = wxPoint(56, y - 8);
+        symbol.push_back(label);
+    }
+    shapeLibrary[def.name] = symbol;
+}
+
+// һźΪӵ·岢⡣replace Ϊ false ʱж
+bool DefineSubcircuit(const wxString& name, const std::vector<Gate>& gates, const std::vector<Wire>& wires,
+    bool replace, wxString& error) {
+    if (name.empty()) {
+        error = "ӵ·ƲΪ";
+        return false;
+    }
+    bool exists = subcircuitLibrary.count(name) != 0;
+    if ((exists && !replace) || (!exists && shapeLibrary.count(name))) {
+        error = wxString::Format("Ϊ %s ", name);
+        return false;
+    }
+
+    std::shared_ptr<SubcircuitDef> def = std::make_shared<SubcircuitDef>();
+    def->name = name;
+    def->gates = gates;
+    def->wires = wires;
+
+    CircuitAnalyzer analyzer;
+    analyzer.Build(gates, wires);
+    analyzer.ExportNetlist(gates, def->net);
+
+    size_t m = def->net.kind.size();
+    def->port.assign(m, -1);
+    def->stateSlot.assign(m, -1);
+    for (size_t g = 0; g < gates.size(); ++g) {
+        GateKind kind = def->net.kind[g];
+        if (kind == GateKind::Switch || kind == GateKind::Clock) def->inputs.push_back((int)g);
+        if (kind == GateKind::Led) def->outputs.push_back((int)g);
+    }
+    if (def->inputs.empty() && def->outputs.empty()) {
+        error = "ӵ·ûж˿ڣÿػʱΪ룬LED Ϊ";
+        return false;
+    }
+    auto byPosition = [&gates](int a, int b) {
+        const wxPoint& pa = gates[a].pos;
+        const wxPoint& pb = gates[b].pos;
+        return pa.y != pb.y ? pa.y < pb.y : pa.x < pb.x;
+    };
+    std::stable_sort(def->inputs.begin(), def->inputs.end(), byPosition);
+    std::stable_sort(def->outputs.begin(), def->outputs.end(), byPosition);
+    for (size_t k = 0; k < def->inputs.size(); ++k) def->port[def->inputs[k]] = (int)k;
+
+    // ǶʵչʱԪҲһ״̬
+    // ʼֵȡԣǶ׶ĳʼֵֵ֮ĵǰ״̬
+    for (size_t g = 0; g < m; ++g) {
+        if (!IsSequential(def->net.kind[g])) continue;
+        unsigned char init;
+        if (g < gates.size()) {
+            init = GetBoolProperty(gates[g], PROP_INIT, false) ? 1 : 0;
+        }
+        else {
+            const NetlistInstance& inst = def->net.instances[def->net.owner[g]];
+            init = inst.def->init[inst.def->stateSlot[g - inst.base]];
+        }
+        def->net.init[g] = init;
+        def->stateSlot[g] = (int)def->init.size();
+        def->init.push_back(init);
+        if (def->net.kind[g] == GateKind::Dff) def->flops.push_back((int)g);
+    }
+    std::vector<int> level, cyclic;
+    LevelizeGates(def->net.kind, def->net.fanin, def->net.fanout, level, cyclic);
+    def->cyclic = !cyclic.empty();
+    for (int g : def->outputs) def->delay = std::max(def->delay, analyzer.GetArrival(g));
+
+    BuildSubcircuitSymbol(*def, gates);
+    def->id = nextSubcircuitId++;  // ֻжɹռñ
+    subcircuitLibrary[name] = def;
+    return true;
+}
+
+// ˳г壬Ƕ׵ĶĶ֮ǰ
+// ˳УǶ׵ĶĶ֮ǰʱ˳弴ɽ
+// 滻Ķű󣬲ֻûϵİţ˳
+std::vector<std::shared_ptr<const SubcircuitDef>> GetSubcircuitDefinitions() {
+    std::vector<std::shared_ptr<const SubcircuitDef>> byId;
+    for (auto& entry : subcircuitLibrary) byId.push_back(entry.second);
+    std::sort(byId.begin(), byId.end(), [](const std::shared_ptr<const SubcircuitDef>& a, const std::shared_ptr<const SubcircuitDef>& b) {
+        return a->id < b->id;
+    });
+    std::vector<std::shared_ptr<const SubcircuitDef>> defs;
+    std::set<wxString> seen;
+    std::function<void(const std::shared_ptr<const SubcircuitDef>&)> place = [&](const std::shared_ptr<const SubcircuitDef>& def) {
+        if (!seen.insert(def->name).second) return;
+        for (const Gate& g : def->gates) {
+            auto it = subcircuitLibrary.find(g.type);
+            if (it != subcircuitLibrary.end()) place(it->second);
+        }
+        defs.push_back(def);
+    };
+    for (auto& def : byId) place(def);
+    return defs;
+}
+
+json GateToJson(const Gate& gate) {
+    json gateJson;
+    gateJson["type"] = gate.type.ToStdString();
+    gateJson["x"] = gate.pos.x;
+    gateJson["y"] = gate.pos.y;
+
+    std::vector<json> propsJson;
+    for (auto& prop : gate.properties) {
+        json propJson;
+        propJson["name"] = prop.GetName().ToStdString();
+        propJson["value"] = prop.GetValueString().ToStdString();
+        propJson["type"] = prop.GetTypeName();
+        propsJson.push_back(propJson);
+    }
+    gateJson["properties"] = propsJson;
+    return gateJson;
+}
+
+Gate GateFromJson(const json& gateJson) {
+    Gate gate;
+    gate.type = gateJson["type"].get<std::string>();
+    gate.pos.x = gateJson["x"];
+    gate.pos.y = gateJson["y"];
+    if (gateJson.find("properties") != gateJson.end()) {
+        for (auto& propJson : gateJson["properties"]) {
+            gate.properties.push_back(Property::Parse(propJson["name"].get<std::string>(),
+                propJson["value"].get<std::string>(), propJson["type"].get<std::string>()));
+        }
+    }
+    return gate;
+}
+
+// ˵ x1/y1/x2/y2߱Ϊ "points": [[x, y], ...]
+json WireToJson(const Wire& w) {
+    if (w.points.size() == 2) {
+        return { { "x1", w.Start().x }, { "y1", w.Start().y }, { "x2", w.End().x }, { "y2", w.End().y } };
+    }
+    json pts = json::array();
+    for (auto& p : w.points) pts.push_back({ p.x, p.y });
+    return { { "points", pts } };
+}
+
+// ҲԼдıʽʱ׳쳣ɵ÷Ϊʧܴ
+Wire WireFromJson(const json& wireJson) {
+    if (wireJson.find("points") != wireJson.end()) {
+        std::vector<wxPoint> pts;
+        for (auto& p : wireJson["points"]) pts.push_back(wxPoint(p.at(0), p.at(1)));
+        if (pts.size() < 2) throw std::runtime_error("wire needs at least 2 points");
+        return Wire(std::move(pts));
+    }
+    return Wire(wxPoint(wireJson.at("x1"), wireJson.at("y1")), wxPoint(wireJson.at("x2"), wireJson.at("y2")));
+}
+
+// ·ļе "subcircuits" 飺ÿ屣Լź
+json SubcircuitsToJson(const std::vector<std::shared_ptr<const SubcircuitDef>>& defs) {
+    json defsJson = json::array();
+    for (auto& def : defs) {
+        json defJson;
+        defJson["name"] = def->name.ToStdString();
+        std::vector<json> gatesJson;
+        for (auto& gate : def->gates) gatesJson.push_back(GateToJson(gate));
+        defJson["gates"] = gatesJson;
+        std::vector<json> wiresJson;
+        for (auto& w : def->wires) wiresJson.push_back(WireToJson(w));
+        defJson["wires"] = wiresJson;
+        defsJson.push_back(defJson);
+    }
+    return defsJson;
+}
+
+json SubcircuitsToJson() { return SubcircuitsToJson(GetSubcircuitDefinitions()); }
+
+// ļеĶ壬ͬļΪ׼¼׷ӵ added
+bool LoadSubcircuitsFromJson(const json& defsJson, std::vector<wxString>& added, wxString& error) {
+    for (auto& defJson : defsJson) {
+        wxString name = defJson["name"].get<std::string>();
+        std::vector<Gate> gates;
+        for (auto& gateJson : defJson["gates"]) gates.push_back(GateFromJson(gateJson));
+        std::vector<Wire> wires;
+        if (defJson.find("wires") != defJson.end()) {
+            for (auto& wireJson : defJson["wires"]) wires.push_back(WireFromJson(wireJson));
+        }
+        bool exists = subcircuitLibrary.count(name) != 0;
+        if (!DefineSubcircuit(name, gates, wires, true, error)) return false;
+        if (!exists) added.push_back(name);
+    }
+    return true;
+}
+
+// =====  =====
+// ƵԽ JSON ıŵϵͳ壬ͬʱõźߣ
+// ڱճʱֻҪıûб仯ֱʹû壬½
+static const char* const CLIPBOARD_FORMAT = "circuit-clipboard";
+
+struct ClipboardContent {
+    std::vector<Gate> gates;    //  origin
+    std::vector<Wire> wires;
+    wxPoint origin;             // ʱѡϽ
+    std::string text;           // л
+};
+
+// ѡڲߣ˵㶼ѡŵŻڲߵĶ˵ϣҲӵδѡе
+template <class Gates>
+std::vector<int> CollectInternalWires(const Gates& gates, const std::vector<Wire>& wires, const std::vector<int>& members) {
+    auto cellOf = [](int v) { return v >= 0 ? v / PIN_TOLERANCE : -((-v + PIN_TOLERANCE - 1) / PIN_TOLERANCE); };
+    auto keyOf = [&cellOf](const wxPoint& p, int dx, int dy) { return ((long long)(cellOf(p.x) + dx) << 32) ^ (unsigned int)(cellOf(p.y) + dy); };
+    auto near = [](const wxPoint& a, const wxPoint& b) { return std::abs(a.x - b.x) <= PIN_TOLERANCE && std::abs(a.y - b.y) <= PIN_TOLERANCE; };
+
+    std::vector<char> selected(gates.size(), 0);
+    for (int g : members) selected[g] = 1;
+    // λãsecond ʾǷѡе
+    std::unordered_map<long long, std::vector<std::pair<wxPoint, char>>> pins;
+    for (size_t g = 0; g < gates.size(); ++g) {
+        const PinLayout& layout = GetPinLayout(GateType(gates, g));
+        const wxPoint& pos = GatePos(gates, g);
+        for (auto& off : layout.inputs) pins[keyOf(pos + off, 0, 0)].push_back(std::make_pair(pos + off, selected[g]));
+        for (auto& off : layout.outputs) pins[keyOf(pos + off, 0, 0)].push_back(std::make_pair(pos + off, selected[g]));
+    }
+
+    // ˵ѡŵʱΪ 1һ˵ӵδѡеţ߲ڲ
+    std::vector<char> alive(wires.size(), 0);
+    std::vector<char> anchored(wires.size() * 2, 0);
+    std::unordered_map<long long, std::vector<std::pair<int, wxPoint>>> ends;
+    for (size_t w = 0; w < wires.size(); ++w) {
+        bool foreign = false;
+        for (int e = 0; e < 2; ++e) {
+            const wxPoint& p = e == 0 ? wires[w].Start() : wires[w].End();
+            for (int dx = -1; dx <= 1; ++dx) {
+                for (int dy = -1; dy <= 1; ++dy) {
+                    auto it = pins.find(keyOf(p, dx, dy));
+                    if (it == pins.end()) continue;
+                    for (auto& pin : it->second) {
+                        if (!near(p, pin.first)) continue;
+                        if (pin.second) anchored[w * 2 + e] = 1;
+                        else foreign = true;
+                    }
+                }
+            }
+        }
+        if (foreign) continue;
+        alive[w] = 1;
+        ends[keyOf(wires[w].Start(), 0, 0)].push_back(std::make_pair((int)w, wires[w].Start()));
+        ends[keyOf(wires[w].End(), 0, 0)].push_back(std::make_pair((int)w, wires[w].End()));
+    }
+
+    // ûнѡϵĶ˵ӵһߣ޳ֱٱ仯
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (size_t w = 0; w < wires.size(); ++w) {
+            if (!alive[w]) continue;
+            for (int e = 0; e < 2 && alive[w]; ++e) {
+                if (anchored[w * 2 + e]) continue;
+                const wxPoint& p = e == 0 ? wires[w].Start() : wires[w].End();
+                bool joined = false;
+                for (int dx = -1; dx <= 1 && !joined; ++dx) {
+                    for (int dy = -1; dy <= 1 && !joined; ++dy) {
+                        auto it = ends.find(keyOf(p, dx, dy));
+                        if (it == ends.end()) continue;
+                        for (auto& end : it->second) {
+                            if (end.first != (int)w && alive[end.first] && near(p, end.second)) {
+                                joined = true;
+                                break;
+                            }
+                        }
+                    }
+                }
+                if (!joined) {
+                    alive[w] = 0;
+                    changed = true;
+                }
+            }
+        }
+    }
+
+    std::vector<int> result;
+    for (size_t w = 0; w < wires.size(); ++w) {
+        if (alive[w]) result.push_back((int)w);
+    }
+    return result;
+}
+
+// ոʽӵ·ʵʱ壬ճһҲʹ
+std::string ClipboardToText(const ClipboardContent& clip) {
+    json j;
+    j["format"] = CLIPBOARD_FORMAT;
+    j["x"] = clip.origin.x;
+    j["y"] = clip.origin.y;
+    bool hasInstance = std::any_of(clip.gates.begin(), clip.gates.end(), [](const Gate& g) { return GetGateKind(g.type) == GateKind::Subcircuit; });
+    if (hasInstance) j["subcircuits"] = SubcircuitsToJson();
+    json gatesJson = json::array();
+    for (auto& gate : clip.gates) gatesJson.push_back(GateToJson(gate));
+    j["gates"] = std::move(gatesJson);
+    json wiresJson = json::array();
+    for (auto& w : clip.wires) wiresJson.push_back(WireToJson(w));
+    j["wires"] = std::move(wiresJson);
+    return j.dump();
+}
+
+// ıеͬӵ·屣ֲ䣬¼Ķ׷ӵ added
+bool ClipboardFromText(const std::string& text, ClipboardContent& clip, std::vector<wxString>& added, wxString& error) {
+    try {
+        json j = json::parse(text);
+        if (!j.is_object() || j.find("format") == j.end() || j["format"] != CLIPBOARD_FORMAT) {
+            error = "ûе·";
+            return false;
+        }
+        if (j.find("subcircuits") != j.end()) {
+            json missing = json::array();
+            for (auto& defJson : j["subcircuits"]) {
+                if (!subcircuitLibrary.count(wxString(defJson["name"].get<std::string>()))) missing.push_back(defJson);
+            }
+            if (!LoadSubcircuitsFromJson(missing, added, error)) return false;
+        }
+        clip.origin = wxPoint(j["x"], j["y"]);
+        clip.gates.clear();
+        clip.gates.reserve(j["gates"].size());
+        for (auto& gateJson : j["gates"]) clip.gates.push_back(GateFromJson(gateJson));
+        clip.wires.clear();
+        clip.wires.reserve(j["wires"].size());
+        for (auto& wireJson : j["wires"]) clip.wires.push_back(WireFromJson(wireJson));
+        clip.text = text;
+    }
+    catch (const std::length_error& e) {
+        error = e.what();
+        return false;
+    }
+    catch (const std::exception&) {
+        error = "ûе·";
+        return false;
+    }
+    return true;
+}
+
+// ===== ̨ =====
+// ʱķڹִ߳Уͨ BACKGROUND_JOB_EVENT ڱ
+wxDECLARE_EVENT(BACKGROUND_JOB_EVENT, wxThreadEvent);
+wxDEFINE_EVENT(BACKGROUND_JOB_EVENT, wxThreadEvent);
+
+class BackgroundJob {
+public:
+    // id ͬʱе񷢳¼
+    BackgroundJob(wxEvtHandler* owner, const wxString& name, int id = wxID_ANY)
+        : m_owner(owner), m_name(name), m_id(id), m_cancel(false), m_done(false), m_progress(-1) {}
+
+    ~BackgroundJob() {
+        Cancel();
+        Join();
+    }
+
+    // work ڹִ߳У߳ڵ onFinished
+    void Start(std::function<void(BackgroundJob&)> work) {
+        m_thread = std::thread([this, work]() {
+            {
+                ScopedTimer timer(ProfileZone::Background);
+                work(*this);
+            }
+            m_done = true;
+            PostEvent(100);
+        });
+    }
+
+    void Cancel() { m_cancel = true; }
+    bool IsCancelled() const { return m_cancel; }
+    bool IsDone() const { return m_done; }
+    const wxString& GetName() const { return m_name; }
+
+    void Join() {
+        if (m_thread.joinable()) m_thread.join();
+    }
+
+    // ɹ̵߳ãٷֱȱ仯ʱŷ¼
+    void ReportProgress(double fraction) {
+        int percent = (int)(fraction * 100);
+        if (percent != m_progress.exchange(percent)) PostEvent(percent);
+    }
+
+    std::function<void()> onFinished;
+    // ̻߳ȡ shapeLibrary / subcircuitLibraryڼ̲߳޸ӵ·
+    bool readsDefinitions = false;
+
+private:
+    wxEvtHandler* m_owner;
+    wxString m_name;
+    int m_id;
+    std::thread m_thread;
+    std::atomic<bool> m_cancel;
+    std::atomic<bool> m_done;
+    std::atomic<int> m_progress;
+
+    void PostEvent(int percent) {
+        wxThreadEvent* evt = new wxThreadEvent(BACKGROUND_JOB_EVENT, m_id);
+        evt->SetInt(percent);
+        wxQueueEvent(m_owner, evt);
+    }
+};
+
+// ===== ѹļ =====
+// ·ļ gzip ѹ.json.gz / .ctb.gzʱļͷ 1f 8b ʶչ޹ء
+// ʱݰ齻̣߳ÿѹһ gzip Աԭ˳дԱβǱ׼ gzip ļ
+// ȡʱԱ߶߽ѹֻڴﱣ޵ļ
+const size_t GZIP_BLOCK_SIZE = 1 << 20;
+
+inline bool IsCompressedFileName(const wxString& filename) {
+    return filename.Lower().EndsWith(".gz");
+}
+
+// ȥ .gz ļжѹָʽ
+inline wxString StripCompressedExtension(const wxString& filename) {
+    return IsCompressedFileName(filename) ? filename.Left(filename.length() - 3) : filename;
+}
+
+bool IsGzipFile(const wxString& filename) {
+    std::ifstream f(filename.ToStdString(), std::ios::binary);
+    unsigned char magic[2] = { 0, 0 };
+    f.read((char*)magic, sizeof(magic));
+    return f.gcount() == sizeof(magic) && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// һѹһ gzip Ա
+bool CompressGzipBlock(const char* data, size_t size, std::string& out) {
+    wxMemoryOutputStream memory;
+    {
+        wxZlibOutputStream zlib(memory, wxZ_DEFAULT_COMPRESSION, wxZLIB_GZIP);
+        zlib.Write(data, size);
+        if (!zlib.Close()) return false;
+    }
+    out.resize(memory.GetSize());
+    if (!out.empty()) memory.CopyTo(&out[0], out.size());
+    return true;
+}
+
+// ѹ壺дһͽѹ̣߳ѹõĿ鰴ύ˳дĿ
+// ;Ŀ߳дѹʱȴ
+class GzipOutputBuffer : public std::streambuf {
+public:
+    explicit GzipOutputBuffer(std::ostream& out) : m_out(out) {
+        unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+        m_maxPending = threads * 2;
+        for (unsigned t = 0; t < threads; ++t) m_workers.emplace_back([this]() { WorkerLoop(); });
+        NewBlock();
+    }
+
+    ~GzipOutputBuffer() { Finish(); }
+
+    // ѹʣµݲȫд
+    bool Finish() {
+        if (m_workers.empty()) return !m_failed;
+        Submit();
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            Drain(lock, 1);
+            m_stop = true;
+        }
+        m_wake.notify_all();
+        for (auto& t : m_workers) t.join();
+        m_workers.clear();
+        return !m_failed && !m_out.fail();
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        Submit();
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+        return c;
+    }
+
+private:
+    struct Block {
+        std::string data;
+        std::string compressed;
+        bool done = false;
+        bool ok = false;
+    };
+
+    void NewBlock() {
+        m_current.reset(new Block);
+        m_current->data.resize(GZIP_BLOCK_SIZE);
+        setp(&m_current->data[0], &m_current->data[0] + GZIP_BLOCK_SIZE);
+    }
+
+    void Submit() {
+        size_t used = pptr() - pbase();
+        if (used == 0) return;
+        m_current->data.resize(used);
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_queue.push_back(m_current.get());
+        m_pending.push_back(std::move(m_current));
+        m_wake.notify_one();
+        Drain(lock, m_maxPending);
+        lock.unlock();
+        NewBlock();
+    }
+
+    // ˳дѾѹõĿ飬ֱ;Ŀ limit
+    void Drain(std::unique_lock<std::mutex>& lock, size_t limit) {
+        for (;;) {
+            while (!m_pending.empty() && m_pending.front()->done) {
+                std::unique_ptr<Block> block = std::move(m_pending.front());
+                m_pending.pop_front();
+                lock.unlock();
+                if (!block->ok) m_failed = true;
+                else m_out.write(block->compressed.data(), block->compressed.size());
+                lock.lock();
+            }
+            if (m_pending.size() < limit) return;
+            m_finished.wait(lock);
+        }
+    }
+
+    void WorkerLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_wake.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty()) return;
+            Block* block = m_queue.front();
+            m_queue.pop_front();
+            lock.unlock();
+            bool ok = CompressGzipBlock(block->data.data(), block->data.size(), block->compressed);
+            std::string().swap(block->data);
+            lock.lock();
+            block->ok = ok;
+            block->done = true;
+            m_finished.notify_all();
+        }
+    }
+
+    std::ostream& m_out;
+    std::unique_ptr<Block> m_current;
+    std::deque<std::unique_ptr<Block>> m_pending;   // ύûдĿ飬ύ˳
+    std::deque<Block*> m_queue;                     // ȴѹĿ
+    size_t m_maxPending = 2;
+    std::vector<std::thread> m_workers;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::condition_variable m_finished;
+    bool m_stop = false;
+    bool m_failed = false;
+};
+
+// Աѹ gzip ļ
+class GzipFileReader {
+public:
+    explicit GzipFileReader(const wxString& filename) : m_file(filename) {
+        if (m_file.IsOk()) m_zlib.reset(new wxZlibInputStream(m_file, wxZLIB_GZIP));
+        else m_failed = true;
+    }
+
+    //  size ֽڣʵʶֽ 0 ʾ IsOk 
+    size_t Read(char* buffer, size_t size) {
+        size_t total = 0;
+        while (total < size && m_zlib) {
+            m_zlib->Read(buffer + total, size - total);
+            total += m_zlib->LastRead();
+            if (m_zlib->GetLastError() == wxSTREAM_NO_ERROR) continue;
+            bool end = m_zlib->GetLastError() == wxSTREAM_EOF;
+            m_zlib.reset();
+            if (!end) {
+                m_failed = true;
+                break;
+            }
+            // Աʱδ˻ļ滹ݾһԱ
+            m_file.Peek();
+            if (m_file.GetLastError() == wxSTREAM_NO_ERROR) m_zlib.reset(new wxZlibInputStream(m_file, wxZLIB_GZIP));
+        }
+        return total;
+    }
+
+    bool IsOk() const { return !m_failed; }
+
+private:
+    wxFileInputStream m_file;
+    std::unique_ptr<wxZlibInputStream> m_zlib;
+    bool m_failed = false;
+};
+
+// ļѹһļ
+bool CompressFile(const wxString& from, const wxString& to) {
+    std::ifstream in(from.ToStdString(), std::ios::binary);
+    std::ofstream out(to.ToStdString(), std::ios::binary);
+    if (!in.is_open() || !out.is_open()) return false;
+    GzipOutputBuffer gzip(out);
+    std::vector<char> buffer(GZIP_BLOCK_SIZE);
+    while (in) {
+        in.read(buffer.data(), buffer.size());
+        gzip.sputn(buffer.data(), in.gcount());
+    }
+    bool ok = gzip.Finish() && in.eof();
+    out.close();
+    return ok && !out.fail();
+}
+
+// ѹļһļ
+bool DecompressFile(const wxString& from, const wxString& to) {
+    GzipFileReader reader(from);
+    std::ofstream out(to.ToStdString(), std::ios::binary);
+    if (!out.is_open()) return false;
+    std::vector<char> buffer(GZIP_BLOCK_SIZE);
+    while (size_t n = reader.Read(buffer.data(), buffer.size())) out.write(buffer.data(), n);
+    out.close();
+    return reader.IsOk() && !out.fail();
+}
+
+// ===== ·ļд =====
+bool ReadTiledCircuitFile(const wxString& filename, std::vector<Gate>& gates, std::vector<Wire>& wires,
+    std::vector<wxString>& addedDefs, wxString& error);
+
+// JSON ·ļĲн˳ɨһ飬ַֻŲΣҳ "gates"/"wires" 飬
+// Ԫر߽紦гɶΣٰ߳ѷֵĶԪؽ JSON źߣ˳ƴ
+struct JsonSpan {
+    const char* begin = nullptr;
+    const char* end = nullptr;
+};
+
+inline const char* SkipJsonSpace(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    return p;
+}
+
+// һֵλãֵʱ nullptr
+const char* SkipJsonValue(const char* p, const char* end) {
+    if (p >= end) return nullptr;
+    if (*p == '"') {
+        for (++p; p < end; ++p) {
+            if (*p == '\\') ++p;
+            else if (*p == '"') return p + 1;
+        }
+        return nullptr;
+    }
+    if (*p == '{' || *p == '[') {
+        // ӰṹַĿոռļĴ룩
+        static const struct Special {
+            bool is[256];
+            Special() : is() { is['"'] = is['{'] = is['['] = is['}'] = is[']'] = true; }
+        } special;
+        int depth = 0;
+        for (; p < end; ++p) {
+            char c = *p;
+            if (!special.is[(unsigned char)c]) continue;
+            if (c == '"') {
+                for (++p; p < end && *p != '"'; ++p) {
+                    if (*p == '\\') ++p;
+                }
+                if (p >= end) return nullptr;
+            }
+            else if (c == '{' || c == '[') ++depth;
+            else if (--depth == 0) return p + 1;
+        }
+        return nullptr;
+    }
+    while (p < end && *p != ',' && *p != ']' && *p != '}' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') ++p;
+    return p;
+}
+
+struct CircuitJsonLayout {
+    std::vector<JsonSpan> gates;        // "gates" 鰴Ԫر߽гɵĶ
+    std::vector<JsonSpan> wires;
+    JsonSpan subcircuits;
+};
+
+// 㲻Ǻ "gates" Ķʱ false÷Ҳܵõ׼ȷĴϢ
+bool ScanCircuitJson(const char* p, const char* end, size_t chunkBytes, CircuitJsonLayout& layout) {
+    bool hasGates = false;
+    p = SkipJsonSpace(p, end);
+    if (p >= end || *p != '{') return false;
+    p = SkipJsonSpace(p + 1, end);
+    while (p < end && *p != '}') {
+        const char* keyEnd = SkipJsonValue(p, end);
+        if (*p != '"' || !keyEnd) return false;
+        std::string key(p + 1, keyEnd - 1);
+        p = SkipJsonSpace(keyEnd, end);
+        if (p >= end || *p != ':') return false;
+        p = SkipJsonSpace(p + 1, end);
+
+        std::vector<JsonSpan>* chunks = key == "gates" ? &layout.gates : key == "wires" ? &layout.wires : nullptr;
+        if (chunks && p < end && *p == '[') {
+            if (chunks == &layout.gates) hasGates = true;
+            chunks->clear();
+            p = SkipJsonSpace(p + 1, end);
+            JsonSpan chunk;
+            while (p < end && *p != ']') {
+                const char* next = SkipJsonValue(p, end);
+                if (!next) return false;
+                if (!chunk.begin) chunk.begin = p;
+                chunk.end = next;
+                if ((size_t)(chunk.end - chunk.begin) >= chunkBytes) {
+                    chunks->push_back(chunk);
+                    chunk = JsonSpan();
+                }
+                p = SkipJsonSpace(next, end);
+                if (p < end && *p == ',') {
+                    p = SkipJsonSpace(p + 1, end);
+                    if (p < end && *p == ']') return false;
+                }
+                else if (p < end && *p != ']') return false;
+            }
+            if (p >= end) return false;
+            if (chunk.begin) chunks->push_back(chunk);
+            ++p;
+        }
+        else {
+            const char* valueEnd = SkipJsonValue(p, end);
+            if (!valueEnd) return false;
+            if (key == "subcircuits") layout.subcircuits = JsonSpan{ p, valueEnd };
+            p = valueEnd;
+        }
+        p = SkipJsonSpace(p, end);
+        if (p < end && *p == ',') p = SkipJsonSpace(p + 1, end);
+        else if (p < end && *p != '}') return false;
+    }
+    return p < end && hasGates;
+}
+
+// һԶŷָԪأϷźΪһ
+template <class T, class Convert>
+void ParseJsonElements(const JsonSpan& span, Convert convert, std::vector<T>& out) {
+    std::string text;
+    text.reserve(span.end - span.begin + 2);
+    text += '[';
+    text.append(span.begin, span.end);
+    text += ']';
+    json items = json::parse(text);
+    std::string().swap(text);
+    out.reserve(items.size());
+    for (auto& item : items) out.push_back(convert(item));
+}
+
+// ߳ȡһνԵ飬󰴶ε˳ƴӣʱصһεϢ
+template <class T, class Convert>
+bool ParseJsonChunks(const std::vector<JsonSpan>& chunks, Convert convert, std::vector<T>& out, std::string& error) {
+    std::vector<std::vector<T>> parts(chunks.size());
+    std::vector<std::string> errors(chunks.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t c = next++; c < chunks.size(); c = next++) {
+            try {
+                ParseJsonElements(chunks[c], convert, parts[c]);
+            }
+            catch (const std::exception& e) {
+                errors[c] = e.what();
+            }
+        }
+    };
+    unsigned threads = (unsigned)std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), chunks.size());
+    std::vector<std::thread> pool;
+    for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    size_t total = 0;
+    for (auto& part : parts) total += part.size();
+    out.clear();
+    out.reserve(total);
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        if (!errors[c].empty()) {
+            error = errors[c];
+            return false;
+        }
+        for (auto& item : parts[c]) out.push_back(std::move(item));
+    }
+    return true;
+}
+
+// ȡ·ļӵ·ȼأ¼׷ӵ addedDefsٶźߡ
+// ļͷʶ JSON Ƭʽ
+bool ReadCircuitFile(const wxString& filename, std::vector<Gate>& gates, std::vector<Wire>& wires,
+    std::vector<wxString>& addedDefs, wxString& error) {
+    std::ifstream f(filename.ToStdString(), std::ios::binary);
+    if (!f.is_open()) {
+        error = "޷ļ: " + filename;
+        return false;
+    }
+    char magic[4] = { 0 };
+    f.read(magic, sizeof(magic));
+    if (f.gcount() == sizeof(magic) && std::memcmp(magic, "CTB1", sizeof(magic)) == 0) {
+        f.close();
+        return ReadTiledCircuitFile(filename, gates, wires, addedDefs, error);
+    }
+    // ļڴ󰴶βнṹԤʱ˻
+    std::string text;
+    if (f.gcount() >= 2 && (unsigned char)magic[0] == 0x1f && (unsigned char)magic[1] == 0x8b) {
+        f.close();
+        // ѹļ߶߽ѹѹƬʽʱƬļȡ
+        GzipFileReader reader(filename);
+        char head[4];
+        size_t got = reader.Read(head, sizeof(head));
+        if (got == sizeof(head) && std::memcmp(head, "CTB1", sizeof(head)) == 0) {
+            return ReadTiledCircuitFile(filename, gates, wires, addedDefs, error);
+        }
+        text.assign(head, got);
+        for (;;) {
+            size_t old = text.size();
+            text.resize(old + GZIP_BLOCK_SIZE);
+            size_t n = reader.Read(&text[old], GZIP_BLOCK_SIZE);
+            text.resize(old + n);
+            if (n == 0) break;
+        }
+        if (!reader.IsOk()) {
+            error = "ѹļʧ: " + filename;
+            return false;
+        }
+    }
+    else {
+        f.clear();
+        f.seekg(0, std::ios::end);
+        text.resize((size_t)f.tellg());
+        f.seekg(0);
+        f.read(&text[0], text.size());
+        if (!f) {
+            error = "ȡļʧ: " + filename;
+            return false;
+        }
+        f.close();
+    }
+
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t chunkBytes = std::max<size_t>(256 << 10, std::min<size_t>(16 << 20, text.size() / (8 * threads)));
+    CircuitJsonLayout layout;
+    try {
+        if (ScanCircuitJson(text.data(), text.data() + text.size(), chunkBytes, layout)) {
+            // ӵ·Ҫʵ֮ǰ
+            if (layout.subcircuits.begin) {
+                wxString defError;
+                if (!LoadSubcircuitsFromJson(json::parse(layout.subcircuits.begin, layout.subcircuits.end), addedDefs, defError)) {
+                    error = "ӵ·ʧ: " + defError;
+                    return false;
+                }
+            }
+            std::string parseError;
+            if (!ParseJsonChunks(layout.gates, GateFromJson, gates, parseError) ||
+                !ParseJsonChunks(layout.wires, WireFromJson, wires, parseError)) {
+                error = wxString("ļʧ: ") + parseError;
+                return false;
+            }
+            return true;
+        }
+
+        json j = json::parse(text);
+
+        // ӵ·Ҫʵ֮ǰ
+        if (j.find("subcircuits") != j.end()) {
+            wxString defError;
+            if (!LoadSubcircuitsFromJson(j["subcircuits"], addedDefs, defError)) {
+                error = "ӵ·ʧ: " + defError;
+                return false;
+            }
+        }
+
+        gates.clear();
+        for (auto& gateJson : j["gates"]) {
+            gates.push_back(GateFromJson(gateJson));
+        }
+        wires.clear();
+        if (j.find("wires") != j.end()) {
+            for (auto& wireJson : j["wires"]) wires.push_back(WireFromJson(wireJson));
+        }
+    }
+    catch (const std::exception& e) {
+        error = wxString("ļʧ: ") + e.what();
+        return false;
+    }
+    return true;
+}
+
+// ʱ߳ȡգŴ洢дʱƸӵ·ãݡ
+// лдļڹ߳нУдͬĿ¼µʱļ̺ٸ滻ԭļ;ʧܲԭļ
+struct CircuitSnapshot {
+    GateStore gates;
+    std::vector<Wire> wires;
+    std::vector<std::shared_ptr<const SubcircuitDef>> subcircuits;
+};
+
+// ļˢ
+bool FlushFileToDisk(const wxString& filename) {
+#ifdef __WXMSW__
+    HANDLE file = ::CreateFileW(filename.wc_str(), GENERIC_WRITE, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    bool ok = ::FlushFileBuffers(file) != 0;
+    ::CloseHandle(file);
+    return ok;
+#else
+    int fd = ::open(filename.fn_str(), O_RDONLY);
+    if (fd < 0) return false;
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+#endif
+}
+
+//  from ԭӵ滻 to
+bool ReplaceFileAtomically(const wxString& from, const wxString& to) {
+#ifdef __WXMSW__
+    return ::MoveFileExW(from.wc_str(), to.wc_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return std::rename(from.fn_str(), to.fn_str()) == 0;
+#endif
+}
+
+// ʽд· JSONź׷ӵһдļٹĵı
+// дļʱڴ·ģ޹ءĸ˳ʽ json::dump(4) Ľֽͬ
+// ոʽ൱ json::dump()Ҳ
+class CircuitJsonWriter {
+public:
+    CircuitJsonWriter(std::ostream& out, bool compact) : m_out(out), m_compact(compact) {
+        m_buffer.reserve(FLUSH_SIZE + 4096);
+    }
+
+    bool Write(const CircuitSnapshot& snapshot, BackgroundJob* job) {
+        m_buffer += '{';
+        Key(1, "gates");
+        size_t n = snapshot.gates.size();
+        m_buffer += '[';
+        for (size_t i = 0; i < n; ++i) {
+            Item(2, i);
+            WriteGate(snapshot.gates.Get(i), 2);
+            if (m_buffer.size() >= FLUSH_SIZE && !Flush()) return false;
+            if (job && i % 4096 == 0) job->ReportProgress(0.9 * i / n);
+        }
+        EndArray(1, n);
+        m_buffer += ',';
+        if (!snapshot.subcircuits.empty()) {
+            // ӵ·ޣ԰ĵٲ
+            Key(1, "subcircuits");
+            std::string defs = SubcircuitsToJson(snapshot.subcircuits).dump(m_compact ? -1 : 4);
+            if (!m_compact) {
+                for (char c : defs) {
+                    m_buffer += c;
+                    if (c == '\n') m_buffer.append(4, ' ');
+                }
+            }
+            else {
+                m_buffer += defs;
+            }
+            m_buffer += ',';
+        }
+        Key(1, "type");
+        m_buffer += "\"circuit\",";
+        Key(1, "version");
+        m_buffer += "\"1.0\",";
+        Key(1, "wires");
+        m_buffer += '[';
+        for (size_t i = 0; i < snapshot.wires.size(); ++i) {
+            Item(2, i);
+            WriteWire(snapshot.wires[i], 2);
+            if (m_buffer.size() >= FLUSH_SIZE && !Flush()) return false;
+        }
+        EndArray(1, snapshot.wires.size());
+        Newline(0);
+        m_buffer += '}';
+        return Flush();
+    }
+
+private:
+    static const size_t FLUSH_SIZE = 1 << 20;
+
+    void Newline(int depth) {
+        if (m_compact) return;
+        m_buffer += '\n';
+        m_buffer.append(depth * 4, ' ');
+    }
+
+    void Key(int depth, const char* name) {
+        Newline(depth);
+        m_buffer += '"';
+        m_buffer += name;
+        m_buffer += m_compact ? "\":" : "\": ";
+    }
+
+    //  json::dump һ£д []ÿԪصһ
+    void Item(int depth, size_t index) {
+        if (index > 0) m_buffer += ',';
+        Newline(depth);
+    }
+
+    void EndArray(int depth, size_t count) {
+        if (count > 0) Newline(depth);
+        m_buffer += ']';
+    }
+
+    void Int(long long v) {
+        char text[24];
+        int len = snprintf(text, sizeof(text), "%lld", v);
+        m_buffer.append(text, len);
+    }
+
+    // תͬ json::dumpšбܺͿַ
+    void String(const std::string& text) {
+        m_buffer += '"';
+        for (unsigned char c : text) {
+            switch (c) {
+            case '"': m_buffer += "\\\""; break;
+            case '\\': m_buffer += "\\\\"; break;
+            case '\b': m_buffer += "\\b"; break;
+            case '\f': m_buffer += "\\f"; break;
+            case '\n': m_buffer += "\\n"; break;
+            case '\r': m_buffer += "\\r"; break;
+            case '\t': m_buffer += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char esc[8];
+                    snprintf(esc, sizeof(esc), "\\u%04x", c);
+                    m_buffer += esc;
+                }
+                else {
+                    m_buffer += (char)c;
+                }
+            }
+        }
+        m_buffer += '"';
+    }
+
+    void WriteGate(const Gate& gate, int depth) {
+        m_buffer += '{';
+        Key(depth + 1, "properties");
+        m_buffer += '[';
+        for (size_t i = 0; i < gate.properties.size(); ++i) {
+            const Property& prop = gate.properties[i];
+            Item(depth + 2, i);
+            m_buffer += '{';
+            Key(depth + 3, "name");
+            String(prop.GetName().ToStdString());
+            m_buffer += ',';
+            Key(depth + 3, "type");
+            String(prop.GetTypeName());
+            m_buffer += ',';
+            Key(depth + 3, "value");
+            String(prop.GetValueString().ToStdString());
+            Newline(depth + 2);
+            m_buffer += '}';
+        }
+        EndArray(depth + 1, gate.properties.size());
+        m_buffer += ',';
+        Key(depth + 1, "type");
+        String(gate.type.ToStdString());
+        m_buffer += ',';
+        Key(depth + 1, "x");
+        Int(gate.pos.x);
+        m_buffer += ',';
+        Key(depth + 1, "y");
+        Int(gate.pos.y);
+        Newline(depth);
+        m_buffer += '}';
+    }
+
+    void WriteWire(const Wire& w, int depth) {
+        m_buffer += '{';
+        if (w.points.size() == 2) {
+            const char* keys[] = { "x1", "x2", "y1", "y2" };
+            int values[] = { w.Start().x, w.End().x, w.Start().y, w.End().y };
+            for (int k = 0; k < 4; ++k) {
+                if (k > 0) m_buffer += ',';
+                Key(depth + 1, keys[k]);
+                Int(values[k]);
+            }
+        }
+        else {
+            Key(depth + 1, "points");
+            m_buffer += '[';
+            for (size_t i = 0; i < w.points.size(); ++i) {
+                Item(depth + 2, i);
+                m_buffer += '[';
+                Newline(depth + 3);
+                Int(w.points[i].x);
+                m_buffer += ',';
+                Newline(depth + 3);
+                Int(w.points[i].y);
+                Newline(depth + 2);
+                m_buffer += ']';
+            }
+            EndArray(depth + 1, w.points.size());
+        }
+        Newline(depth);
+        m_buffer += '}';
+    }
+
+    bool Flush() {
+        m_out.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+        return !m_out.fail();
+    }
+
+    std::ostream& m_out;
+    bool m_compact;
+    std::string m_buffer;
+};
+
+bool WriteCircuitFile(const CircuitSnapshot& snapshot, const wxString& filename, BackgroundJob* job, wxString& error, bool compact = false) {
+    wxString temp = filename + ".tmp";
+    std::ofstream f(temp.ToStdString(), std::ios::binary);
+    if (!f.is_open()) {
+        error = "޷ļ: " + filename;
+        return false;
+    }
+    bool written;
+    if (IsCompressedFileName(filename)) {
+        GzipOutputBuffer gzip(f);
+        std::ostream out(&gzip);
+        written = CircuitJsonWriter(out, compact).Write(snapshot, job);
+        written = gzip.Finish() && written;
+    }
+    else {
+        written = CircuitJsonWriter(f, compact).Write(snapshot, job);
+    }
+    f.close();
+    if (!written || f.fail() || !FlushFileToDisk(temp)) {
+        wxRemoveFile(temp);
+        error = "дļʧ: " + filename;
+        return false;
+    }
+    if (!ReplaceFileAtomically(temp, filename)) {
+        wxRemoveFile(temp);
+        error = "޷滻ļ: " + filename;
+        return false;
+    }
+    return true;
+}
+
+// ===== ༭־ָ =====
+// ÿ޸׷һ¼ŵɾŴ洢֪ͨߵ޸ɻͼ棬µӵ·͵ǰļ
+// ¼Ȼڴʱд̳߳׷ӵ journal.<n>.log ˢֻ̣༭йء
+// ־·ģӦĳʱд̰߳ѵʱĿд snapshot.<n+1>.json֮ļ¼д journal.<n+1>.log
+// ̺ɾļʱָĿ¼ﻹļ˵ϴû˳µĿղ˳ط־
+class EditJournal : public GateStoreListener {
+public:
+    explicit EditJournal(const wxString& dir) : m_dir(dir) {
+        RemoveFilesBefore(m_dir, std::numeric_limits<int>::max());
+        m_writer = std::thread([this]() { WriterLoop(); });
+    }
+
+    ~EditJournal() { Stop(); }
+
+    void GateAdded(const GateStore& gates, size_t i) override {
+        json r = GateToJson(gates.Get(i));
+        r["op"] = "add";
+        Record(r);
+    }
+
+    // ϶ʱÿƶƶţƶֻÿλ
+    void GateMoved(const GateStore& gates, size_t i) override {
+        m_pendingMoves[i] = gates.Pos(i);
+    }
+
+    void GateChanged(const GateStore& gates, size_t i) override {
+        json r = GateToJson(gates.Get(i));
+        r["op"] = "set";
+        r["i"] = i;
+        Record(r);
+    }
+
+    void GateRemoved(size_t i) override {
+        Record({ { "op", "remove" }, { "i", i } });
+    }
+
+    void GatesReplaced(const GateStore& gates) override {
+        json list = json::array();
+        for (size_t i = 0; i < gates.size(); ++i) list.push_back(GateToJson(gates.Get(i)));
+        Record({ { "op", "gates" }, { "gates", list } });
+    }
+
+    void WireAdded(const std::vector<Wire>& wires, size_t i) {
+        json r = WireToJson(wires[i]);
+        r["op"] = "wire+";
+        Record(r);
+    }
+
+    void WireChanged(const std::vector<Wire>& wires, size_t i) {
+        json r = WireToJson(wires[i]);
+        r["op"] = "wire=";
+        r["i"] = i;
+        Record(r);
+    }
+
+    // ɾһߣ򣩣߱ԭ˳
+    void WiresRemoved(const std::vector<size_t>& indices) {
+        Record({ { "op", "wire-" }, { "list", indices } });
+    }
+
+    void WiresReplaced(const std::vector<Wire>& wires) {
+        json list = json::array();
+        for (auto& w : wires) list.push_back(WireToJson(w));
+        Record({ { "op", "wires" }, { "wires", list } });
+    }
+
+    void FileChanged(const wxString& filename) {
+        if (filename == m_file) return;
+        m_file = filename;
+        Record({ { "op", "file" }, { "name", filename.ToStdString() } });
+    }
+
+    // ɶʱãѻļ¼д̣߳־ʱ˳ǰ״̬Ŀ
+    void Commit(const GateStore& gates, const std::vector<Wire>& wires) {
+        FlushMoves();
+        LogNewSubcircuits();
+        if (m_buffer.empty()) return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_logBytes += m_buffer.size();
+        m_tasks.push_back(Task());
+        m_tasks.back().generation = m_generation;
+        m_tasks.back().records.swap(m_buffer);
+        if (m_logBytes > COMPACT_MIN_BYTES && m_logBytes > 128 * (gates.size() + wires.size())) {
+            ++m_generation;
+            auto snapshot = std::make_shared<CircuitSnapshot>();
+            snapshot->gates = gates;
+            snapshot->wires = wires;
+            snapshot->subcircuits = GetSubcircuitDefinitions();
+            m_tasks.push_back(Task());
+            m_tasks.back().generation = m_generation;
+            m_tasks.back().snapshot = snapshot;
+            m_logBytes = 0;
+            // ûļ־ͷ¼һ
+            if (!m_file.empty()) Record({ { "op", "file" }, { "name", m_file.ToStdString() } });
+        }
+        m_cv.notify_one();
+    }
+
+    bool HasFailed() const { return m_failed; }
+
+    // ˳дѽļ¼ɾȫָļ
+    void Discard() {
+        Stop();
+        RemoveFilesBefore(m_dir, std::numeric_limits<int>::max());
+    }
+
+    static bool HasRecoveryData(const wxString& dir) {
+        return !ListFiles(dir, "snapshot.", ".json").empty() || !ListFiles(dir, "journal.", ".log").empty();
+    }
+
+    // طŵһ޷ļ¼Ϊֹʱһпֻдһ룩
+    static bool Recover(const wxString& dir, std::vector<Gate>& gates, std::vector<Wire>& wires, wxString& file,
+        std::vector<wxString>& addedDefs, wxString& error) {
+        GateStore store;
+        wires.clear();
+        int base = 0;
+        auto snapshots = ListFiles(dir, "snapshot.", ".json");
+        if (!snapshots.empty()) {
+            base = snapshots.back().first;
+            std::vector<Gate> snapshotGates;
+            if (!ReadCircuitFile(snapshots.back().second, snapshotGates, wires, addedDefs, error)) return false;
+            store.Assign(snapshotGates);
+        }
+        bool complete = true;
+        for (auto& log : ListFiles(dir, "journal.", ".log")) {
+            if (log.first < base) continue;
+            std::ifstream f(log.second.ToStdString(), std::ios::binary);
+            std::string line;
+            while (complete && std::getline(f, line)) {
+                if (!line.empty()) complete = ApplyRecord(line, store, wires, file, addedDefs);
+            }
+        }
+        gates = store.ToGates();
+        return true;
+    }
+
+private:
+    static const size_t COMPACT_MIN_BYTES = 4 << 20;
+
+    struct Task {
+        int generation = 0;
+        std::string records;                        // ׷ӵ journal.<generation>.log
+        std::shared_ptr<CircuitSnapshot> snapshot;  // ǿʱд snapshot.<generation>.json
+    };
+
+    wxString m_dir;
+    wxString m_file;
+    std::string m_buffer;                       // ûд̵߳ļ¼ÿһ
+    std::map<size_t, wxPoint> m_pendingMoves;
+    int m_lastDefinition = -1;                  // Ѽ¼ӵ·ţŴ 0 ʼ
+    int m_generation = 1;
+    size_t m_logBytes = 0;                      // ϴο֮󽻳ļ¼
+
+    std::thread m_writer;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::deque<Task> m_tasks;
+    bool m_stop = false;
+    std::atomic<bool> m_failed{ false };
+
+    void Record(const json& r) {
+        FlushMoves();
+        m_buffer += r.dump();
+        m_buffer += '\n';
+    }
+
+    void FlushMoves() {
+        if (m_pendingMoves.empty()) return;
+        std::map<size_t, wxPoint> moves;
+        moves.swap(m_pendingMoves);
+        for (auto& m : moves) {
+            json r = { { "op", "move" }, { "i", m.first }, { "x", m.second.x }, { "y", m.second.y } };
+            m_buffer += r.dump();
+            m_buffer += '\n';
+        }
+    }
+
+    void LogNewSubcircuits() {
+        std::vector<std::shared_ptr<const SubcircuitDef>> defs;
+        for (auto& def : GetSubcircuitDefinitions()) {
+            if (def->id > m_lastDefinition) defs.push_back(def);
+        }
+        if (defs.empty()) return;
+        for (auto& def : defs) m_lastDefinition = std::max(m_lastDefinition, def->id);
+        Record({ { "op", "subcircuits" }, { "defs", SubcircuitsToJson(defs) } });
+    }
+
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cv.notify_one();
+        if (m_writer.joinable()) m_writer.join();
+    }
+
+    void WriterLoop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        for (;;) {
+            m_cv.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_tasks.empty()) return;
+            std::deque<Task> tasks;
+            tasks.swap(m_tasks);
+            lock.unlock();
+            for (auto& task : tasks) Process(task);
+            lock.lock();
+        }
+    }
+
+    void Process(const Task& task) {
+        ScopedTimer timer(ProfileZone::FileIO);
+        if (task.snapshot) {
+            wxString error;
+            if (WriteCircuitFile(*task.snapshot, FilePath(m_dir, "snapshot.", task.generation, ".json"), nullptr, error, true)) {
+                RemoveFilesBefore(m_dir, task.generation);
+            }
+            else {
+                m_failed = true;
+            }
+            return;
+        }
+        wxString path = FilePath(m_dir, "journal.", task.generation, ".log");
+        std::ofstream f(path.ToStdString(), std::ios::binary | std::ios::app);
+        f.write(task.records.data(), task.records.size());
+        f.close();
+        if (f.fail() || !FlushFileToDisk(path)) m_failed = true;
+    }
+
+    static wxString FilePath(const wxString& dir, const char* prefix, int generation, const char* ext) {
+        return dir + wxFILE_SEP_PATH + wxString::Format("%s%d%s", prefix, generation, ext);
+    }
+
+    // Ŀ¼ prefix<n>ext ʽļ n 
+    static std::vector<std::pair<int, wxString>> ListFiles(const wxString& dir, const wxString& prefix, const wxString& ext) {
+        std::vector<std::pair<int, wxString>> result;
+        if (!wxDir::Exists(dir)) return result;
+        wxArrayString files;
+        wxDir::GetAllFiles(dir, &files, prefix + "*" + ext, wxDIR_FILES);
+        for (size_t i = 0; i < files.GetCount(); ++i) {
+            wxString name = wxFileName(files[i]).GetFullName();
+            if (!name.StartsWith(prefix) || !name.EndsWith(ext)) continue;
+            long n;
+            if (name.Mid(prefix.length(), name.length() - prefix.length() - ext.length()).ToLong(&n)) {
+                result.push_back(std::make_pair((int)n, files[i]));
+            }
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+    static void RemoveFilesBefore(const wxString& dir, int generation) {
+        for (auto& f : ListFiles(dir, "snapshot.", ".json")) {
+            if (f.first < generation) wxRemoveFile(f.second);
+        }
+        for (auto& f : ListFiles(dir, "journal.", ".log")) {
+            if (f.first < generation) wxRemoveFile(f.second);
+        }
+    }
+
+    static bool ApplyRecord(const std::string& line, GateStore& gates, std::vector<Wire>& wires, wxString& file, std::vector<wxString>& addedDefs) {
+        try {
+            json r = json::parse(line);
+            std::string op = r["op"].get<std::string>();
+            size_t i = r.find("i") != r.end() ? r["i"].get<size_t>() : 0;
+            if (op == "add") gates.Add(GateFromJson(r));
+            else if (op == "set" && i < gates.size()) gates.Set(i, GateFromJson(r));
+            else if (op == "move" && i < gates.size()) gates.SetPos(i, wxPoint(r["x"], r["y"]));
+            else if (op == "remove" && i < gates.size()) gates.SwapRemove(i);
+            else if (op == "gates") {
+                std::vector<Gate> list;
+                for (auto& g : r["gates"]) list.push_back(GateFromJson(g));
+                gates.Assign(list);
+            }
+            else if (op == "wire+") wires.push_back(WireFromJson(r));
+            else if (op == "wire=" && i < wires.size()) wires[i] = WireFromJson(r);
+            else if (op == "wire-") {
+                std::vector<char> remove(wires.size(), 0);
+                for (auto& k : r["list"]) {
+                    if (k.get<size_t>() >= wires.size()) return false;
+                    remove[k.get<size_t>()] = 1;
+                }
+                size_t kept = 0;
+                for (size_t k = 0; k < wires.size(); ++k) {
+                    if (!remove[k]) wires[kept++] = std::move(wires[k]);
+                }
+                wires.resize(kept);
+            }
+            else if (op == "wires") {
+                wires.clear();
+                for (auto& w : r["wires"]) wires.push_back(WireFromJson(w));
+            }
+            else if (op == "file") file = r["name"].get<std::string>();
+            else if (op == "subcircuits") {
+                wxString error;
+                return LoadSubcircuitsFromJson(r["defs"], addedDefs, error);
+            }
+            else return false;
+            return true;
+        }
+        catch (const std::exception&) {
+            return false;
+        }
+    }
+};
+
+// ===== ̶͹Ϸ =====
+// ϴÿ 64 λװ 64 õ·ÿֻһΣ
+// ÿδĹֻعϵȳ׶ֵӹϱɾ
+struct StuckAtFault {
+    int gate;
+    int pin;        // -1 ʾţΪ
+    int stuckValue; // 0  1
+    bool detected;
+};
+
+struct FaultSimReport {
+    size_t totalFaults = 0;
+    size_t detectedFaults = 0;
+    size_t patterns = 0;
+    bool cancelled = false;
+    std::vector<StuckAtFault> undetected;
+
+    double Coverage() const { return totalFaults ? 100.0 * detectedFaults / totalFaults : 0.0; }
+};
+
+class FaultSimulator {
+public:
+    explicit FaultSimulator(const LevelizedNetlist& netlist) : m_net(netlist), m_epoch(0) {
+        size_t n = m_net.kind.size();
+        m_rank.assign(n, 0);
+        for (size_t i = 0; i < m_net.order.size(); ++i) m_rank[m_net.order[i]] = (int)i;
+        m_isOutput.assign(n, 0);
+        for (int g : m_net.outputs) m_isOutput[g] = 1;
+        m_good.assign(n, 0);
+        m_faulty.assign(n, 0);
+        m_mark.assign(n, 0);
+        m_queued.assign(n, 0);
+    }
+
+    // öÿÿϵĹ̶ 0 / ̶ 1 
+    void EnumerateFaults() {
+        m_faults.clear();
+        for (size_t g = 0; g < m_net.kind.size(); ++g) {
+            const PinLayout& layout = GetPinLayout(m_net.kind[g]);
+            for (size_t p = 0; p < layout.inputs.size(); ++p) {
+                m_faults.push_back({ (int)g, (int)p, 0, false });
+                m_faults.push_back({ (int)g, (int)p, 1, false });
+            }
+            if (!layout.outputs.empty()) {
+                m_faults.push_back({ (int)g, -1, 0, false });
+                m_faults.push_back({ (int)g, -1, 1, false });
+            }
+        }
+    }
+
+    // vectors ÿһ m_net.inputs ˳صȡֵ
+    FaultSimReport Run(const std::vector<std::vector<unsigned char>>& vectors, BackgroundJob* job) {
+        FaultSimReport report;
+        report.totalFaults = m_faults.size();
+        report.patterns = vectors.size();
+
+        // δϵţĩβɾ
+        std::vector<int> live(m_faults.size());
+        for (size_t i = 0; i < live.size(); ++i) live[i] = (int)i;
+
+        size_t batches = (vectors.size() + 63) / 64;
+        for (size_t b = 0; b < batches && !live.empty(); ++b) {
+            if (job && job->IsCancelled()) {
+                report.cancelled = true;
+                break;
+            }
+            size_t first = b * 64;
+            size_t count = std::min<size_t>(64, vectors.size() - first);
+            uint64_t mask = count == 64 ? ~0ULL : ((1ULL << count) - 1);
+            SimulateGood(vectors, first, count);
+
+            for (size_t k = 0; k < live.size();) {
+                if (Detects(m_faults[live[k]], mask)) {
+                    m_faults[live[k]].detected = true;
+                    live[k] = live.back();
+                    live.pop_back();
+                }
+                else {
+                    ++k;
+                }
+            }
+            if (job) job->ReportProgress((double)(b + 1) / batches);
+        }
+
+        report.detectedFaults = report.totalFaults - live.size();
+        for (auto& f : m_faults) {
+            if (!f.detected) report.undetected.push_back(f);
+        }
+        return report;
+    }
+
+private:
+    const LevelizedNetlist& m_net;
+    std::vector<StuckAtFault> m_faults;
+    std::vector<int> m_rank;
+    std::vector<unsigned char> m_isOutput;
+    std::vector<uint64_t> m_good;
+    std::vector<uint64_t> m_faulty;
+    std::vector<unsigned> m_mark;    // ιϴ m_faulty Ч
+    std::vector<unsigned> m_queued;
+    unsigned m_epoch;
+
+    static uint64_t EvalWord(GateKind kind, uint64_t a, uint64_t b) {
+        switch (kind) {
+        case GateKind::And: return a & b;
+        case GateKind::Or: return a | b;
+        case GateKind::Not: return ~a;
+        case GateKind::Xor: return a ^ b;
+        case GateKind::Nand: return ~(a & b);
+        case GateKind::Nor: return ~(a | b);
+        case GateKind::Xnor: return ~(a ^ b);
+        case GateKind::Buffer: return a;
+        case GateKind::Led: return a;
+        default: return 0;
+        }
+    }
+
+    uint64_t Value(int g) const { return m_mark[g] == m_epoch ? m_faulty[g] : m_good[g]; }
+
+    // ʱӺʹϲﱣֳʼֵȫɨ账Ϊɹ۲㣩
+    uint64_t InitWord(int g) const { return (size_t)g < m_net.init.size() && m_net.init[g] ? ~0ULL : 0; }
+
+    // forcedPin >= 0 ʱȡ forcedValue
+    uint64_t EvalGate(int g, bool faulty, int forcedPin, uint64_t forcedValue) const {
+        const std::vector<int>& in = m_net.fanin[g];
+        uint64_t v[2] = { 0, 0 };
+        for (size_t i = 0; i < in.size() && i < 2; ++i) {
+            if ((int)i == forcedPin) v[i] = forcedValue;
+            else if (in[i] >= 0) v[i] = faulty ? Value(in[i]) : m_good[in[i]];
+        }
+        if (m_net.kind[g] == GateKind::Latch) return (v[1] & v[0]) | (~v[1] & InitWord(g));
+        return EvalWord(m_net.kind[g], v[0], v[1]);
+    }
+
+    void SimulateGood(const std::vector<std::vector<unsigned char>>& vectors, size_t first, size_t count) {
+        for (size_t i = 0; i < m_net.inputs.size(); ++i) {
+            uint64_t word = 0;
+            for (size_t k = 0; k < count; ++k) {
+                const std::vector<unsigned char>& vec = vectors[first + k];
+                if (i < vec.size() && vec[i]) word |= 1ULL << k;
+            }
+            m_good[m_net.inputs[i]] = word;
+        }
+        for (int g : m_net.order) {
+            GateKind kind = m_net.kind[g];
+            if (kind == GateKind::Clock || kind == GateKind::Dff) m_good[g] = InitWord(g);
+            else if (kind != GateKind::Switch) m_good[g] = EvalGate(g, false, -1, 0);
+        }
+    }
+
+    // ڵǰһ·浥ϣһõ·ͬΪ
+    bool Detects(const StuckAtFault& fault, uint64_t mask) {
+        if (++m_epoch == 0) {
+            std::fill(m_mark.begin(), m_mark.end(), 0);
+            std::fill(m_queued.begin(), m_queued.end(), 0);
+            m_epoch = 1;
+        }
+        int site = fault.gate;
+        uint64_t stuck = fault.stuckValue ? ~0ULL : 0;
+        if (m_net.kind[site] == GateKind::Dff && fault.pin >= 0) {
+            int driver = m_net.fanin[site][fault.pin];
+            uint64_t good = driver >= 0 ? m_good[driver] : 0;
+            return ((stuck ^ good) & mask) != 0;
+        }
+        uint64_t value = fault.pin < 0 ? stuck : EvalGate(site, false, fault.pin, stuck);
+        if (((value ^ m_good[site]) & mask) == 0) return false; // δ
+
+        m_faulty[site] = value;
+        m_mark[site] = m_epoch;
+        if (m_isOutput[site]) return true;
+
+        typedef std::pair<int, int> Item; // (ֵ˳, )
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> queue;
+        for (int s : m_net.fanout[site]) {
+            if (m_queued[s] != m_epoch) {
+                m_queued[s] = m_epoch;
+                queue.push(Item(m_rank[s], s));
+            }
+        }
+        while (!queue.empty()) {
+            int g = queue.top().second;
+            queue.pop();
+            if (g == site) continue; // ̶Ĺϲᱻķд
+            if (m_net.kind[g] == GateKind::Dff) return true; // ֵﴥ
+            uint64_t v = EvalGate(g, true, -1, 0);
+            if (((v ^ m_good[g]) & mask) == 0) continue;
+            m_faulty[g] = v;
+            m_mark[g] = m_epoch;
+            if (m_isOutput[g]) return true;
+            for (int s : m_net.fanout[g]) {
+                if (m_queued[s] != m_epoch) {
+                    m_queued[s] = m_epoch;
+                    queue.push(Item(m_rank[s], s));
+                }
+            }
+        }
+        return false;
+    }
+};
+
+// ȡļÿһַ 0/1 ζӦأ˳򣩣
+// ַԣ# ֮Ϊע
+bool LoadTestVectors(const wxString& filename, std::vector<std::vector<unsigned char>>& vectors) {
+    std::ifstream f(filename.ToStdString());
+    if (!f.is_open()) return false;
+    std::string line;
+    while (std::getline(f, line)) {
+        std::vector<unsigned char> vec;
+        for (char c : line) {
+            if (c == '#') break;
+            if (c == '0' || c == '1') vec.push_back((unsigned char)(c - '0'));
+        }
+        if (!vec.empty()) vectors.push_back(vec);
+    }
+    return true;
+}
+
+// =====  =====
+// ѷֲɱƽָ (opcode, src1, src2, dst)ÿźռ״̬λеһλ
+// opcode  4 λֵѭﲻҪͷ֧
+// ʱӺʹ״̬λָչָľֵʵֱ֡
+class CompiledCircuit {
+public:
+    struct Instr {
+        uint32_t op;  // ֵ (a | b << 1) λ
+        uint32_t a;
+        uint32_t b;
+        uint32_t dst;
+    };
+
+    // 0 źźΪ 0յ붼ӵ
+    static const uint32_t CONST0 = 0;
+
+    void Compile(const LevelizedNetlist& net) {
+        size_t n = net.kind.size();
+        m_slot.assign(n, CONST0);
+        for (size_t i = 0; i < net.order.size(); ++i) {
+            m_slot[net.order[i]] = (uint32_t)(i + 1);
+        }
+        size_t latches = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (net.kind[i] == GateKind::Latch) ++latches;
+        }
+        m_signals = n + 1 + 2 * latches; // ÿмź
+        m_state.assign((m_signals + 63) / 64, 0);
+
+        m_program.clear();
+        m_program.reserve(n + 2 * latches);
+        m_types.clear();
+        m_clockSlots.clear();
+        m_flops.clear();
+        uint32_t temp = (uint32_t)(n + 1);
+        for (int g : net.order) {
+            GateKind kind = net.kind[g];
+            if (kind == GateKind::Switch) continue; //  SetInput д
+            const std::vector<int>& in = net.fanin[g];
+            uint32_t a = in.size() > 0 && in[0] >= 0 ? m_slot[in[0]] : CONST0;
+            uint32_t b = in.size() > 1 && in[1] >= 0 ? m_slot[in[1]] : CONST0;
+            if (kind == GateKind::Clock) {
+                m_clockSlots.push_back(m_slot[g]);
+            }
+            else if (kind == GateKind::Dff) {
+                m_flops.push_back({ a, b, m_slot[g], 0, 0 });
+            }
+            else if (kind == GateKind::Latch) {
+                // Q = (EN & D) | (~EN & Q)
+                Emit(0x8, a, b, temp, net.type[g]);
+                Emit(0x4, b, m_slot[g], temp + 1, net.type[g]);
+                Emit(0xE, temp, temp + 1, m_slot[g], net.type[g]);
+                temp += 2;
+            }
+            else {
+                Emit(TruthTable(kind), a, b, m_slot[g], net.type[g]);
+            }
+        }
+
+        m_inputSlots.clear();
+        for (int g : net.inputs) m_inputSlots.push_back(m_slot[g]);
+        m_outputSlots.clear();
+        for (int g : net.outputs) m_outputSlots.push_back(m_slot[g]);
+
+        // ءʱӡĳʼֵʼ
+        for (size_t i = 0; i < n && i < net.init.size(); ++i) SetBit(m_slot[i], net.init[i]);
+        Run();
+        for (Flop& f : m_flops) f.prevClock = (unsigned char)GetBit(f.clock);
+        EnableActivity(m_countActivity);
+    }
+
+    size_t GetInstructionCount() const { return m_program.size(); }
+    size_t GetInputCount() const { return m_inputSlots.size(); }
+    size_t GetOutputCount() const { return m_outputSlots.size(); }
+    size_t GetFlipFlopCount() const { return m_flops.size(); }
+
+    void SetInput(size_t index, bool value) { SetBit(m_inputSlots[index], value ? 1 : 0); }
+    bool GetOutput(size_t index) const { return GetBit(m_outputSlots[index]) != 0; }
+    bool GetGateValue(int gate) const { return GetBit(m_slot[gate]) != 0; }
+
+    // ִһָ飨һڣ
+    void Run() {
+        uint64_t* state = m_state.data();
+        for (const Instr& in : m_program) {
+            uint64_t x = (state[in.a >> 6] >> (in.a & 63)) & 1;
+            uint64_t y = (state[in.b >> 6] >> (in.b & 63)) & 1;
+            uint64_t r = (in.op >> (x | (y << 1))) & 1;
+            uint64_t& word = state[in.dst >> 6];
+            word = (word & ~(1ULL << (in.dst & 63))) | (r << (in.dst & 63));
+        }
+    }
+
+    // ʱһأȲд DתʱӺֵCLK صĴֵ
+    // ΪĴʱʱвظȶΪֹ
+    void ClockEdge() {
+        if (m_countActivity) m_before = m_state;
+        for (Flop& f : m_flops) f.sampled = (unsigned char)GetBit(f.d);
+        for (uint32_t slot : m_clockSlots) SetBit(slot, GetBit(slot) ^ 1);
+        bool captured = true;
+        for (size_t pass = 0; pass <= m_flops.size() && captured; ++pass) {
+            Run();
+            captured = false;
+            for (Flop& f : m_flops) {
+                uint64_t clock = GetBit(f.clock);
+                if (clock && !f.prevClock) {
+                    SetBit(f.q, f.sampled);
+                    captured = true;
+                }
+                f.prevClock = (unsigned char)clock;
+            }
+        }
+        if (captured) Run();
+        if (m_countActivity) CountToggles();
+    }
+
+    // ͳÿʱϸźŵķתӳģͣẹ̈
+    void EnableActivity(bool enable) {
+        m_countActivity = enable;
+        size_t words = m_state.size();
+        m_planes.assign(enable ? ACTIVITY_PLANES * words : 0, 0);
+        m_toggleTotals.assign(enable ? words * 64 : 0, 0);
+        m_pendingEdges = 0;
+    }
+
+    // ȡת
+    void GetToggleCounts(std::vector<uint64_t>& out) {
+        FlushToggles();
+        out.assign(m_slot.size(), 0);
+        if (m_toggleTotals.empty()) return;
+        for (size_t g = 0; g < m_slot.size(); ++g) out[g] = m_toggleTotals[m_slot[g]];
+    }
+
+    // һʱڣ + ½أ
+    void Cycle() {
+        ClockEdge();
+        ClockEdge();
+    }
+
+    // ɿ߱ C++ Դ룺ÿźһ 64 λ֣һεòм 64 
+    void EmitCpp(std::ostream& os) const {
+        os << "// Generated by the circuit editor. Each signal is a 64-bit word, so one call\n"
+           << "// evaluates 64 independent input vectors.\n"
+           << "#include <cstdint>\n\n"
+           << "enum {\n"
+           << "    CIRCUIT_SIGNALS = " << m_signals << ",\n"
+           << "    CIRCUIT_INPUTS = " << m_inputSlots.size() << ",\n"
+           << "    CIRCUIT_OUTPUTS = " << m_outputSlots.size() << "\n"
+           << "};\n\n"
+           << "// s must hold CIRCUIT_SIGNALS words and persist between calls: clock and\n"
+           << "// flip-flop outputs are state held in s and updated by the caller.\n"
+           << "void circuit_eval(const uint64_t* in, uint64_t* out, uint64_t* s) {\n"
+           << "    s[0] = 0;\n";
+        for (size_t i = 0; i < m_inputSlots.size(); ++i) {
+            os << "    s[" << m_inputSlots[i] << "] = in[" << i << "];\n";
+        }
+        for (size_t i = 0; i < m_program.size(); ++i) {
+            const Instr& in = m_program[i];
+            std::string a = "s[" + std::to_string(in.a) + "]";
+            std::string b = "s[" + std::to_string(in.b) + "]";
+            os << "    s[" << in.dst << "] = " << Expression(in.op, a, b) << "; // "
+               << m_types[i].ToUTF8().data() << "\n";
+        }
+        for (size_t i = 0; i < m_outputSlots.size(); ++i) {
+            os << "    out[" << i << "] = s[" << m_outputSlots[i] << "];\n";
+        }
+        os << "}\n";
+        for (const Flop& f : m_flops) {
+            os << "// flip-flop: s[" << f.q << "] <= s[" << f.d << "] on rising edge of s[" << f.clock << "]\n";
+        }
+    }
+
+private:
+    std::vector<Instr> m_program;
+    std::vector<uint64_t> m_state;
+    std::vector<uint32_t> m_slot;       //  -> źλ
+    std::vector<uint32_t> m_inputSlots;
+    std::vector<uint32_t> m_outputSlots;
+    std::vector<wxString> m_types;      // ֻԴע
+    size_t m_signals = 1;
+
+    struct Flop {
+        uint32_t d;
+        uint32_t clock;
+        uint32_t q;
+        unsigned char prevClock;
+        unsigned char sampled;
+    };
+    std::vector<uint32_t> m_clockSlots;
+    std::vector<Flop> m_flops;
+
+    // תλƬţm_planes[k * words + w] ǵ w ״̬ 64 źżֵĵ k λ
+    // һͬʱ 64 źżһ 2^ACTIVITY_PLANES - 1 ʱۼӵ m_toggleTotals
+    enum { ACTIVITY_PLANES = 16 };
+    bool m_countActivity = false;
+    std::vector<uint64_t> m_before;
+    std::vector<uint64_t> m_planes;
+    std::vector<uint64_t> m_toggleTotals;
+    unsigned m_pendingEdges = 0;
+
+    void CountToggles() {
+        size_t words = m_state.size();
+        uint64_t* planes = m_planes.data();
+        for (size_t w = 0; w < words; ++w) {
+            uint64_t carry = m_state[w] ^ m_before[w];
+            for (size_t k = 0; carry && k < ACTIVITY_PLANES; ++k) {
+                uint64_t& plane = planes[k * words + w];
+                uint64_t next = plane & carry;
+                plane ^= carry;
+                carry = next;
+            }
+        }
+        if (++m_pendingEdges == (1u << ACTIVITY_PLANES) - 1) FlushToggles();
+    }
+
+    void FlushToggles() {
+        if (m_pendingEdges == 0) return;
+        size_t words = m_state.size();
+        for (size_t k = 0; k < ACTIVITY_PLANES; ++k) {
+            for (size_t w = 0; w < words; ++w) {
+                uint64_t bits = m_planes[k * words + w];
+                for (size_t b = 0; bits; ++b, bits >>= 1) {
+                    if (bits & 1) m_toggleTotals[w * 64 + b] += 1ULL << k;
+                }
+            }
+        }
+        std::fill(m_planes.begin(), m_planes.end(), 0);
+        m_pendingEdges = 0;
+    }
+
+    void Emit(uint32_t op, uint32_t a, uint32_t b, uint32_t dst, const wxString& type) {
+        Instr instr;
+        instr.op = op;
+        instr.a = a;
+        instr.b = b;
+        instr.dst = dst;
+        m_program.push_back(instr);
+        m_types.push_back(type);
+    }
+
+    static uint32_t TruthTable(GateKind kind) {
+        switch (kind) {
+        case GateKind::And: return 0x8;
+        case GateKind::Or: return 0xE;
+        case GateKind::Xor: return 0x6;
+        case GateKind::Nand: return 0x7;
+        case GateKind::Nor: return 0x1;
+        case GateKind::Xnor: return 0x9;
+        case GateKind::Not: return 0x5;
+        case GateKind::Buffer: return 0xA;
+        case GateKind::Led: return 0xA;
+        default: return 0x0;
+        }
+    }
+
+    static std::string Expression(uint32_t op, const std::string& a, const std::string& b) {
+        switch (op) {
+        case 0x0: return "0";
+        case 0x8: return a + " & " + b;
+        case 0xE: return a + " | " + b;
+        case 0x6: return a + " ^ " + b;
+        case 0x7: return "~(" + a + " & " + b + ")";
+        case 0x1: return "~(" + a + " | " + b + ")";
+        case 0x9: return "~(" + a + " ^ " + b + ")";
+        case 0x5: return "~" + a;
+        case 0xA: return a;
+        }
+        // ֵչΪС֮
+        std::string expr;
+        for (int i = 0; i < 4; ++i) {
+            if (!((op >> i) & 1)) continue;
+            if (!expr.empty()) expr += " | ";
+            expr += "(" + std::string(i & 1 ? "" : "~") + a + " & " + std::string(i & 2 ? "" : "~") + b + ")";
+        }
+        return expr;
+    }
+
+    uint64_t GetBit(uint32_t slot) const { return (m_state[slot >> 6] >> (slot & 63)) & 1; }
+
+    void SetBit(uint32_t slot, uint64_t value) {
+        uint64_t& word = m_state[slot >> 6];
+        word = (word & ~(1ULL << (slot & 63))) | (value << (slot & 63));
+    }
+};
+
+const uint32_t CompiledCircuit::CONST0;
+
+// Žֵ¶Աȣ룬ÿֵ·
+struct CompileBenchReport {
+    size_t instructions = 0;
+    size_t cycles = 0;
+    double compileMs = 0;
+    double compiledCyclesPerSec = 0;
+    double interpretedCyclesPerSec = 0;
+    bool cancelled = false;
+};
+
+CompileBenchReport RunCompileBenchmark(const LevelizedNetlist& net, size_t cycles, BackgroundJob* job) {
+    CompileBenchReport report;
+    auto t0 = std::chrono::steady_clock::now();
+    CompiledCircuit circuit;
+    circuit.Compile(net);
+    auto t1 = std::chrono::steady_clock::now();
+    report.compileMs = std::chrono::duration<double, std::milli>(t1 - t0).count();
+    report.instructions = circuit.GetInstructionCount();
+
+    uint64_t seed = 0x9E3779B97F4A7C15ULL;
+    auto random = [&seed]() {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        return seed;
+    };
+
+    // ָ
+    size_t done = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (; done < cycles; ++done) {
+        if ((done & 1023) == 0 && job) {
+            if (job->IsCancelled()) break;
+            job->ReportProgress(0.5 * done / cycles);
+        }
+        for (size_t i = 0; i < circuit.GetInputCount(); ++i) circuit.SetInput(i, random() & 1);
+        circuit.Run();
+    }
+    t1 = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+    report.compiledCyclesPerSec = seconds > 0 ? done / seconds : 0;
+    report.cycles = done;
+
+    // գͷ֧ͨȡֵĽֵ
+    std::vector<unsigned char> value(net.kind.size(), 0);
+    for (size_t i = 0; i < value.size() && i < net.init.size(); ++i) value[i] = net.init[i];
+    done = 0;
+    t0 = std::chrono::steady_clock::now();
+    for (; done < cycles; ++done) {
+        if ((done & 1023) == 0 && job) {
+            if (job->IsCancelled()) break;
+            job->ReportProgress(0.5 + 0.5 * done / cycles);
+        }
+        for (int g : net.inputs) value[g] = random() & 1;
+        for (int g : net.order) {
+            const std::vector<int>& in = net.fanin[g];
+            int a = in.size() > 0 && in[0] >= 0 ? value[in[0]] : 0;
+            int b = in.size() > 1 && in[1] >= 0 ? value[in[1]] : 0;
+            switch (net.kind[g]) {
+            case GateKind::And: value[g] = a & b; break;
+            case GateKind::Or: value[g] = a | b; break;
+            case GateKind::Not: value[g] = !a; break;
+            case GateKind::Xor: value[g] = a ^ b; break;
+            case GateKind::Nand: value[g] = !(a & b); break;
+            case GateKind::Nor: value[g] = !(a | b); break;
+            case GateKind::Xnor: value[g] = !(a ^ b); break;
+            case GateKind::Buffer: value[g] = a; break;
+            case GateKind::Led: value[g] = a; break;
+            case GateKind::Latch: if (b) value[g] = (unsigned char)a; break;
+            case GateKind::Switch: case GateKind::Clock: case GateKind::Dff: break;
+            default: value[g] = 0; break;
+            }
+        }
+    }
+    t1 = std::chrono::steady_clock::now();
+    seconds = std::chrono::duration<double>(t1 - t0).count();
+    report.interpretedCyclesPerSec = seconds > 0 ? done / seconds : 0;
+    report.cancelled = job && job->IsCancelled();
+    return report;
+}
+
+// ===== Ĺ =====
+// ̬İ E = 1/2 * C * V^2 * ת 㣬C иŵĵ֮
+static const double SUPPLY_VOLTAGE = 3.3;          // V
+static const double DEFAULT_CLOCK_FREQUENCY = 100;  // MHz
+
+// ÿŵĵ (fF) "" ʱΪ׼
+double GetInputCapacitance(const wxString& type, const std::vector<Property>& props) {
+    double def = 0;
+    switch (GetGateKind(type)) {
+    case GateKind::Not: case GateKind::Buffer: def = 1.5; break;
+    case GateKind::And: case GateKind::Or: case GateKind::Nand: case GateKind::Nor: def = 2.0; break;
+    case GateKind::Xor: case GateKind::Xnor: def = 3.0; break;
+    case GateKind::Dff: case GateKind::Latch: def = 2.5; break;
+    case GateKind::Led: def = 5.0; break;
+    default: break;
+    }
+    return GetDoubleProperty(props, PROP_CAPACITANCE, def);
+}
+
+double GetInputCapacitance(const Gate& gate) { return GetInputCapacitance(gate.type, gate.properties); }
+
+struct PowerReport {
+    std::vector<double> energy;  // ÿķת (fJ)
+    double totalEnergy = 0;
+    double maxEnergy = 0;
+    uint64_t toggles = 0;
+    size_t cycles = 0;           // 0 ʾûаʱڷ
+    double frequency = DEFAULT_CLOCK_FREQUENCY;
+
+    // ƽ̬ (uW)ÿ (fJ) * Ƶ (MHz) = nW
+    double Power() const { return cycles > 0 ? totalEnergy / cycles * frequency / 1000 : 0; }
+};
+
+// ȡһʱӵƵ
+template <class Gates>
+double GetClockFrequency(const Gates& gates) {
+    for (size_t g = 0; g < gates.size(); ++g) {
+        if (GetGateKind(GateType(gates, g)) == GateKind::Clock) {
+            return GetDoubleProperty(GateProperties(gates, g), PROP_FREQUENCY, DEFAULT_CLOCK_FREQUENCY);
+        }
+    }
+    return DEFAULT_CLOCK_FREQUENCY;
+}
+
+template <class Gates>
+void EstimatePower(const Gates& gates, const std::vector<std::vector<int>>& fanout,
+    const std::vector<uint64_t>& toggles, size_t cycles, PowerReport& report) {
+    size_t n = std::min(gates.size(), std::min(fanout.size(), toggles.size()));
+    report = PowerReport();
+    report.energy.assign(gates.size(), 0);
+    report.cycles = cycles;
+    report.frequency = GetClockFrequency(gates);
+    for (size_t g = 0; g < n; ++g) {
+        if (toggles[g] == 0) continue;
+        double capacitance = 0;
+        for (int s : fanout[g]) capacitance += GetInputCapacitance(GateType(gates, s), GateProperties(gates, s));
+        double e = 0.5 * capacitance * SUPPLY_VOLTAGE * SUPPLY_VOLTAGE * toggles[g];
+        report.energy[g] = e;
+        report.totalEnergy += e;
+        report.maxEnergy = std::max(report.maxEnergy, e);
+        report.toggles += toggles[g];
+    }
+}
+
+// ڷӵ·ʵѾչڲڶ֮ڲŵĵݰеȡ
+// ڲʵڵĶţͼͱ԰ͳ
+template <class Gates>
+void EstimatePower(const Gates& gates, const LevelizedNetlist& net,
+    const std::vector<uint64_t>& toggles, size_t cycles, PowerReport& report) {
+    static const std::vector<Property> noProperties;
+    size_t top = gates.size();
+    report = PowerReport();
+    report.energy.assign(top, 0);
+    report.cycles = cycles;
+    report.frequency = GetClockFrequency(gates);
+    auto capacitance = [&](int s) {
+        if ((size_t)s < top) return GetInputCapacitance(GateType(gates, s), GateProperties(gates, s));
+        const NetlistInstance& inst = net.instances[net.owner[s]];
+        size_t k = s - inst.base;
+        return GetInputCapacitance(net.type[s], k < inst.def->gates.size() ? inst.def->gates[k].properties : noProperties);
+    };
+    size_t n = std::min(net.fanout.size(), toggles.size());
+    for (size_t g = 0; g < n; ++g) {
+        if (toggles[g] == 0) continue;
+        double c = 0;
+        for (int s : net.fanout[g]) c += capacitance(s);
+        double e = 0.5 * c * SUPPLY_VOLTAGE * SUPPLY_VOLTAGE * toggles[g];
+        size_t target = g < top ? g : (size_t)net.instances[net.owner[g]].gate;
+        report.energy[target] += e;
+        report.totalEnergy += e;
+        report.toggles += toggles[g];
+    }
+    for (double e : report.energy) report.maxEnergy = std::max(report.maxEnergy, e);
+}
+
+// ΪͬĬԣ͵ʱʹã
+void SetDefaultProperties(Gate& newGate) {
+    const wxString& shape = newGate.type;
+    if (shape == "LED") {
+        newGate.properties.push_back(Property::MakeString(PROP_COLOR, "ɫ"));
+        newGate.properties.push_back(Property::MakeDouble(PROP_VOLTAGE, 3.3));
+    }
+    else if (shape == "") {
+        newGate.properties.push_back(Property::MakeString(PROP_SWITCH_STATE, "ر"));
+    }
+    else if (shape == "AND" || shape == "OR" || shape == "NOT" ||
+        shape == "XOR" || shape == "NAND" || shape == "NOR" ||
+        shape == "XNOR" || shape == "BUFFER") {
+        newGate.properties.push_back(Property::MakeInt(PROP_DELAY, 10));
+        newGate.properties.push_back(Property::MakeDouble(PROP_CAPACITANCE, GetInputCapacitance(newGate)));
+    }
+    else if (shape == "DFF" || shape == "LATCH") {
+        newGate.properties.push_back(Property::MakeInt(PROP_DELAY, 10));
+        newGate.properties.push_back(Property::MakeBool(PROP_INIT, false));
+        newGate.properties.push_back(Property::MakeDouble(PROP_CAPACITANCE, GetInputCapacitance(newGate)));
+    }
+    else if (shape == "CLOCK") {
+        newGate.properties.push_back(Property::MakeDouble(PROP_FREQUENCY, DEFAULT_CLOCK_FREQUENCY));
+    }
+}
+
+// =====  =====
+// ṹ Verilog  BLIF ֱӰдڴƴ
+// ŵ swNʱ clkNŵ nNLED Ӧ˿ ledN
+void WriteNetName(std::ostream& os, const LevelizedNetlist& net, int g) {
+    switch (net.kind[g]) {
+    case GateKind::Switch: os << "sw" << g; break;
+    case GateKind::Clock: os << "clk" << g; break;
+    default: os << "n" << g; break;
+    }
+}
+
+// ģֻĸֺ»
+std::string NetlistModuleName(const wxString& name) {
+    std::string out;
+    for (char c : name.ToStdString()) {
+        if (isalnum((unsigned char)c) || c == '_') out += c;
+    }
+    if (out.empty() || isdigit((unsigned char)out[0])) out = "circuit_" + out;
+    return out;
+}
+
+static const char* VerilogPrimitive(GateKind kind) {
+    switch (kind) {
+    case GateKind::And: return "and";
+    case GateKind::Or: return "or";
+    case GateKind::Not: return "not";
+    case GateKind::Xor: return "xor";
+    case GateKind::Nand: return "nand";
+    case GateKind::Nor: return "nor";
+    case GateKind::Xnor: return "xnor";
+    case GateKind::Buffer: return "buf";
+    default: return nullptr;
+    }
+}
+
+// ӵ·һģ飬ģϴַ
+std::string SubcircuitModuleName(const SubcircuitDef& def) {
+    std::string name = NetlistModuleName(def.name);
+    if (name.compare(0, 8, "circuit_") == 0) name = name.substr(8);
+    return "sub" + std::to_string(def.id) + (name.empty() ? "" : "_" + name);
+}
+
+// õĶ壨Ƕ׵ģõĶǰ棬ÿֻһ
+void CollectSubcircuits(const LevelizedNetlist& net, std::vector<const SubcircuitDef*>& defs) {
+    for (auto& inst : net.instances) {
+        const SubcircuitDef* def = inst.def.get();
+        if (std::find(defs.begin(), defs.end(), def) != defs.end()) continue;
+        CollectSubcircuits(def->net, defs);
+        defs.push_back(def);
+    }
+}
+
+// ʵ k ˿չе
+static int InstanceOutputNet(const NetlistInstance& inst, size_t k) {
+    return k == 0 ? inst.gate : inst.base + inst.def->outputs[k];
+}
+
+static void WriteVerilogModule(const LevelizedNetlist& net, const std::string& module, std::ostream& os) {
+    size_t n = net.kind.size();
+    auto input = [&](int g) {
+        if (g >= 0) WriteNetName(os, net, g);
+        else os << "1'b0";
+    };
+
+    os << "module " << module << " (";
+    bool first = true;
+    for (size_t g = 0; g < n; ++g) {
+        GateKind kind = net.kind[g];
+        if (IsOwnedGate(net, g)) continue;
+        if (kind != GateKind::Switch && kind != GateKind::Clock && kind != GateKind::Led) continue;
+        os << (first ? "" : ", ");
+        if (kind == GateKind::Led) os << "led" << g;
+        else WriteNetName(os, net, (int)g);
+        first = false;
+    }
+    os << ");\n";
+
+    for (size_t g = 0; g < n; ++g) {
+        GateKind kind = net.kind[g];
+        if (IsOwnedGate(net, g)) continue;
+        if (kind == GateKind::Switch || kind == GateKind::Clock) {
+            os << "    input ";
+            WriteNetName(os, net, (int)g);
+            os << ";\n";
+        }
+        else if (kind == GateKind::Led) {
+            os << "    output led" << g << ";\n";
+        }
+        else if (IsSequential(kind)) {
+            int init = g < net.init.size() ? net.init[g] : 0;
+            os << "    reg n" << g << " = 1'b" << init << ";\n";
+        }
+        else if (VerilogPrimitive(kind)) {
+            os << "    wire n" << g << ";\n";
+        }
+    }
+    for (auto& inst : net.instances) {
+        for (size_t k = 0; k < inst.def->outputs.size(); ++k) os << "    wire n" << InstanceOutputNet(inst, k) << ";\n";
+    }
+    os << "\n";
+
+    // ӵ·ʵ˿ӣ˿ڵĻ¼ⲿ
+    for (auto& inst : net.instances) {
+        const SubcircuitDef& def = *inst.def;
+        os << "    " << SubcircuitModuleName(def) << " u" << inst.gate << " (";
+        for (size_t p = 0; p < def.inputs.size(); ++p) {
+            os << (p ? ", ." : ".");
+            WriteNetName(os, def.net, def.inputs[p]);
+            os << "(";
+            input(net.fanin[inst.base + def.inputs[p]][0]);
+            os << ")";
+        }
+        for (size_t k = 0; k < def.outputs.size(); ++k) {
+            os << (k || !def.inputs.empty() ? ", .led" : ".led") << def.outputs[k] << "(n" << InstanceOutputNet(inst, k) << ")";
+        }
+        os << ");\n";
+    }
+
+    for (size_t g = 0; g < n; ++g) {
+        GateKind kind = net.kind[g];
+        const std::vector<int>& in = net.fanin[g];
+        if (IsOwnedGate(net, g)) continue;
+        if (const char* prim = VerilogPrimitive(kind)) {
+            os << "    " << prim << " g" << g << " (n" << g;
+            for (int d : in) {
+                os << ", ";
+                input(d);
+            }
+            os << ");\n";
+        }
+        else if (kind == GateKind::Led) {
+            os << "    assign led" << g << " = ";
+            input(in[0]);
+            os << ";\n";
+        }
+        else if (kind == GateKind::Dff) {
+            os << "    always @(posedge ";
+            input(in[1]); // ʱʱӳֳʼֵ
+            os << ") n" << g << " <= ";
+            input(in[0]);
+            os << ";\n";
+        }
+        else if (kind == GateKind::Latch) {
+            os << "    always @* if (";
+            input(in[1]);
+            os << ") n" << g << " = ";
+            input(in[0]);
+            os << ";\n";
+        }
+    }
+    os << "endmodule\n";
+}
+
+void WriteVerilog(const LevelizedNetlist& net, const std::string& module, std::ostream& os) {
+    os << "// Generated by the circuit editor\n";
+    std::vector<const SubcircuitDef*> defs;
+    CollectSubcircuits(net, defs);
+    for (const SubcircuitDef* def : defs) {
+        WriteVerilogModule(def->net, SubcircuitModuleName(*def), os);
+        os << "\n";
+    }
+    WriteVerilogModule(net, module, os);
+}
+
+// BLIF  .names ֵֻгΪ 1 У
+static const char* BlifCover(GateKind kind) {
+    switch (kind) {
+    case GateKind::And: return "11 1\n";
+    case GateKind::Or: return "1- 1\n-1 1\n";
+    case GateKind::Not: return "0 1\n";
+    case GateKind::Xor: return "10 1\n01 1\n";
+    case GateKind::Nand: return "0- 1\n-0 1\n";
+    case GateKind::Nor: return "00 1\n";
+    case GateKind::Xnor: return "11 1\n00 1\n";
+    case GateKind::Buffer: return "1 1\n";
+    case GateKind::Led: return "1 1\n";
+    default: return nullptr;
+    }
+}
+
+static void WriteBlifModel(const LevelizedNetlist& net, const std::string& module, std::ostream& os) {
+    size_t n = net.kind.size();
+    bool dangling = false;
+    for (size_t g = 0; g < n && !dangling; ++g) {
+        for (int d : net.fanin[g]) dangling = dangling || d < 0;
+    }
+    auto input = [&](int g) {
+        if (g >= 0) WriteNetName(os, net, g);
+        else os << "zero";
+    };
+
+    os << ".model " << module << "\n.inputs";
+    for (size_t g = 0; g < n; ++g) {
+        if (IsOwnedGate(net, g)) continue;
+        if (net.kind[g] == GateKind::Switch || net.kind[g] == GateKind::Clock) {
+            os << " ";
+            WriteNetName(os, net, (int)g);
+        }
+    }
+    os << "\n.outputs";
+    for (size_t g = 0; g < n; ++g) {
+        if (net.kind[g] == GateKind::Led && !IsOwnedGate(net, g)) os << " led" << g;
+    }
+    os << "\n";
+    if (dangling) os << ".names zero\n"; // ûе .names Ϊ 0
+
+    for (auto& inst : net.instances) {
+        const SubcircuitDef& def = *inst.def;
+        os << ".subckt " << SubcircuitModuleName(def);
+        for (size_t p = 0; p < def.inputs.size(); ++p) {
+            os << " ";
+            WriteNetName(os, def.net, def.inputs[p]);
+            os << "=";
+            input(net.fanin[inst.base + def.inputs[p]][0]);
+        }
+        for (size_t k = 0; k < def.outputs.size(); ++k) {
+            os << " led" << def.outputs[k] << "=n" << InstanceOutputNet(inst, k);
+        }
+        os << "\n";
+    }
+
+    for (size_t g = 0; g < n; ++g) {
+        GateKind kind = net.kind[g];
+        const std::vector<int>& in = net.fanin[g];
+        if (IsOwnedGate(net, g)) continue;
+        if (const char* cover = BlifCover(kind)) {
+            os << ".names";
+            for (int d : in) {
+                os << " ";
+                input(d);
+            }
+            if (kind == GateKind::Led) os << " led" << g << "\n";
+            else os << " n" << g << "\n";
+            os << cover;
+        }
+        else if (IsSequential(kind)) {
+            int init = g < net.init.size() ? net.init[g] : 0;
+            os << ".latch ";
+            input(in[0]);
+            os << " n" << g << (kind == GateKind::Dff ? " re " : " ah ");
+            input(in[1]);
+            os << " " << init << "\n";
+        }
+    }
+    os << ".end\n";
+}
+
+// ģǰõӵ·һģ
+void WriteBlif(const LevelizedNetlist& net, const std::string& module, std::ostream& os) {
+    os << "# Generated by the circuit editor\n";
+    WriteBlifModel(net, module, os);
+    std::vector<const SubcircuitDef*> defs;
+    CollectSubcircuits(net, defs);
+    for (const SubcircuitDef* def : defs) {
+        os << "\n";
+        WriteBlifModel(def->net, SubcircuitModuleName(*def), os);
+    }
+}
+
+// ===== ڴӳļ =====
+// ֻӳļֱӳڴзּǺţʱƬļԤ
+class MappedFile {
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    bool Open(const wxString& filename, bool sequential = true) {
+        Close();
+#ifdef __WXMSW__
+        m_file = ::CreateFileW(filename.wc_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | (sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS), NULL);
+        if (m_file == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER size;
+        if (!::GetFileSizeEx(m_file, &size)) { Close(); return false; }
+        m_size = (size_t)size.QuadPart;
+        if (m_size == 0) { m_data = ""; return true; }
+        m_mapping = ::CreateFileMappingW(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (m_mapping == NULL) { Close(); return false; }
+        m_data = (const char*)::MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+        if (m_data == NULL) { Close(); return false; }
+#else
+        m_fd = ::open(filename.fn_str(), O_RDONLY);
+        if (m_fd < 0) return false;
+        struct stat st;
+        if (::fstat(m_fd, &st) != 0) { Close(); return false; }
+        m_size = (size_t)st.st_size;
+        if (m_size == 0) { m_data = ""; return true; }
+        void* p = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+        if (p == MAP_FAILED) { Close(); return false; }
+        ::madvise(p, m_size, sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+        m_data = (const char*)p;
+#endif
+        return true;
+    }
+
+    void Close() {
+#ifdef __WXMSW__
+        if (m_data && m_size) ::UnmapViewOfFile(m_data);
+        if (m_mapping != NULL) ::CloseHandle(m_mapping);
+        if (m_file != INVALID_HANDLE_VALUE) ::CloseHandle(m_file);
+        m_mapping = NULL;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data && m_size) ::munmap((void*)m_data, m_size);
+        if (m_fd >= 0) ::close(m_fd);
+        m_fd = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+    }
+
+    const char* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+
+    // ѾһβҪפϵͳֻӳ䣬֮ٷʱ´ļ룩
+    void Release(size_t offset, size_t length) {
+        if (!m_data || offset >= m_size) return;
+        length = std::min(length, m_size - offset);
+#ifdef __WXMSW__
+        ::VirtualUnlock((LPVOID)(m_data + offset), length);
+#else
+        size_t page = (size_t)::sysconf(_SC_PAGESIZE);
+        size_t begin = offset / page * page;
+        ::madvise((void*)(m_data + begin), offset + length - begin, MADV_DONTNEED);
+#endif
+    }
+
+private:
+    const char* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef __WXMSW__
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = NULL;
+#else
+    int m_fd = -1;
+#endif
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+};
+
+// ===== Ƭ·ļ =====
+// ·ĶƸʽΪƬŹϽڵƬ߹ΧڵƬ
+// ͬһƬļ¼ļţƬСֵַַУ¼ֻš
+// ʱֻӳļӿڸƬŽ Gate/WireڴԤʱûõƬ
+// ʱͳפڴļС޹ءֵС
+static const char TILED_MAGIC[4] = { 'C', 'T', 'B', '1' };
+static const int TILED_TILE_SIZE = 1024;
+static const int TILED_MAX_CELLS = 1024;    // ÿƬΧ̫ʱӴƬ
+
+struct TiledFileHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t gateCount;
+    uint64_t wireCount;
+    int32_t tileSize;
+    int32_t originX, originY;       // һƬϽ
+    int32_t cols, rows;
+    int32_t overhang;               // ¼Ƭ
+    uint64_t tilesOffset;           // Ƭcols * rows 
+    uint64_t stringsOffset;         // ַƫơUTF-8 
+    uint64_t subcircuitsOffset;     // ӵ·壨JSON ı
+    uint64_t subcircuitsBytes;
+};
+
+struct TiledFileTile {
+    uint64_t offset;                // ż¼֮߼¼
+    uint32_t bytes;
+    uint32_t gates;
+    uint32_t wires;
+    int32_t left, top, right, bottom;   // ݷΧ
+    uint32_t reserved;
+};
+
+// ĴСͼļʽã
+wxSize GetGateSize(const wxString& type) {
+    if (type == "NOT" || type == "BUFFER") return wxSize(70, 60);
+    if (type == "LED") return wxSize(80, 90);
+    if (type == "DFF" || type == "LATCH") return wxSize(80, 80);
+    auto it = subcircuitLibrary.find(type);
+    if (it != subcircuitLibrary.end()) return wxSize(it->second->size.x, it->second->size.y);
+    return wxSize(80, 60);
+}
+
+// ͬռݵķΧ
+wxRect GetGateExtent(const wxString& type, const wxPoint& pos, size_t propCount) {
+    wxSize size = GetGateSize(type);
+    if (propCount > 0) size.y = std::max(size.y, 70 + 12 * (int)propCount);
+    return wxRect(pos, size);
+}
+
+// ͼƬʱʵʻķΧͼΣ쵽ࣩ֡
+// ֿȰÿ 12 عƣƫ󣬶ֵһƬֻǶ໭һ
+wxRect GetGateDrawExtent(const wxString& type, const wxPoint& pos, const std::vector<Property>& props) {
+    wxRect r(pos, GetGateSize(type));
+    auto addText = [&r](int x, int y, size_t length, int height) {
+        r = r.Union(wxRect(x, y, 12 * (int)length, height));
+    };
+    auto it = shapeLibrary.find(type);
+    if (it == shapeLibrary.end()) {
+        addText(pos.x, pos.y, 4, 16);
+    }
+    else {
+        for (const Shape& sh : it->second) {
+            if (sh.type == ShapeType::Line || sh.type == ShapeType::Polygon) {
+                for (const wxPoint& p : sh.pts) r = r.Union(wxRect(pos + p, wxSize(1, 1)));
+            }
+            else if (sh.type == ShapeType::Circle || sh.type == ShapeType::Arc) {
+                r = r.Union(wxRect(pos.x + sh.center.x - sh.radius, pos.y + sh.center.y - sh.radius, 2 * sh.radius + 1, 2 * sh.radius + 1));
+            }
+            else if (sh.type == ShapeType::Text) {
+                addText(pos.x + sh.center.x, pos.y + sh.center.y, sh.text.length(), 16);
+            }
+        }
+    }
+    int y = pos.y + 70;
+    for (const Property& prop : props) {
+        addText(pos.x, y, prop.GetName().length() + 2 + prop.GetValueString().length(), 12);
+        y += 12;
+    }
+    r.Inflate(1, 1);  // ߿
+    return r;
+}
+
+wxRect GetWireExtent(const Wire& w) {
+    int left = w.points[0].x, right = left, top = w.points[0].y, bottom = top;
+    for (auto& p : w.points) {
+        left = std::min(left, p.x);
+        right = std::max(right, p.x);
+        top = std::min(top, p.y);
+        bottom = std::max(bottom, p.y);
+    }
+    return wxRect(wxPoint(left, top), wxPoint(right, bottom));
+}
+
+template <class T>
+void AppendBinary(std::string& out, const T& value) {
+    out.append((const char*)&value, sizeof(T));
+}
+
+// ӳڴ˳ȡԽǰOk()  false
+class BinaryCursor {
+public:
+    BinaryCursor(const char* data, size_t size) : m_p(data), m_end(data + size) {}
+
+    template <class T>
+    T Read() {
+        T value{};
+        if ((size_t)(m_end - m_p) < sizeof(T)) {
+            m_ok = false;
+            m_p = m_end;
+            return value;
+        }
+        std::memcpy(&value, m_p, sizeof(T));
+        m_p += sizeof(T);
+        return value;
+    }
+
+    bool Ok() const { return m_ok; }
+
+private:
+    const char* m_p;
+    const char* m_end;
+    bool m_ok = true;
+};
+
+bool WriteTiledCircuitFile(const CircuitSnapshot& snapshot, const wxString& filename, BackgroundJob* job, wxString& error) {
+    const GateStore& gates = snapshot.gates;
+    const std::vector<Wire>& wires = snapshot.wires;
+    size_t n = gates.size();
+
+    // ŰϽǡ߰ΧķƬ
+    std::vector<wxRect> wireExtent;
+    wireExtent.reserve(wires.size());
+    for (auto& w : wires) wireExtent.push_back(GetWireExtent(w));
+    auto wireAnchor = [&wireExtent](size_t k) {
+        const wxRect& r = wireExtent[k];
+        return wxPoint(r.x + r.width / 2, r.y + r.height / 2);
+    };
+    long long minX = 0, minY = 0, maxX = 0, maxY = 0;
+    bool first = true;
+    auto include = [&](const wxPoint& p) {
+        if (first) { minX = maxX = p.x; minY = maxY = p.y; first = false; }
+        minX = std::min<long long>(minX, p.x);
+        minY = std::min<long long>(minY, p.y);
+        maxX = std::max<long long>(maxX, p.x);
+        maxY = std::max<long long>(maxY, p.y);
+    };
+    for (size_t i = 0; i < n; ++i) include(gates.Pos(i));
+    for (size_t k = 0; k < wires.size(); ++k) include(wireAnchor(k));
+
+    long long tileSize = TILED_TILE_SIZE;
+    while ((std::max(maxX - minX, maxY - minY) + 1) / tileSize >= TILED_MAX_CELLS) tileSize *= 2;
+    int cols = (int)((maxX - minX) / tileSize + 1);
+    int rows = (int)((maxY - minY) / tileSize + 1);
+    size_t cells = (size_t)cols * rows;
+    auto cellOf = [&](const wxPoint& p) {
+        return (size_t)((p.y - minY) / tileSize) * cols + (size_t)((p.x - minX) / tileSize);
+    };
+
+    // Ƭ
+    std::vector<uint32_t> gateStart(cells + 1, 0), wireStart(cells + 1, 0);
+    for (size_t i = 0; i < n; ++i) ++gateStart[cellOf(gates.Pos(i)) + 1];
+    for (size_t k = 0; k < wires.size(); ++k) ++wireStart[cellOf(wireAnchor(k)) + 1];
+    for (size_t c = 0; c < cells; ++c) {
+        gateStart[c + 1] += gateStart[c];
+        wireStart[c + 1] += wireStart[c];
+    }
+    std::vector<uint32_t> gateOrder(n), wireOrder(wires.size());
+    {
+        std::vector<uint32_t> next(gateStart.begin(), gateStart.end() - 1);
+        for (size_t i = 0; i < n; ++i) gateOrder[next[cellOf(gates.Pos(i))]++] = (uint32_t)i;
+        next.assign(wireStart.begin(), wireStart.end() - 1);
+        for (size_t k = 0; k < wires.size(); ++k) wireOrder[next[cellOf(wireAnchor(k))]++] = (uint32_t)k;
+    }
+
+    // ļڵַ
+    std::unordered_map<int, uint32_t> localString;
+    std::vector<int> strings;
+    auto stringId = [&](int id) {
+        auto it = localString.find(id);
+        if (it != localString.end()) return it->second;
+        uint32_t local = (uint32_t)strings.size();
+        localString.insert(std::make_pair(id, local));
+        strings.push_back(id);
+        return local;
+    };
+
+    wxString temp = filename + ".tmp";
+    std::ofstream f(temp.ToStdString(), std::ios::binary);
+    if (!f.is_open()) {
+        error = "޷ļ: " + filename;
+        return false;
+    }
+
+    TiledFileHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, TILED_MAGIC, 4);
+    header.version = 1;
+    header.gateCount = n;
+    header.wireCount = wires.size();
+    header.tileSize = (int32_t)tileSize;
+    header.originX = (int32_t)minX;
+    header.originY = (int32_t)minY;
+    header.cols = cols;
+    header.rows = rows;
+    f.write((const char*)&header, sizeof(header));
+
+    std::vector<TiledFileTile> tiles(cells);
+    std::string buffer;
+    uint64_t offset = sizeof(header);
+    long long overhang = 0;
+    size_t written = 0;
+    for (size_t c = 0; c < cells; ++c) {
+        TiledFileTile& tile = tiles[c];
+        std::memset(&tile, 0, sizeof(tile));
+        tile.offset = offset;
+        tile.gates = gateStart[c + 1] - gateStart[c];
+        tile.wires = wireStart[c + 1] - wireStart[c];
+        if (tile.gates == 0 && tile.wires == 0) continue;
+
+        wxRect cell((int)(minX + (long long)(c % cols) * tileSize), (int)(minY + (long long)(c / cols) * tileSize), (int)tileSize, (int)tileSize);
+        wxRect extent;
+        buffer.clear();
+        for (uint32_t k = gateStart[c]; k < gateStart[c + 1]; ++k) {
+            size_t i = gateOrder[k];
+            const wxPoint& pos = gates.Pos(i);
+            const std::vector<Property>& props = gates.Properties(i);
+            AppendBinary<int32_t>(buffer, pos.x);
+            AppendBinary<int32_t>(buffer, pos.y);
+            AppendBinary<uint32_t>(buffer, stringId(gates.TypeId(i)));
+            AppendBinary<uint32_t>(buffer, (uint32_t)props.size());
+            for (auto& p : props) {
+                int64_t value;
+                if (p.type == PropertyType::String) value = stringId((int)p.i);
+                else std::memcpy(&value, &p.i, sizeof(value));
+                AppendBinary<uint32_t>(buffer, stringId(p.name));
+                AppendBinary<uint32_t>(buffer, (uint32_t)p.type);
+                AppendBinary<int64_t>(buffer, value);
+            }
+            wxRect r = GetGateExtent(gates.Type(i), pos, props.size());
+            extent = extent.IsEmpty() ? r : extent.Union(r);
+        }
+        for (uint32_t k = wireStart[c]; k < wireStart[c + 1]; ++k) {
+            const Wire& w = wires[wireOrder[k]];
+            AppendBinary<uint32_t>(buffer, (uint32_t)w.points.size());
+            for (auto& p : w.points) {
+                AppendBinary<int32_t>(buffer, p.x);
+                AppendBinary<int32_t>(buffer, p.y);
+            }
+            const wxRect& r = wireExtent[wireOrder[k]];
+            extent = extent.IsEmpty() ? r : extent.Union(r);
+        }
+        if (buffer.size() > UINT32_MAX) {
+            error = "ܼ, ޷дƬļ: " + filename;
+            f.close();
+            wxRemoveFile(temp);
+            return false;
+        }
+        tile.bytes = (uint32_t)buffer.size();
+        tile.left = extent.GetLeft();
+        tile.top = extent.GetTop();
+        tile.right = extent.GetRight() + 1;
+        tile.bottom = extent.GetBottom() + 1;
+        overhang = std::max<long long>(overhang, std::max(
+            std::max(cell.GetLeft() - tile.left, cell.GetTop() - tile.top),
+            std::max(tile.right - cell.GetRight() - 1, tile.bottom - cell.GetBottom() - 1)));
+        f.write(buffer.data(), buffer.size());
+        offset += buffer.size();
+
+        written += tile.gates;
+        if (job && n > 0 && c % 256 == 0) job->ReportProgress(0.9 * written / n);
+    }
+    header.overhang = (int32_t)std::min<long long>(overhang, INT32_MAX);
+
+    // ַ
+    header.stringsOffset = offset;
+    std::vector<std::string> utf8;
+    utf8.reserve(strings.size());
+    for (int id : strings) utf8.push_back(std::string(PropertyStrings::Get(id).ToUTF8().data()));
+    buffer.clear();
+    AppendBinary<uint32_t>(buffer, (uint32_t)utf8.size());
+    AppendBinary<uint32_t>(buffer, 0);
+    uint64_t textOffset = 0;
+    for (auto& s : utf8) {
+        AppendBinary<uint64_t>(buffer, textOffset);
+        textOffset += s.size();
+    }
+    AppendBinary<uint64_t>(buffer, textOffset);
+    for (auto& s : utf8) buffer += s;
+    f.write(buffer.data(), buffer.size());
+    offset += buffer.size();
+
+    // ӵ·
+    std::string defs = snapshot.subcircuits.empty() ? std::string() : SubcircuitsToJson(snapshot.subcircuits).dump();
+    header.subcircuitsOffset = offset;
+    header.subcircuitsBytes = defs.size();
+    f.write(defs.data(), defs.size());
+    offset += defs.size();
+
+    header.tilesOffset = offset;
+    f.write((const char*)tiles.data(), tiles.size() * sizeof(TiledFileTile));
+    f.seekp(0);
+    f.write((const char*)&header, sizeof(header));
+    f.close();
+    if (!f.fail() && IsCompressedFileName(filename)) {
+        // ļͷŻдδѹʱļѹ
+        wxString packed = filename + ".gz.tmp";
+        if (job) job->ReportProgress(0.95);
+        bool ok = CompressFile(temp, packed);
+        wxRemoveFile(temp);
+        temp = packed;
+        if (!ok) f.setstate(std::ios::failbit);
+    }
+    if (f.fail() || !FlushFileToDisk(temp)) {
+        wxRemoveFile(temp);
+        error = "дļʧ: " + filename;
+        return false;
+    }
+    if (!ReplaceFileAtomically(temp, filename)) {
+        wxRemoveFile(temp);
+        error = "޷滻ļ: " + filename;
+        return false;
+    }
+    return true;
+}
+
+// ƬļֻвѯƬŽʹõ˳򻺴ڴԤ
+class TiledCircuitFile {
+public:
+    struct Tile {
+        std::vector<Gate> gates;
+        std::vector<Wire> wires;
+    };
+
+    ~TiledCircuitFile() {
+        m_file.Close();
+        if (!m_tempFile.empty()) wxRemoveFile(m_tempFile);
+    }
+
+    // ӵ·ڴʱһ루¼׷ӵ addedDefs
+    // ѹƬļȽѹʱļӳ䣬رʱɾ
+    // ʱĿ¼ wxFileName ȡãڴ wxApp ֮ǰҲܵ
+    bool Open(const wxString& filename, std::vector<wxString>& addedDefs, wxString& error) {
+        wxString path = filename;
+        if (IsGzipFile(filename)) {
+            m_tempFile = wxFileName::CreateTempFileName(wxFileName::GetTempDir() + wxFILE_SEP_PATH + "ctb");
+            if (m_tempFile.empty() || !DecompressFile(filename, m_tempFile)) {
+                error = "ѹļʧ: " + filename;
+                return false;
+            }
+            path = m_tempFile;
+        }
+        if (!m_file.Open(path, false)) {
+            error = "޷ļ: " + filename;
+            return false;
+        }
+        const char* data = m_file.GetData();
+        size_t size = m_file.GetSize();
+        error = "ļ: " + filename;
+        if (size < sizeof(TiledFileHeader)) return false;
+        std::memcpy(&m_header, data, sizeof(m_header));
+        if (std::memcmp(m_header.magic, TILED_MAGIC, 4) != 0 || m_header.version != 1) {
+            error = "Ƭ·ļ: " + filename;
+            return false;
+        }
+        if (m_header.tileSize <= 0 || m_header.cols <= 0 || m_header.rows <= 0 || m_header.overhang < 0 ||
+            m_header.cols > TILED_MAX_CELLS || m_header.rows > TILED_MAX_CELLS ||
+            m_header.tilesOffset > size || GetTileCount() > (size - m_header.tilesOffset) / sizeof(TiledFileTile) ||
+            m_header.subcircuitsOffset > size || m_header.subcircuitsBytes > size - m_header.subcircuitsOffset ||
+            m_header.stringsOffset > size || size - m_header.stringsOffset < 8) return false;
+        uint32_t stringCount;
+        std::memcpy(&stringCount, data + m_header.stringsOffset, sizeof(stringCount));
+        if ((size - m_header.stringsOffset - 8) / 8 < (uint64_t)stringCount + 1) return false;
+        m_strings.assign(stringCount, -1);
+        m_stringText = m_header.stringsOffset + 8 + 8 * ((uint64_t)stringCount + 1);
+
+        if (m_header.subcircuitsBytes > 0) {
+            try {
+                json defs = json::parse(data + m_header.subcircuitsOffset, data + m_header.subcircuitsOffset + m_header.subcircuitsBytes);
+                wxString defError;
+                if (!LoadSubcircuitsFromJson(defs, addedDefs, defError)) {
+                    error = "ӵ·ʧ: " + defError;
+                    return false;
+                }
+            }
+            catch (const std::exception& e) {
+                error = wxString("ļʧ: ") + e.what();
+                return false;
+            }
+        }
+        error.clear();
+        return true;
+    }
+
+    size_t GetGateCount() const { return (size_t)m_header.gateCount; }
+    size_t GetWireCount() const { return (size_t)m_header.wireCount; }
+    size_t GetTileCount() const { return (size_t)m_header.cols * m_header.rows; }
+    size_t GetResidentTiles() const { return m_resident.size(); }
+    size_t GetResidentBytes() const { return m_residentBytes; }
+    void SetBudget(size_t bytes) { m_budget = bytes; }
+
+    // һǿƬݷΧ򿪺ӿƵ
+    wxRect GetFirstExtent() const {
+        for (size_t t = 0; t < GetTileCount(); ++t) {
+            TiledFileTile entry = Entry(t);
+            if (entry.gates + entry.wires > 0) return ExtentOf(entry);
+        }
+        return wxRect();
+    }
+
+    //  area ཻƬҪʱļнΧһȦƬҲԤȽƽʱصȴ
+    // صָһβѯǰЧ
+    void Query(const wxRect& area, std::vector<const Tile*>& tiles) {
+        tiles.clear();
+        ++m_stamp;
+        wxRect nearby = area;
+        nearby.Inflate(m_header.tileSize, m_header.tileSize);
+        int c0, r0, c1, r1;
+        CellRange(nearby, c0, r0, c1, r1);
+        size_t parsed = m_resident.size();
+        for (int r = r0; r <= r1; ++r) {
+            for (int c = c0; c <= c1; ++c) {
+                size_t index = (size_t)r * m_header.cols + c;
+                TiledFileTile entry = Entry(index);
+                if (entry.gates + entry.wires == 0) continue;
+                wxRect extent = ExtentOf(entry);
+                if (!nearby.Intersects(extent)) continue;
+                const Tile* tile = Materialize(index);
+                if (tile && area.Intersects(extent)) tiles.push_back(tile);
+            }
+        }
+        // ļ¼ѾڴУӳҳҪȱҳʱϵͳӳڵҳν
+        if (m_resident.size() != parsed) m_file.Release(sizeof(TiledFileHeader), (size_t)(m_header.stringsOffset - sizeof(TiledFileHeader)));
+        Evict();
+    }
+
+    // Ƭ뻺棨ʱʹã
+    bool ReadTile(size_t index, Tile& tile) {
+        TiledFileTile entry = Entry(index);
+        size_t size = m_file.GetSize();
+        if (entry.offset > size || entry.bytes > size - entry.offset ||
+            entry.gates > entry.bytes / 16 || entry.wires > entry.bytes / 4) return false;
+        BinaryCursor in(m_file.GetData() + entry.offset, entry.bytes);
+        tile.gates.resize(entry.gates);
+        for (auto& g : tile.gates) {
+            g.pos.x = in.Read<int32_t>();
+            g.pos.y = in.Read<int32_t>();
+            g.type = PropertyStrings::Get(StringId(in.Read<uint32_t>()));
+            uint32_t count = in.Read<uint32_t>();
+            if (count > entry.bytes / 16) return false;
+            g.properties.resize(count);
+            for (auto& p : g.properties) {
+                p.name = StringId(in.Read<uint32_t>());
+                uint32_t type = in.Read<uint32_t>();
+                int64_t value = in.Read<int64_t>();
+                p.type = type <= (uint32_t)PropertyType::Bool ? (PropertyType)type : PropertyType::String;
+                if (p.type == PropertyType::String) p.i = StringId((uint32_t)value);
+                else std::memcpy(&p.i, &value, sizeof(value));
+            }
+        }
+        tile.wires.resize(entry.wires);
+        for (auto& w : tile.wires) {
+            uint32_t count = in.Read<uint32_t>();
+            if (count < 2 || count > entry.bytes / 8) return false;
+            w.points.resize(count);
+            for (auto& p : w.points) {
+                p.x = in.Read<int32_t>();
+                p.y = in.Read<int32_t>();
+            }
+        }
+        return in.Ok();
+    }
+
+private:
+    struct Resident {
+        Tile tile;
+        size_t bytes;
+        uint64_t stamp;
+        std::list<size_t>::iterator use;
+    };
+
+    MappedFile m_file;
+    wxString m_tempFile;                // ѹʱļ
+    TiledFileHeader m_header;
+    std::vector<int> m_strings;         // ļеַ -> פţ-1 ʾûжȡ
+    uint64_t m_stringText = 0;
+    std::unordered_map<size_t, Resident> m_resident;
+    std::list<size_t> m_lru;            // õǰ
+    uint64_t m_stamp = 0;
+    size_t m_residentBytes = 0;
+    size_t m_budget = 64 << 20;
+
+    TiledFileTile Entry(size_t index) const {
+        TiledFileTile entry;
+        std::memcpy(&entry, m_file.GetData() + m_header.tilesOffset + index * sizeof(TiledFileTile), sizeof(entry));
+        return entry;
+    }
+
+    static wxRect ExtentOf(const TiledFileTile& entry) {
+        return wxRect(entry.left, entry.top, entry.right - entry.left, entry.bottom - entry.top);
+    }
+
+    // ݿ area еƬзΧ
+    void CellRange(const wxRect& area, int& c0, int& r0, int& c1, int& r1) const {
+        long long ts = m_header.tileSize, reach = m_header.overhang;
+        auto cell = [ts](long long v, long long origin, int count) {
+            long long c = v < origin ? -1 : (v - origin) / ts;
+            return (int)std::max<long long>(0, std::min<long long>(count - 1, c));
+        };
+        c0 = cell((long long)area.GetLeft() - reach, m_header.originX, m_header.cols);
+        c1 = cell((long long)area.GetRight() + reach, m_header.originX, m_header.cols);
+        r0 = cell((long long)area.GetTop() - reach, m_header.originY, m_header.rows);
+        r1 = cell((long long)area.GetBottom() + reach, m_header.originY, m_header.rows);
+    }
+
+    int StringId(uint32_t local) {
+        if (local >= m_strings.size()) return 0;
+        int& id = m_strings[local];
+        if (id < 0) {
+            const char* data = m_file.GetData();
+            uint64_t range[2];
+            std::memcpy(range, data + m_header.stringsOffset + 8 + 8 * (uint64_t)local, sizeof(range));
+            uint64_t size = m_file.GetSize();
+            if (range[0] > range[1] || m_stringText > size || range[1] > size - m_stringText) id = 0;
+            else id = PropertyStrings::Intern(wxString::FromUTF8(data + m_stringText + range[0], (size_t)(range[1] - range[0])));
+        }
+        return id;
+    }
+
+    const Tile* Materialize(size_t index) {
+        auto it = m_resident.find(index);
+        if (it == m_resident.end()) {
+            Resident r;
+            if (!ReadTile(index, r.tile)) return nullptr;
+            r.bytes = sizeof(Resident) + r.tile.gates.size() * (sizeof(Gate) + 32) + r.tile.wires.size() * sizeof(Wire);
+            for (auto& g : r.tile.gates) r.bytes += g.properties.size() * sizeof(Property);
+            for (auto& w : r.tile.wires) r.bytes += w.points.size() * sizeof(wxPoint);
+            m_residentBytes += r.bytes;
+            m_lru.push_front(index);
+            r.use = m_lru.begin();
+            it = m_resident.insert(std::make_pair(index, std::move(r))).first;
+        }
+        else {
+            m_lru.splice(m_lru.begin(), m_lru, it->second.use);
+        }
+        it->second.stamp = m_stamp;
+        return &it->second.tile;
+    }
+
+    // Ԥʱδõһ˶βѯõƬ
+    void Evict() {
+        while (m_residentBytes > m_budget && !m_lru.empty()) {
+            auto it = m_resident.find(m_lru.back());
+            if (it->second.stamp == m_stamp) break;
+            m_residentBytes -= it->second.bytes;
+            m_lru.pop_back();
+            m_resident.erase(it);
+        }
+    }
+};
+
+// Ƭļɱ༭ŰƬ˳
+bool ReadTiledCircuitFile(const wxString& filename, std::vector<Gate>& gates, std::vector<Wire>& wires,
+    std::vector<wxString>& addedDefs, wxString& error) {
+    TiledCircuitFile file;
+    if (!file.Open(filename, addedDefs, error)) return false;
+    gates.clear();
+    wires.clear();
+    gates.reserve(file.GetGateCount());
+    wires.reserve(file.GetWireCount());
+    TiledCircuitFile::Tile tile;
+    for (size_t t = 0; t < file.GetTileCount(); ++t) {
+        if (!file.ReadTile(t, tile)) {
+            error = "ļ: " + filename;
+            return false;
+        }
+        for (auto& g : tile.gates) gates.push_back(std::move(g));
+        for (auto& w : tile.wires) wires.push_back(std::move(w));
+    }
+    return true;
+}
+
+// =====  =====
+// ȡ BLIF ͽṹ Verilog ӼɵĸʽԼżԭ/assign/always д
+// Ǻָֻӳڴ (ָ, )ҲƣвΪÿǺŷڴ档
+struct TextToken {
+    const char* p = nullptr;
+    size_t n = 0;
+
+    bool Is(const char* s) const { return strlen(s) == n && memcmp(p, s, n) == 0; }
+};
+
+//  -> ţѰַɢбֱָļ
+class NetNameTable {
+public:
+    int Intern(const TextToken& name) {
+        if (m_slots.empty() || (m_names.size() + 1) * 2 > m_slots.size()) Grow();
+        size_t mask = m_slots.size() - 1;
+        for (size_t i = Hash(name.p, name.n) & mask;; i = (i + 1) & mask) {
+            int id = m_slots[i];
+            if (id < 0) {
+                m_slots[i] = (int)m_names.size();
+                m_names.push_back(name);
+                return m_slots[i];
+            }
+            if (m_names[id].n == name.n && memcmp(m_names[id].p, name.p, name.n) == 0) return id;
+        }
+    }
+
+    // ֽ⸴߼ʱ
+    int NewNet() {
+        m_names.push_back(TextToken());
+        return (int)m_names.size() - 1;
+    }
+
+    size_t Size() const { return m_names.size(); }
+    std::string Name(int id) const { return std::string(m_names[id].p, m_names[id].n); }
+
+private:
+    std::vector<TextToken> m_names;
+    std::vector<int> m_slots;
+
+    static size_t Hash(const char* p, size_t n) {
+        uint64_t h = 1469598103934665603ULL;
+        for (size_t i = 0; i < n; ++i) {
+            h ^= (unsigned char)p[i];
+            h *= 1099511628211ULL;
+        }
+        return (size_t)(h ^ (h >> 29));
+    }
+
+    void Grow() {
+        size_t size = m_slots.empty() ? 1024 : m_slots.size() * 2;
+        m_slots.assign(size, -1);
+        for (size_t id = 0; id < m_names.size(); ++id) {
+            if (!m_names[id].p) continue;
+            for (size_t i = Hash(m_names[id].p, m_names[id].n) & (size - 1);; i = (i + 1) & (size - 1)) {
+                if (m_slots[i] < 0) { m_slots[i] = (int)id; break; }
+            }
+        }
+    }
+};
+
+// õĵԪÿԪ룬һ
+class NetlistBuilder {
+public:
+    struct Cell {
+        GateKind kind;
+        int out;
+        int in[2];
+        unsigned char init;
+    };
+
+    NetNameTable names;
+    std::vector<Cell> cells;
+    std::vector<int> outputs;
+
+    int Net(const TextToken& name) { return names.Intern(name); }
+
+    //  clk/clock ͷΪʱԴΪ
+    void AddInput(const TextToken& name) {
+        bool clock = name.n >= 3 && (strncmp(name.p, "clk", 3) == 0 || strncmp(name.p, "CLK", 3) == 0 ||
+            (name.n >= 5 && (strncmp(name.p, "clock", 5) == 0 || strncmp(name.p, "CLOCK", 5) == 0)));
+        Emit(clock ? GateKind::Clock : GateKind::Switch, -1, -1, Net(name), 0);
+    }
+
+    int Emit(GateKind kind, int a, int b, int out, unsigned char init = 0) {
+        if (out < 0) out = names.NewNet();
+        Cell c = { kind, out, { a, b }, init };
+        cells.push_back(c);
+        return out;
+    }
+
+    int Constant(int value) {
+        int& net = m_const[value ? 1 : 0];
+        if (net < 0) net = Emit(GateKind::Switch, -1, -1, -1, (unsigned char)(value ? 1 : 0));
+        return net;
+    }
+
+    int Not(int net) {
+        auto it = m_not.find(net);
+        if (it != m_not.end()) return it->second;
+        int out = Emit(GateKind::Not, net, -1, -1);
+        m_not[net] = out;
+        return out;
+    }
+
+    // ŲŵƽNAND/NOR/XNOR ֻһȡ
+    int AddGate(GateKind kind, const std::vector<int>& in, int out) {
+        if (in.empty()) return Emit(GateKind::Buffer, Constant(0), -1, out);
+        if (kind == GateKind::Not || kind == GateKind::Buffer || in.size() == 1) {
+            bool invert = kind == GateKind::Not || kind == GateKind::Nand || kind == GateKind::Nor || kind == GateKind::Xnor;
+            return Emit(invert ? GateKind::Not : GateKind::Buffer, in[0], -1, out);
+        }
+        GateKind base = kind == GateKind::Nand ? GateKind::And : kind == GateKind::Nor ? GateKind::Or
+            : kind == GateKind::Xnor ? GateKind::Xor : kind;
+        m_reduce.assign(in.begin(), in.end());
+        while (m_reduce.size() > 2) {
+            size_t half = 0;
+            for (size_t i = 0; i + 1 < m_reduce.size(); i += 2) {
+                m_reduce[half++] = Emit(base, m_reduce[i], m_reduce[i + 1], -1);
+            }
+            if (m_reduce.size() % 2) m_reduce[half++] = m_reduce.back();
+            m_reduce.resize(half);
+        }
+        return Emit(kind, m_reduce[0], m_reduce[1], out);
+    }
+
+    // BLIF  .namesrows 벿ֵ 0/1/- ģʽonset Ϊ false ʱЩи 0
+    void Cover(const std::vector<int>& in, const std::vector<TextToken>& rows, bool onset, int out) {
+        size_t k = in.size();
+        if (k <= 2) {
+            unsigned tt = 0;
+            for (unsigned m = 0; m < (1u << k); ++m) {
+                for (auto& row : rows) {
+                    bool match = true;
+                    for (size_t i = 0; i < k && match; ++i) {
+                        char c = row.p[i];
+                        match = c == '-' || (c == '1') == (((m >> i) & 1) != 0);
+                    }
+                    if (match) { tt |= 1u << m; break; }
+                }
+            }
+            unsigned all = (1u << (1u << k)) - 1;
+            if (!onset) tt = ~tt & all;
+            if (tt == 0 || tt == all) {
+                Emit(GateKind::Buffer, Constant(tt != 0), -1, out);
+                return;
+            }
+            GateKind kind = GateKind::Unknown;
+            if (k == 1) kind = tt == 0x2 ? GateKind::Buffer : GateKind::Not;
+            else if (tt == 0x8) kind = GateKind::And;
+            else if (tt == 0xE) kind = GateKind::Or;
+            else if (tt == 0x6) kind = GateKind::Xor;
+            else if (tt == 0x7) kind = GateKind::Nand;
+            else if (tt == 0x1) kind = GateKind::Nor;
+            else if (tt == 0x9) kind = GateKind::Xnor;
+            if (kind != GateKind::Unknown) {
+                Emit(kind, in[0], k > 1 ? in[1] : -1, out);
+                return;
+            }
+        }
+
+        // һ֮ͣÿһ
+        std::vector<int> terms, literals;
+        for (auto& row : rows) {
+            literals.clear();
+            for (size_t i = 0; i < k; ++i) {
+                if (row.p[i] == '1') literals.push_back(in[i]);
+                else if (row.p[i] == '0') literals.push_back(Not(in[i]));
+            }
+            if (literals.empty()) {
+                terms.assign(1, Constant(1));
+                break;
+            }
+            terms.push_back(literals.size() == 1 ? literals[0] : AddGate(GateKind::And, literals, -1));
+        }
+        if (terms.empty()) terms.push_back(Constant(0));
+        AddGate(onset ? GateKind::Or : GateKind::Nor, terms, out);
+    }
+
+private:
+    int m_const[2] = { -1, -1 };
+    std::unordered_map<int, int> m_not;
+    std::vector<int> m_reduce;
+};
+
+// зּǺţ # עͺβ \ 
+class BlifReader {
+public:
+    BlifReader(const char* begin, const char* end) : m_p(begin), m_end(end) {}
+
+    bool NextLine(std::vector<TextToken>& tokens) {
+        tokens.clear();
+        while (m_p < m_end) {
+            char c = *m_p;
+            if (c == '\n') {
+                ++m_p;
+                ++m_line;
+                if (!tokens.empty()) return true;
+            }
+            else if (c == ' ' || c == '\t' || c == '\r') {
+                ++m_p;
+            }
+            else if (c == '#') {
+                while (m_p < m_end && *m_p != '\n') ++m_p;
+            }
+            else if (c == '\\' && IsLineEnd(m_p + 1)) {
+                while (*m_p != '\n') ++m_p;
+                ++m_p;
+                ++m_line;
+            }
+            else {
+                TextToken t;
+                t.p = m_p;
+                if (tokens.empty()) m_tokenLine = m_line;
+                while (m_p < m_end && !isspace((unsigned char)*m_p) && *m_p != '#') ++m_p;
+                t.n = m_p - t.p;
+                tokens.push_back(t);
+            }
+        }
+        return !tokens.empty();
+    }
+
+    // һек
+    int GetLine() const { return m_tokenLine; }
+
+private:
+    const char* m_p;
+    const char* m_end;
+    int m_line = 1;
+    int m_tokenLine = 1;
+
+    bool IsLineEnd(const char* p) const {
+        while (p < m_end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+        return p < m_end && *p == '\n';
+    }
+};
+
+bool ParseBlif(const char* begin, const char* end, NetlistBuilder& b, wxString& error) {
+    BlifReader reader(begin, end);
+    std::vector<TextToken> tokens, rows;
+    std::vector<int> in;
+    int clock = -1;
+    bool pending = false, onset = true, line = reader.NextLine(tokens);
+    int out = -1;
+
+    while (line) {
+        int lineNo = reader.GetLine();
+        const TextToken& head = tokens[0];
+        if (head.n == 0 || head.p[0] != '.') {
+            // .names ֵ
+            if (!pending) {
+                error = wxString::Format(" %d : ֵвκ .names", lineNo);
+                return false;
+            }
+            const TextToken& pattern = tokens[0];
+            const TextToken& value = tokens.size() > 1 ? tokens[1] : tokens[0];
+            if ((in.empty() ? tokens.size() != 1 : tokens.size() != 2 || pattern.n != in.size()) ||
+                value.n != 1 || (value.p[0] != '0' && value.p[0] != '1')) {
+                error = wxString::Format(" %d : ֵиʽ", lineNo);
+                return false;
+            }
+            onset = value.p[0] == '1';
+            rows.push_back(pattern);
+            line = reader.NextLine(tokens);
+            continue;
+        }
+
+        if (pending) {
+            if (in.empty()) b.Emit(GateKind::Buffer, b.Constant(!rows.empty() && onset), -1, out);
+            else b.Cover(in, rows, onset, out);
+            pending = false;
+        }
+
+        if (head.Is(".inputs")) {
+            for (size_t i = 1; i < tokens.size(); ++i) b.AddInput(tokens[i]);
+        }
+        else if (head.Is(".outputs")) {
+            for (size_t i = 1; i < tokens.size(); ++i) b.outputs.push_back(b.Net(tokens[i]));
+        }
+        else if (head.Is(".names")) {
+            if (tokens.size() < 2) {
+                error = wxString::Format(" %d : .names ȱ", lineNo);
+                return false;
+            }
+            in.clear();
+            rows.clear();
+            for (size_t i = 1; i + 1 < tokens.size(); ++i) in.push_back(b.Net(tokens[i]));
+            out = b.Net(tokens.back());
+            onset = true;
+            pending = true;
+        }
+        else if (head.Is(".latch")) {
+            // .latch   [ ] [ֵ]
+            if (tokens.size() < 3) {
+                error = wxString::Format(" %d : .latch ", lineNo);
+                return false;
+            }
+            int d = b.Net(tokens[1]), q = b.Net(tokens[2]);
+            size_t rest = tokens.size() - 3;
+            TextToken type;
+            int control = -1;
+            if (rest >= 2) {
+                type = tokens[3];
+                control = tokens[4].Is("NIL") ? -1 : b.Net(tokens[4]);
+            }
+            unsigned char init = rest == 1 || rest == 3 ? (tokens.back().Is("1") ? 1 : 0) : 0;
+            if (control < 0) {
+                // ûиźʱʹһȫʱ
+                if (clock < 0) clock = b.Emit(GateKind::Clock, -1, -1, -1);
+                control = clock;
+            }
+            if (type.p && (type.Is("ah") || type.Is("al"))) {
+                b.Emit(GateKind::Latch, d, type.Is("al") ? b.Not(control) : control, q, init);
+            }
+            else {
+                b.Emit(GateKind::Dff, d, type.p && type.Is("fe") ? b.Not(control) : control, q, init);
+            }
+        }
+        else if (head.Is(".end")) {
+            break;
+        }
+        else if (head.Is(".subckt") || head.Is(".gate") || head.Is(".mlatch")) {
+            error = wxString::Format(" %d : ֧ %s", lineNo, wxString(head.p, head.n));
+            return false;
+        }
+        // .model.clock ԼʱԼָ
+        line = reader.NextLine(tokens);
+    }
+    if (pending) {
+        if (in.empty()) b.Emit(GateKind::Buffer, b.Constant(!rows.empty() && onset), -1, out);
+        else b.Cover(in, rows, onset, out);
+    }
+    return true;
+}
+
+// Verilog Ǻţʶֳ 1'b0 д͵㣬<= ΪһǺ
+class VerilogLexer {
+public:
+    VerilogLexer(const char* begin, const char* end) : m_p(begin), m_end(end) {}
+
+    bool Next(TextToken& t) {
+        SkipSpace();
+        if (m_p >= m_end) return false;
+        t.p = m_p;
+        char c = *m_p;
+        if (c == '\\') {
+            // תʶհΪֹ
+            while (m_p < m_end && !isspace((unsigned char)*m_p)) ++m_p;
+        }
+        else if (isalnum((unsigned char)c) || c == '_' || c == '\'' || c == '$') {
+            while (m_p < m_end && (isalnum((unsigned char)*m_p) || *m_p == '_' || *m_p == '$' || *m_p == '\'')) ++m_p;
+        }
+        else if (c == '<' && m_p + 1 < m_end && m_p[1] == '=') {
+            m_p += 2;
+        }
+        else {
+            ++m_p;
+        }
+        t.n = m_p - t.p;
+        return true;
+    }
+
+    int GetLine() const { return m_line; }
+
+private:
+    const char* m_p;
+    const char* m_end;
+    int m_line = 1;
+
+    void SkipSpace() {
+        while (m_p < m_end) {
+            if (*m_p == '\n') { ++m_line; ++m_p; }
+            else if (isspace((unsigned char)*m_p)) ++m_p;
+            else if (*m_p == '/' && m_p + 1 < m_end && m_p[1] == '/') {
+                while (m_p < m_end && *m_p != '\n') ++m_p;
+            }
+            else if (*m_p == '/' && m_p + 1 < m_end && m_p[1] == '*') {
+                m_p += 2;
+                while (m_p + 1 < m_end && !(m_p[0] == '*' && m_p[1] == '/')) {
+                    if (*m_p == '\n') ++m_line;
+                    ++m_p;
+                }
+                m_p = std::min(m_p + 2, m_end);
+            }
+            else break;
+        }
+    }
+};
+
+class VerilogParser {
+public:
+    VerilogParser(const char* begin, const char* end, NetlistBuilder& b) : m_lex(begin, end), m_b(b) {}
+
+    bool Parse(wxString& error) {
+        bool inModule = false;
+        while (Advance()) {
+            if (m_tok.Is("module")) {
+                if (inModule) return Fail("֧Ƕ׵ module", error);
+                inModule = true;
+                if (!Advance()) return Fail("module ȱ", error);
+                if (!Advance()) return Fail("module ", error);
+                if (m_tok.Is("(") && !ParsePortList(error)) return false;
+                if (!m_tok.Is(";")) return Fail("module ͷȱ ;", error);
+            }
+            else if (m_tok.Is("endmodule")) {
+                return true; // ֻȡһģ
+            }
+            else if (!inModule) {
+                return Fail("module ֮", error);
+            }
+            else if (m_tok.Is("input") || m_tok.Is("output") || m_tok.Is("wire") || m_tok.Is("reg")) {
+                if (!ParseDeclaration(error)) return false;
+            }
+            else if (m_tok.Is("assign")) {
+                if (!ParseAssign(error)) return false;
+            }
+            else if (m_tok.Is("always")) {
+                if (!ParseAlways(error)) return false;
+            }
+            else if (Primitive(m_tok) != GateKind::Unknown) {
+                if (!ParseInstance(Primitive(m_tok), error)) return false;
+            }
+            else {
+                return Fail("ֵ֧ " + TokenText(), error);
+            }
+        }
+        return inModule ? true : Fail("ûҵ module", error);
+    }
+
+    // reg ĳֵ
+    unsigned char GetInit(int net) const { return (size_t)net < m_init.size() ? m_init[net] : 0; }
+
+private:
+    VerilogLexer m_lex;
+    NetlistBuilder& m_b;
+    TextToken m_tok;
+    std::vector<int> m_args;
+    std::vector<unsigned char> m_init;
+
+    bool Advance() { return m_lex.Next(m_tok); }
+
+    wxString TokenText() const { return wxString(m_tok.p, m_tok.n); }
+
+    bool Fail(const wxString& message, wxString& error) {
+        error = wxString::Format(" %d : %s", m_lex.GetLine(), message);
+        return false;
+    }
+
+    bool Expect(const char* s, wxString& error) {
+        if (Advance() && m_tok.Is(s)) return true;
+        return Fail(wxString::Format("ӦΪ %s", s), error);
+    }
+
+    static GateKind Primitive(const TextToken& t) {
+        if (t.Is("and")) return GateKind::And;
+        if (t.Is("or")) return GateKind::Or;
+        if (t.Is("not")) return GateKind::Not;
+        if (t.Is("xor")) return GateKind::Xor;
+        if (t.Is("nand")) return GateKind::Nand;
+        if (t.Is("nor")) return GateKind::Nor;
+        if (t.Is("xnor")) return GateKind::Xnor;
+        if (t.Is("buf")) return GateKind::Buffer;
+        return GateKind::Unknown;
+    }
+
+    bool IsIdentifier() const {
+        return m_tok.n > 0 && (isalpha((unsigned char)m_tok.p[0]) || m_tok.p[0] == '_' || m_tok.p[0] == '\\');
+    }
+
+    // ǰǺΪ 1'b0 / 1'b1 / 0 / 1
+    bool Operand(int& net, wxString& error) {
+        if (IsIdentifier()) {
+            net = m_b.Net(m_tok);
+            return true;
+        }
+        if (m_tok.n > 0 && (m_tok.p[m_tok.n - 1] == '0' || m_tok.p[m_tok.n - 1] == '1') && isdigit((unsigned char)m_tok.p[0])) {
+            net = m_b.Constant(m_tok.p[m_tok.n - 1] == '1');
+            return true;
+        }
+        return Fail("޷ʶĲ " + TokenText(), error);
+    }
+
+    // ˿бֱӴANSI д
+    bool ParsePortList(wxString& error) {
+        bool input = false, output = false;
+        while (Advance() && !m_tok.Is(")")) {
+            if (m_tok.Is("input")) { input = true; output = false; }
+            else if (m_tok.Is("output")) { output = true; input = false; }
+            else if (m_tok.Is("wire") || m_tok.Is("reg") || m_tok.Is(",")) continue;
+            else if (m_tok.Is("[")) return Fail("֧", error);
+            else if (IsIdentifier()) {
+                if (input) m_b.AddInput(m_tok);
+                else if (output) m_b.outputs.push_back(m_b.Net(m_tok));
+            }
+            else return Fail("˿бʽ", error);
+        }
+        return Advance();
+    }
+
+    bool ParseDeclaration(wxString& error) {
+        bool input = m_tok.Is("input"), output = m_tok.Is("output");
+        while (Advance() && !m_tok.Is(";")) {
+            if (m_tok.Is(",") || m_tok.Is("wire") || m_tok.Is("reg")) continue;
+            if (m_tok.Is("[")) return Fail("֧", error);
+            if (!IsIdentifier()) return Fail("ʽ", error);
+            int net = m_b.Net(m_tok);
+            if (input) m_b.AddInput(m_tok);
+            else if (output) m_b.outputs.push_back(net);
+            if (m_init.size() <= (size_t)net) m_init.resize(net + 1, 0);
+            if (!Advance()) break;
+            if (m_tok.Is("=")) {
+                // reg q = 1'b1;
+                if (!Advance()) break;
+                m_init[net] = m_tok.n > 0 && m_tok.p[m_tok.n - 1] == '1';
+                if (!Advance()) break;
+            }
+            if (m_tok.Is(";")) return true;
+            if (!m_tok.Is(",")) return Fail("ʽ", error);
+        }
+        return true;
+    }
+
+    bool ParseInstance(GateKind kind, wxString& error) {
+        if (!Advance()) return Fail("ʵ", error);
+        if (!m_tok.Is("(")) {
+            // ʵѡ
+            if (!Expect("(", error)) return false;
+        }
+        m_args.clear();
+        while (Advance() && !m_tok.Is(")")) {
+            if (m_tok.Is(",")) continue;
+            int net;
+            if (!Operand(net, error)) return false;
+            m_args.push_back(net);
+        }
+        if (m_args.size() < 2) return Fail("ʵҪһһ", error);
+        int out = m_args[0];
+        m_args.erase(m_args.begin());
+        m_b.AddGate(kind, m_args, out);
+        return Expect(";", error);
+    }
+
+    // assign y = a; assign y = ~a; assign y = a op b; assign y = ~(a op b);
+    bool ParseAssign(wxString& error) {
+        int out, a, c;
+        if (!Advance() || !Operand(out, error)) return false;
+        if (!Expect("=", error)) return false;
+        bool invert = false, paren = false;
+        if (!Advance()) return Fail("assign ", error);
+        if (m_tok.Is("~")) {
+            invert = true;
+            if (!Advance()) return Fail("assign ", error);
+        }
+        if (m_tok.Is("(")) {
+            paren = true;
+            if (!Advance()) return Fail("assign ", error);
+        }
+        if (!Operand(a, error) || !Advance()) return false;
+        if (paren && m_tok.Is(")")) {
+            paren = false;
+            if (!Advance()) return Fail("assign ", error);
+        }
+        if (m_tok.Is(";")) {
+            m_b.Emit(invert ? GateKind::Not : GateKind::Buffer, a, -1, out);
+            return true;
+        }
+        GateKind kind;
+        if (m_tok.Is("&")) kind = invert ? GateKind::Nand : GateKind::And;
+        else if (m_tok.Is("|")) kind = invert ? GateKind::Nor : GateKind::Or;
+        else if (m_tok.Is("^")) kind = invert ? GateKind::Xnor : GateKind::Xor;
+        else return Fail("ֵ֧ " + TokenText(), error);
+        if (invert && !paren) return Fail("~ ֻڵʽ", error);
+        if (!Advance() || !Operand(c, error)) return false;
+        if (paren && !Expect(")", error)) return false;
+        m_b.Emit(kind, a, c, out);
+        return Expect(";", error);
+    }
+
+    // always @(posedge clk) q <= d;    always @* if (en) q = d;
+    bool ParseAlways(wxString& error) {
+        if (!Expect("@", error) || !Advance()) return false;
+        if (m_tok.Is("*")) {
+            return ParseLatch(error);
+        }
+        if (!m_tok.Is("(") || !Advance()) return Fail("always ʽ", error);
+        if (m_tok.Is("*")) {
+            if (!Expect(")", error)) return false;
+            return ParseLatch(error);
+        }
+        bool negedge = m_tok.Is("negedge");
+        if (!negedge && !m_tok.Is("posedge")) return Fail("ֻ֧ posedge/negedge  always", error);
+        int clock, q, d;
+        if (!Advance() || !Operand(clock, error) || !Expect(")", error)) return false;
+        if (!Advance() || !Operand(q, error)) return false;
+        if (!Advance() || !(m_tok.Is("<=") || m_tok.Is("="))) return Fail("ӦΪ <=", error);
+        if (!Advance() || !Operand(d, error) || !Expect(";", error)) return false;
+        m_b.Emit(GateKind::Dff, d, negedge ? m_b.Not(clock) : clock, q);
+        return true;
+    }
+
+    bool ParseLatch(wxString& error) {
+        int en, q, d;
+        if (!Expect("if", error) || !Expect("(", error)) return false;
+        if (!Advance() || !Operand(en, error) || !Expect(")", error)) return false;
+        if (!Advance() || !Operand(q, error)) return false;
+        if (!Advance() || !(m_tok.Is("<=") || m_tok.Is("="))) return Fail("ӦΪ =", error);
+        if (!Advance() || !Operand(d, error) || !Expect(";", error)) return false;
+        m_b.Emit(GateKind::Latch, d, en, q);
+        return true;
+    }
+};
+
+// ѵԪתɻϵźߣηԶڷ
+void PlaceImportedNetlist(const NetlistBuilder& b, std::vector<Gate>& gates, std::vector<Wire>& wires) {
+    size_t nets = b.names.Size();
+    std::vector<int> driver(nets, -1), readers(nets, 0);
+    for (size_t c = 0; c < b.cells.size(); ++c) {
+        const NetlistBuilder::Cell& cell = b.cells[c];
+        if (driver[cell.out] < 0) driver[cell.out] = (int)c;
+        for (int p = 0; p < 2; ++p) {
+            if (cell.in[p] >= 0) readers[cell.in[p]]++;
+        }
+    }
+
+    // ֻ˿ڵĻֱ LED 
+    std::vector<int> ledNet;
+    std::vector<unsigned char> dropped(b.cells.size(), 0);
+    for (int net : b.outputs) {
+        int c = driver[net];
+        if (c >= 0 && b.cells[c].kind == GateKind::Buffer && readers[net] == 0) {
+            dropped[c] = 1;
+            net = b.cells[c].in[0];
+        }
+        ledNet.push_back(net);
+    }
+
+    // ţĵԪαţLED 
+    std::vector<int> index(b.cells.size(), -1);
+    std::vector<GateKind> kind;
+    std::vector<unsigned char> init;
+    for (size_t c = 0; c < b.cells.size(); ++c) {
+        if (dropped[c]) continue;
+        const NetlistBuilder::Cell& cell = b.cells[c];
+        index[c] = (int)kind.size();
+        kind.push_back(cell.kind);
+        init.push_back(cell.init);
+    }
+    size_t n = kind.size() + ledNet.size();
+    std::vector<std::vector<int>> fanin(n), fanout(n);
+    auto driverGate = [&](int net) { return net >= 0 && driver[net] >= 0 ? index[driver[net]] : -1; };
+    for (size_t c = 0; c < b.cells.size(); ++c) {
+        if (index[c] < 0) continue;
+        int g = index[c];
+        fanin[g].resize(GetPinLayout(kind[g]).inputs.size(), -1);
+        for (size_t p = 0; p < fanin[g].size(); ++p) fanin[g][p] = driverGate(b.cells[c].in[p]);
+    }
+    for (size_t i = 0; i < ledNet.size(); ++i) {
+        kind.push_back(GateKind::Led);
+        init.push_back(0);
+        fanin[kind.size() - 1].assign(1, driverGate(ledNet[i]));
+    }
+    for (size_t g = 0; g < n; ++g) {
+        for (int d : fanin[g]) if (d >= 0) fanout[d].push_back((int)g);
+    }
+
+    std::vector<int> level, cyclic;
+    LevelizeGates(kind, fanin, fanout, level, cyclic);
+
+    // Уͬһﰴеƽֵ򣬼߽
+    int maxLevel = 0;
+    for (int l : level) maxLevel = std::max(maxLevel, l);
+    std::vector<std::vector<int>> columns(maxLevel + 1);
+    for (size_t g = 0; g < n; ++g) columns[level[g]].push_back((int)g);
+    std::vector<double> row(n, 0), key(n, 0);
+    static const int COLUMN_WIDTH = 200, ROW_HEIGHT = 100;
+    gates.assign(n, Gate());
+    for (int l = 0; l <= maxLevel; ++l) {
+        std::vector<int>& col = columns[l];
+        for (int g : col) {
+            double sum = 0;
+            int count = 0;
+            for (int d : fanin[g]) {
+                if (d >= 0 && level[d] < l) { sum += row[d]; ++count; }
+            }
+            key[g] = count ? sum / count : (double)g;
+        }
+        std::stable_sort(col.begin(), col.end(), [&key](int a, int c) { return key[a] < key[c]; });
+        for (size_t r = 0; r < col.size(); ++r) {
+            int g = col[r];
+            row[g] = (double)r;
+            gates[g].pos = wxPoint(50 + l * COLUMN_WIDTH, 50 + (int)r * ROW_HEIGHT);
+        }
+    }
+
+    for (size_t g = 0; g < n; ++g) {
+        Gate& gate = gates[g];
+        switch (kind[g]) {
+        case GateKind::And: gate.type = "AND"; break;
+        case GateKind::Or: gate.type = "OR"; break;
+        case GateKind::Not: gate.type = "NOT"; break;
+        case GateKind::Xor: gate.type = "XOR"; break;
+        case GateKind::Nand: gate.type = "NAND"; break;
+        case GateKind::Nor: gate.type = "NOR"; break;
+        case GateKind::Xnor: gate.type = "XNOR"; break;
+        case GateKind::Buffer: gate.type = "BUFFER"; break;
+        case GateKind::Led: gate.type = "LED"; break;
+        case GateKind::Switch: gate.type = ""; break;
+        case GateKind::Clock: gate.type = "CLOCK"; break;
+        case GateKind::Dff: gate.type = "DFF"; break;
+        case GateKind::Latch: gate.type = "LATCH"; break;
+        default: break;
+        }
+        SetDefaultProperties(gate);
+        if (init[g]) {
+            for (auto& prop : gate.properties) {
+                if (prop.name == PROP_SWITCH_STATE) prop = Property::MakeString(PROP_SWITCH_STATE, "");
+                else if (prop.name == PROP_INIT) prop = Property::MakeBool(PROP_INIT, true);
+            }
+        }
+    }
+
+    wires.clear();
+    for (size_t g = 0; g < n; ++g) {
+        const PinLayout& layout = GetPinLayout(kind[g]);
+        for (size_t p = 0; p < fanin[g].size(); ++p) {
+            int d = fanin[g][p];
+            if (d < 0) continue;
+            wires.push_back(Wire(gates[d].pos + GetPinLayout(kind[d]).outputs[0], gates[g].pos + layout.inputs[p]));
+        }
+    }
+}
+
+// չѡ BLIF  Verilog 
+bool ImportNetlist(const wxString& filename, std::vector<Gate>& gates, std::vector<Wire>& wires, wxString& error) {
+    MappedFile file;
+    if (!file.Open(filename)) {
+        error = "޷ļ: " + filename;
+        return false;
+    }
+    const char* begin = file.GetData();
+    const char* end = begin + file.GetSize();
+
+    NetlistBuilder builder;
+    if (filename.Lower().EndsWith(".blif")) {
+        if (!ParseBlif(begin, end, builder, error)) return false;
+    }
+    else {
+        VerilogParser parser(begin, end, builder);
+        if (!parser.Parse(error)) return false;
+        for (auto& cell : builder.cells) {
+            if (IsSequential(cell.kind)) cell.init = parser.GetInit(cell.out);
+        }
+    }
+    PlaceImportedNetlist(builder, gates, wires);
+    return true;
+}
+
+// ===== Զ =====
+// ߰ѸҲһеλãصŻƿ
+// ٰźϷ/вλϣصϣڲλģ˻
+// ˻ʱгÿֻ߳ƶԼţŶȡֿʼʱĿգ
+// ȣſ𲽿߽硣
+// ߵٳȣźŷ򣨴󣩵߼ӷٽͻơ
+struct LayoutEdge {
+    int from, to;            // š
+    wxPoint fromPin, toPin;  // λõƫ
+};
+
+struct LayoutResult {
+    std::vector<wxPoint> pos;
+    double wireLengthBefore = 0;
+    double wireLengthAfter = 0;
+};
+
+class AutoPlacer {
+public:
+    // height ŷĸ߶ȣռüвۣλȡ gridSize 
+    AutoPlacer(const std::vector<wxPoint>& pos, const std::vector<int>& height, const std::vector<LayoutEdge>& edges, int gridSize)
+        : m_edges(edges) {
+        size_t n = pos.size();
+        m_pitchX = RoundUp(COLUMN_PITCH, gridSize);
+        m_pitchY = RoundUp(ROW_PITCH, gridSize);
+        m_x.resize(n);
+        m_y.resize(n);
+        m_span.resize(n);
+        for (size_t g = 0; g < n; ++g) {
+            m_x[g] = pos[g].x;
+            m_y[g] = pos[g].y;
+            m_span[g] = std::max(1, (height[g] + m_pitchY - 1) / m_pitchY);
+        }
+        m_incident.assign(n, std::vector<int>());
+        for (size_t e = 0; e < edges.size(); ++e) {
+            m_incident[edges[e].from].push_back((int)e);
+            if (edges[e].to != edges[e].from) m_incident[edges[e].to].push_back((int)e);
+        }
+        m_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // ȡʱ false
+    bool Run(BackgroundJob* job, LayoutResult& result) {
+        size_t n = m_x.size();
+        result.pos.assign(n, wxPoint());
+        if (n == 0) return true;
+        for (size_t g = 0; g < n; ++g) result.pos[g] = wxPoint((int)m_x[g], (int)m_y[g]);
+        result.wireLengthBefore = WireLength(result.pos);
+
+        if (!ForceDirected(job)) return false;
+        Legalize();
+        if (!Anneal(job)) return false;
+
+        for (size_t g = 0; g < n; ++g) {
+            result.pos[g] = wxPoint(MARGIN_X + m_col[g] * m_pitchX, MARGIN_Y + m_row[g] * m_pitchY);
+        }
+        result.wireLengthAfter = WireLength(result.pos);
+        return true;
+    }
+
+private:
+    static const int COLUMN_PITCH = 260;  // żԼ 130Զߵ
+    static const int ROW_PITCH = 120;     // ֮
+    static const int MARGIN_X = 60;       // 
+    static const int MARGIN_Y = 40;
+    static const int FORCE_ITERATIONS = 80;
+    static const int ANNEAL_ROUNDS = 48;
+    static const int BACKWARD_PENALTY = 2;
+
+    std::vector<int> m_span;
+    std::vector<LayoutEdge> m_edges;
+    std::vector<std::vector<int>> m_incident;
+    unsigned m_threads;
+    int m_pitchX, m_pitchY;
+
+    std::vector<double> m_x, m_y;         // ׶ε
+    std::vector<int> m_col, m_row;        // Ϸ֮Ĳλ
+    int m_columns = 0, m_rows = 0;
+    std::vector<int> m_occupied;          // λ -> ţдţm_occupied[col * m_rows + row]
+
+    static int RoundUp(int v, int grid) { return grid > 0 ? (v + grid - 1) / grid * grid : v; }
+
+    double WireLength(const std::vector<wxPoint>& pos) const {
+        double total = 0;
+        for (auto& e : m_edges) {
+            wxPoint a = pos[e.from] + e.fromPin, b = pos[e.to] + e.toPin;
+            total += std::abs(a.x - b.x) + std::abs(a.y - b.y);
+        }
+        return total;
+    }
+
+    //  [0, count) ִָ̲߳
+    void ParallelFor(size_t count, const std::function<void(size_t, size_t)>& body) const {
+        unsigned threads = (unsigned)std::min<size_t>(m_threads, std::max<size_t>(1, count / 1024));
+        if (threads <= 1) {
+            body(0, count);
+            return;
+        }
+        std::vector<std::thread> pool;
+        size_t chunk = (count + threads - 1) / threads;
+        for (unsigned t = 0; t < threads; ++t) {
+            size_t begin = t * chunk, end = std::min(count, begin + chunk);
+            if (begin < end) pool.emplace_back(body, begin, end);
+        }
+        for (auto& th : pool) th.join();
+    }
+
+    bool ForceDirected(BackgroundJob* job) {
+        size_t n = m_x.size();
+        std::vector<double> fx(n), fy(n);
+        std::unordered_map<long long, std::vector<int>> cells;
+        double maxStep = m_pitchX * 2.0;
+        for (int iter = 0; iter < FORCE_ITERATIONS; ++iter) {
+            if (job && job->IsCancelled()) return false;
+            cells.clear();
+            for (size_t g = 0; g < n; ++g) {
+                long long key = ((long long)std::floor(m_x[g] / m_pitchX) << 32) ^ (unsigned int)(int)std::floor(m_y[g] / m_pitchY);
+                cells[key].push_back((int)g);
+            }
+            ParallelFor(n, [&](size_t begin, size_t end) {
+                for (size_t g = begin; g < end; ++g) {
+                    double sx = 0, sy = 0;
+                    // ߣϣҲһСŵȸ
+                    for (int e : m_incident[g]) {
+                        const LayoutEdge& edge = m_edges[e];
+                        double dx = m_x[edge.from] + m_pitchX - m_x[edge.to];
+                        double dy = m_y[edge.from] + edge.fromPin.y - edge.toPin.y - m_y[edge.to];
+                        if ((int)g == edge.to) { sx += dx; sy += dy; }
+                        else { sx -= dx; sy -= dy; }
+                    }
+                    if (!m_incident[g].empty()) {
+                        sx *= 0.5 / m_incident[g].size();
+                        sy *= 0.5 / m_incident[g].size();
+                    }
+                    // صصСķƿ
+                    int cx = (int)std::floor(m_x[g] / m_pitchX), cy = (int)std::floor(m_y[g] / m_pitchY);
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        for (int dy = -1; dy <= 1; ++dy) {
+                            auto it = cells.find(((long long)(cx + dx) << 32) ^ (unsigned int)(cy + dy));
+                            if (it == cells.end()) continue;
+                            for (int h : it->second) {
+                                if (h == (int)g) continue;
+                                double ox = m_pitchX - std::abs(m_x[g] - m_x[h]);
+                                double oy = m_pitchY * 0.5 * (m_span[g] + m_span[h]) - std::abs(m_y[g] - m_y[h]);
+                                if (ox <= 0 || oy <= 0) continue;
+                                // ȫغʱž
+                                double dirX = m_x[g] != m_x[h] ? (m_x[g] > m_x[h] ? 1 : -1) : ((int)g > h ? 1 : -1);
+                                double dirY = m_y[g] != m_y[h] ? (m_y[g] > m_y[h] ? 1 : -1) : ((int)g > h ? 1 : -1);
+                                if (ox * m_pitchY < oy * m_pitchX) sx += dirX * ox * 0.5;
+                                else sy += dirY * oy * 0.5;
+                            }
+                        }
+                    }
+                    fx[g] = sx;
+                    fy[g] = sy;
+                }
+            });
+            double limit = maxStep * (1.0 - (double)iter / FORCE_ITERATIONS) + 1;
+            for (size_t g = 0; g < n; ++g) {
+                m_x[g] += std::max(-limit, std::min(limit, fx[g]));
+                m_y[g] += std::max(-limit, std::min(limit, fy[g]));
+            }
+            if (job) job->ReportProgress(0.3 * (iter + 1) / FORCE_ITERATIONS);
+        }
+        return true;
+    }
+
+    // УÿڴпʼѰҿλ
+    void Legalize() {
+        size_t n = m_x.size();
+        double minX = m_x[0], minY = m_y[0];
+        for (size_t g = 0; g < n; ++g) {
+            minX = std::min(minX, m_x[g]);
+            minY = std::min(minY, m_y[g]);
+        }
+        m_col.assign(n, 0);
+        m_row.assign(n, 0);
+        std::vector<int> wantRow(n);
+        m_columns = 1;
+        int totalSpan = 0;
+        for (size_t g = 0; g < n; ++g) {
+            m_col[g] = (int)std::floor((m_x[g] - minX) / m_pitchX + 0.5);
+            wantRow[g] = (int)std::floor((m_y[g] - minY) / m_pitchY + 0.5);
+            m_columns = std::max(m_columns, m_col[g] + 1);
+            totalSpan += m_span[g];
+        }
+        std::vector<std::vector<int>> columns(m_columns);
+        for (size_t g = 0; g < n; ++g) columns[m_col[g]].push_back((int)g);
+
+        // ÿаηãž
+        std::vector<std::vector<int>> colOccupied(m_columns);
+        int rows = 1;
+        for (int c = 0; c < m_columns; ++c) {
+            std::vector<int>& col = columns[c];
+            std::stable_sort(col.begin(), col.end(), [&wantRow](int a, int b) { return wantRow[a] < wantRow[b]; });
+            std::vector<int>& occ = colOccupied[c];
+            for (int g : col) {
+                int r = FindFreeRows(occ, wantRow[g], m_span[g]);
+                if ((int)occ.size() < r + m_span[g]) occ.resize(r + m_span[g], -1);
+                for (int k = 0; k < m_span[g]; ++k) occ[r + k] = g;
+                m_row[g] = r;
+                rows = std::max(rows, r + m_span[g]);
+            }
+        }
+        // ˻ʱƵ֮һЩλ
+        m_rows = rows + std::max(4, (int)std::sqrt((double)totalSpan) / 4);
+        m_occupied.assign((size_t)m_columns * m_rows, -1);
+        for (size_t g = 0; g < n; ++g) {
+            for (int k = 0; k < m_span[g]; ++k) m_occupied[(size_t)m_col[g] * m_rows + m_row[g] + k] = (int)g;
+        }
+    }
+
+    static int FindFreeRows(const std::vector<int>& occ, int want, int span) {
+        auto freeAt = [&](int r) {
+            if (r < 0) return false;
+            for (int k = 0; k < span; ++k) {
+                if (r + k < (int)occ.size() && occ[r + k] >= 0) return false;
+            }
+            return true;
+        };
+        for (int d = 0;; ++d) {
+            if (freeAt(want + d)) return want + d;
+            if (freeAt(want - d)) return want - d;
+        }
+    }
+
+    // һ̵߳˻
+    struct Stripe {
+        int begin, end;                   // зΧ [begin, end)
+        std::vector<int> gates;
+    };
+
+    bool Anneal(BackgroundJob* job) {
+        size_t n = m_col.size();
+        std::vector<int> snapCol, snapRow;
+        double temperature = 0;
+        for (auto& e : m_edges) temperature += EdgeCost(e, m_col, m_row, nullptr, -1);
+        temperature = m_edges.empty() ? 1 : 0.5 * temperature / m_edges.size();
+        double finalTemperature = std::max(1.0, temperature * 0.005);
+        double cooling = std::pow(finalTemperature / temperature, 1.0 / ANNEAL_ROUNDS);
+
+        for (int round = 0; round < ANNEAL_ROUNDS; ++round) {
+            if (job && job->IsCancelled()) return false;
+            snapCol = m_col;
+            snapRow = m_row;
+
+            //  4 Уִ
+            unsigned count = (unsigned)std::max(1, std::min((int)m_threads, m_columns / 4));
+            int width = (m_columns + count - 1) / count;
+            int offset = (round % 2) ? width / 2 : 0;
+            std::vector<Stripe> stripes;
+            for (int begin = -offset; begin < m_columns; begin += width) {
+                Stripe s;
+                s.begin = std::max(0, begin);
+                s.end = std::min(m_columns, begin + width);
+                if (s.begin < s.end) stripes.push_back(s);
+            }
+            std::vector<int> stripeOf(m_columns);
+            for (size_t s = 0; s < stripes.size(); ++s) {
+                for (int c = stripes[s].begin; c < stripes[s].end; ++c) stripeOf[c] = (int)s;
+            }
+            for (size_t g = 0; g < n; ++g) stripes[stripeOf[m_col[g]]].gates.push_back((int)g);
+
+            // ƶ¶С
+            double progress = (double)round / ANNEAL_ROUNDS;
+            int window = std::max(1, (int)(std::max(m_columns, m_rows) * 0.25 * (1 - progress)));
+            std::vector<std::thread> pool;
+            for (size_t s = 0; s < stripes.size(); ++s) {
+                pool.emplace_back([&, s]() {
+                    AnnealStripe(stripes[s], stripeOf, (int)s, snapCol, snapRow, temperature, window,
+                        (unsigned)(round * 7919 + s * 104729 + 1));
+                });
+            }
+            for (auto& th : pool) th.join();
+            temperature *= cooling;
+            if (job) job->ReportProgress(0.3 + 0.7 * (round + 1) / ANNEAL_ROUNDS);
+        }
+        return true;
+    }
+
+    // ڱĸֿ̣߳ʼʱڵжϣ̵߳ŶʵʱλãŶ
+    int EdgeCost(const LayoutEdge& e, const std::vector<int>& snapCol, const std::vector<int>& snapRow,
+        const std::vector<int>* stripeOf, int stripe) const {
+        auto pos = [&](int g, int& x, int& y) {
+            bool own = !stripeOf || (*stripeOf)[snapCol[g]] == stripe;
+            x = (own ? m_col[g] : snapCol[g]) * m_pitchX;
+            y = (own ? m_row[g] : snapRow[g]) * m_pitchY;
+        };
+        int ax, ay, bx, by;
+        pos(e.from, ax, ay);
+        pos(e.to, bx, by);
+        int dx = (bx + e.toPin.x) - (ax + e.fromPin.x);
+        int dy = (by + e.toPin.y) - (ay + e.fromPin.y);
+        return std::abs(dx) + std::abs(dy) + (dx < 0 ? -dx * BACKWARD_PENALTY : 0);
+    }
+
+    void AnnealStripe(Stripe& stripe, const std::vector<int>& stripeOf, int s, const std::vector<int>& snapCol,
+        const std::vector<int>& snapRow, double temperature, int window, unsigned seed) {
+        if (stripe.gates.empty()) return;
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        auto cost = [&](int g, int h) {
+            long long total = 0;
+            for (int e : m_incident[g]) total += EdgeCost(m_edges[e], snapCol, snapRow, &stripeOf, s);
+            if (h >= 0) {
+                for (int e : m_incident[h]) total += EdgeCost(m_edges[e], snapCol, snapRow, &stripeOf, s);
+            }
+            return total;
+        };
+        auto place = [&](int g, int value) {
+            for (int k = 0; k < m_span[g]; ++k) m_occupied[(size_t)m_col[g] * m_rows + m_row[g] + k] = value;
+        };
+
+        size_t moves = stripe.gates.size() * 4;
+        for (size_t m = 0; m < moves; ++m) {
+            int g = stripe.gates[rng() % stripe.gates.size()];
+            int col = m_col[g] + (int)(rng() % (2 * window + 1)) - window;
+            int row = m_row[g] + (int)(rng() % (2 * window + 1)) - window;
+            col = std::max(stripe.begin, std::min(stripe.end - 1, col));
+            row = std::max(0, std::min(m_rows - m_span[g], row));
+            if (col == m_col[g] && row == m_row[g]) continue;
+
+            // Ŀλƶͬ߶ȡռ򽻻
+            int other = -1;
+            bool blocked = false;
+            for (int k = 0; k < m_span[g] && !blocked; ++k) {
+                int h = m_occupied[(size_t)col * m_rows + row + k];
+                if (h < 0 || h == g) continue;
+                if (other < 0) other = h;
+                else if (h != other) blocked = true;
+            }
+            if (blocked) continue;
+            if (other >= 0 && (m_span[other] != m_span[g] || m_row[other] != row)) continue;
+            if (other >= 0 && col == m_col[g] && std::abs(row - m_row[g]) < m_span[g]) continue;
+
+            long long before = cost(g, other);
+            int oldCol = m_col[g], oldRow = m_row[g];
+            place(g, -1);
+            if (other >= 0) place(other, -1);
+            m_col[g] = col;
+            m_row[g] = row;
+            if (other >= 0) {
+                m_col[other] = oldCol;
+                m_row[other] = oldRow;
+            }
+            long long delta = cost(g, other) - before;
+            if (delta <= 0 || uniform(rng) < std::exp(-delta / temperature)) {
+                if (other >= 0) place(other, other);
+                place(g, g);
+            }
+            else {
+                if (other >= 0) {
+                    m_col[other] = col;
+                    m_row[other] = row;
+                }
+                m_col[g] = oldCol;
+                m_row[g] = oldRow;
+                if (other >= 0) place(other, other);
+                place(g, g);
+            }
+        }
+    }
+};
+
+// ===== Զ =====
+// ÿ磨һźţϵĺƽֱߡ
+// ÿ¼ǷŵķڣλͼĸԤ/ĸռá
+// ֻڶ˵㴦Բͬڸֱǽ棬ͬһ䡢ֲصߡ
+// Ȱ簴ڻصÿڶ߳ϲ A*ͨٴ󴰿ԣ
+// Ȼͨʱ·磨ززӱΪŵŵֱߡ
+struct RouteNet {
+    wxPoint source;               // 
+    std::vector<wxPoint> sinks;   // 
+};
+
+struct RouteResult {
+    std::vector<Wire> wires;
+    size_t routed = 0;            // ͨ
+    size_t failed = 0;            // Ϊֱߵ
+    long long length = 0;
+    int bends = 0;
+    int ripups = 0;
+};
+
+class WireRouter {
+public:
+    // obstacles ŵķfreePins ûӵţ߲ܾ
+    WireRouter(const std::vector<wxRect>& obstacles, const std::vector<RouteNet>& nets, const std::vector<wxPoint>& freePins, int gridSize)
+        : m_nets(nets) {
+        // Ҫ룬ڸϲͬĶ˵ᱻ
+        m_pitch = std::max(1, gridSize);
+        while (m_pitch <= PIN_TOLERANCE) m_pitch += std::max(1, gridSize);
+        m_threads = std::max(1u, std::thread::hardware_concurrency());
+
+        wxRect area;
+        bool first = true;
+        auto extend = [&](const wxRect& r) {
+            if (first) area = r;
+            else area.Union(r);
+            first = false;
+        };
+        for (auto& r : obstacles) extend(r);
+        for (auto& net : nets) {
+            extend(wxRect(net.source, wxSize(1, 1)));
+            for (auto& p : net.sinks) extend(wxRect(p, wxSize(1, 1)));
+        }
+        for (auto& p : freePins) extend(wxRect(p, wxSize(1, 1)));
+        m_x0 = (FloorDiv(area.x, m_pitch) - BORDER) * m_pitch;
+        m_y0 = (FloorDiv(area.y, m_pitch) - BORDER) * m_pitch;
+        m_w = FloorDiv(area.x + area.width - m_x0, m_pitch) + BORDER + 1;
+        m_h = FloorDiv(area.y + area.height - m_y0, m_pitch) + BORDER + 1;
+        size_t cells = (size_t)m_w * m_h;
+        m_blocked.assign((cells + 63) / 64, 0);
+        m_reserved.assign(cells, FREE);
+        m_hOwner.assign(cells, FREE);
+        m_vOwner.assign(cells, FREE);
+
+        // ŵķ򣨺߽磩
+        for (auto& r : obstacles) {
+            int x0 = std::max(0, CeilDiv(r.x - m_x0, m_pitch)), x1 = std::min(m_w - 1, FloorDiv(r.x + r.width - m_x0, m_pitch));
+            int y0 = std::max(0, CeilDiv(r.y - m_y0, m_pitch)), y1 = std::min(m_h - 1, FloorDiv(r.y + r.height - m_y0, m_pitch));
+            for (int y = y0; y <= y1; ++y) {
+                for (int x = x0; x <= x1; ++x) SetBlocked(Index(x, y), true);
+            }
+        }
+
+        // ŸڵĸԤ磬õĸ˭
+        m_state.resize(nets.size());
+        for (size_t n = 0; n < nets.size(); ++n) {
+            NetState& st = m_state[n];
+            st.pins.push_back(nets[n].source);
+            st.access.push_back(AccessNode(nets[n].source, true));
+            for (auto& p : nets[n].sinks) {
+                st.pins.push_back(p);
+                st.access.push_back(AccessNode(p, false));
+            }
+            st.sinkDone.assign(nets[n].sinks.size(), 0);
+            for (size_t k = 0; k < st.pins.size(); ++k) {
+                Reserve(st.pins[k], (int)n);
+                Reserve(StubCorner(st.pins[k], st.access[k]), (int)n);
+                Reserve(NodePoint(st.access[k]), (int)n);
+            }
+        }
+        for (auto& p : freePins) Reserve(p, CONFLICT);
+        for (auto& st : m_state) {
+            for (int a : st.access) SetBlocked(a, false);
+        }
+        for (size_t i = 0; i < cells; ++i) {
+            if (m_reserved[i] != FREE) m_hOwner[i] = m_vOwner[i] = m_reserved[i];
+        }
+    }
+
+    // ȡʱ false
+    bool Run(BackgroundJob* job, RouteResult& result) {
+        std::vector<Search> searches(m_threads);
+
+        // һ׶Σڻصһڲ
+        std::vector<int> order, serial;
+        for (size_t n = 0; n < m_nets.size(); ++n) {
+            if (m_nets[n].sinks.empty()) continue;
+            m_state[n].window = NetWindow((int)n, WINDOW_MARGIN);
+            order.push_back((int)n);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return Area(m_state[a].window) < Area(m_state[b].window);
+        });
+        int tilesW = (m_w + TILE - 1) / TILE, tilesH = (m_h + TILE - 1) / TILE;
+        std::vector<int> tileWave((size_t)tilesW * tilesH, -1);
+        std::vector<int> remaining;
+        for (int n : order) {
+            if (Area(TileRect(m_state[n].window)) * 4 > (long long)tilesW * tilesH) serial.push_back(n);
+            else remaining.push_back(n);
+        }
+        size_t total = remaining.size(), finished = 0;
+        std::vector<int> wave, next;
+        for (int waveId = 0; !remaining.empty(); ++waveId) {
+            if (job && job->IsCancelled()) return false;
+            wave.clear();
+            next.clear();
+            for (int n : remaining) {
+                Rect t = TileRect(m_state[n].window);
+                bool free = true;
+                for (int y = t.y0; y <= t.y1 && free; ++y) {
+                    for (int x = t.x0; x <= t.x1 && free; ++x) free = tileWave[(size_t)y * tilesW + x] != waveId;
+                }
+                if (!free) {
+                    next.push_back(n);
+                    continue;
+                }
+                for (int y = t.y0; y <= t.y1; ++y) {
+                    for (int x = t.x0; x <= t.x1; ++x) tileWave[(size_t)y * tilesW + x] = waveId;
+                }
+                wave.push_back(n);
+            }
+            std::atomic<size_t> cursor(0);
+            auto worker = [&](Search* search) {
+                for (size_t i; (i = cursor++) < wave.size();) RouteSinks(wave[i], m_state[wave[i]].window, *search, false);
+            };
+            unsigned threads = (unsigned)std::min<size_t>(m_threads, wave.size());
+            if (threads <= 1) worker(&searches[0]);
+            else {
+                std::vector<std::thread> pool;
+                for (unsigned t = 0; t < threads; ++t) pool.emplace_back(worker, &searches[t]);
+                for (auto& th : pool) th.join();
+            }
+            for (int n : wave) {
+                if (!m_state[n].Complete()) serial.push_back(n);
+            }
+            finished += wave.size();
+            if (job) job->ReportProgress(0.8 * finished / std::max<size_t>(1, total));
+            remaining.swap(next);
+        }
+
+        // ڶ׶ΣУ󴰿ڲز
+        std::deque<int> queue(serial.begin(), serial.end());
+        size_t processed = 0;
+        while (!queue.empty()) {
+            if (job && job->IsCancelled()) return false;
+            int n = queue.front();
+            queue.pop_front();
+            RouteSinks(n, NetWindow(n, WINDOW_MARGIN * 2), searches[0], true, &queue, &result.ripups);
+            if (job) job->ReportProgress(0.8 + 0.2 * std::min(1.0, (double)++processed / std::max<size_t>(1, serial.size() * 2)));
+        }
+
+        EmitWires(result);
+        return true;
+    }
+
+private:
+    enum { FREE = -1, CONFLICT = -2 };  // CONFLICT磨δӵţã˭
+    static const int BORDER = 4;       // ·߸
+    static const int WINDOW_MARGIN = 8;
+    static const int TILE = 16;        // ʱ TILE x TILE ĿжϴǷص
+    static const int BEND_COST = 4;
+    static const int CROSS_COST = 6;
+    static const int RIPUP_COST = 30;
+    static const int MAX_RIPUPS = 3;         // ÿ౻𼸴Σȫϼ  
+    static const int SEARCH_BUDGET = 4000;
+
+    enum { RIGHT, LEFT, DOWN, UP, NONE };
+    static bool Horizontal(int dir) { return dir == RIGHT || dir == LEFT; }
+
+    struct Rect { int x0, y0, x1, y1; };
+
+    struct NetState {
+        std::vector<wxPoint> pins;        // 0 ΪţΪ
+        std::vector<int> access;          // ÿŽĸ
+        std::vector<char> sinkDone;
+        std::vector<int> tree;            // Ѳߵĸ
+        std::vector<std::pair<int, int>> edges;
+        Rect window;
+        int ripups = 0;
+        bool Complete() const { return std::find(sinkDone.begin(), sinkDone.end(), 0) == sinkDone.end(); }
+    };
+
+    // ÿ߳һݵ A* ִκжϸǷѷʣҪ
+    struct Search {
+        std::vector<int> cost, parent;
+        std::vector<unsigned> stamp;
+        std::vector<unsigned char> dir;
+        unsigned epoch = 0;
+        std::vector<std::pair<int, int>> heap;
+    };
+
+    std::vector<RouteNet> m_nets;
+    std::vector<NetState> m_state;
+    unsigned m_threads;
+    int m_pitch, m_x0, m_y0, m_w, m_h;
+    std::vector<uint64_t> m_blocked;
+    std::vector<int> m_reserved, m_hOwner, m_vOwner;
+
+    static int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+    static int CeilDiv(int a, int b) { return -FloorDiv(-a, b); }
+    static long long Area(const Rect& r) { return (long long)(r.x1 - r.x0 + 1) * (r.y1 - r.y0 + 1); }
+
+    int Index(int x, int y) const { return y * m_w + x; }
+    bool IsBlocked(int i) const { return (m_blocked[i >> 6] >> (i & 63)) & 1; }
+    void SetBlocked(int i, bool value) {
+        if (value) m_blocked[i >> 6] |= 1ull << (i & 63);
+        else m_blocked[i >> 6] &= ~(1ull << (i & 63));
+    }
+    wxPoint NodePoint(int i) const { return wxPoint(m_x0 + (i % m_w) * m_pitch, m_y0 + (i / m_w) * m_pitch); }
+
+    // ҡĸУȡһ
+    int AccessNode(const wxPoint& pin, bool output) const {
+        int x = output ? CeilDiv(pin.x - m_x0, m_pitch) : FloorDiv(pin.x - m_x0, m_pitch);
+        int y = FloorDiv(pin.y - m_y0 + m_pitch / 2, m_pitch);
+        return Index(std::max(0, std::min(m_w - 1, x)), std::max(0, std::min(m_h - 1, y)));
+    }
+
+    // ŵȺ
+    wxPoint StubCorner(const wxPoint& pin, int access) const { return wxPoint(NodePoint(access).x, pin.y); }
+
+    void Reserve(const wxPoint& p, int net) {
+        int x0 = std::max(0, CeilDiv(p.x - PIN_TOLERANCE - m_x0, m_pitch)), x1 = std::min(m_w - 1, FloorDiv(p.x + PIN_TOLERANCE - m_x0, m_pitch));
+        int y0 = std::max(0, CeilDiv(p.y - PIN_TOLERANCE - m_y0, m_pitch)), y1 = std::min(m_h - 1, FloorDiv(p.y + PIN_TOLERANCE - m_y0, m_pitch));
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                int& r = m_reserved[Index(x, y)];
+                if (r == FREE || r == net) r = net;
+                else r = CONFLICT;
+            }
+        }
+    }
+
+    Rect NetWindow(int n, int margin) const {
+        Rect r = { m_w, m_h, -1, -1 };
+        for (int a : m_state[n].access) {
+            int x = a % m_w, y = a / m_w;
+            r.x0 = std::min(r.x0, x); r.x1 = std::max(r.x1, x);
+            r.y0 = std::min(r.y0, y); r.y1 = std::max(r.y1, y);
+        }
+        r.x0 = std::max(0, r.x0 - margin); r.x1 = std::min(m_w - 1, r.x1 + margin);
+        r.y0 = std::max(0, r.y0 - margin); r.y1 = std::min(m_h - 1, r.y1 + margin);
+        return r;
+    }
+
+    Rect TileRect(const Rect& r) const { return Rect{ r.x0 / TILE, r.y0 / TILE, r.x1 / TILE, r.y1 / TILE }; }
+
+    // ռѲ磨ԤԱ
+    bool IsRipupable(int i, int owner, int net) const {
+        return owner >= 0 && owner != net && m_reserved[i] == FREE && m_state[owner].ripups < MAX_RIPUPS;
+    }
+
+    // βδɵţŽȲȫͨʱ true
+    // ripup Ϊ true ʱߣŻض
+    bool RouteSinks(int n, const Rect& window, Search& search, bool ripup, std::deque<int>* queue = nullptr, int* ripups = nullptr) {
+        NetState& st = m_state[n];
+        std::vector<int> pending;
+        for (size_t k = 0; k < st.sinkDone.size(); ++k) {
+            if (!st.sinkDone[k]) pending.push_back((int)k);
+        }
+        wxPoint src = st.pins[0];
+        std::sort(pending.begin(), pending.end(), [&](int a, int b) {
+            wxPoint pa = st.pins[a + 1], pb = st.pins[b + 1];
+            return std::abs(pa.x - src.x) + std::abs(pa.y - src.y) < std::abs(pb.x - src.x) + std::abs(pb.y - src.y);
+        });
+        std::vector<int> path;
+        bool all = true;
+        for (int k : pending) {
+            int target = st.access[k + 1];
+            if (!IsOpen(n, st.access[0]) || !IsOpen(n, target)) {
+                all = false;
+                continue;
+            }
+            bool ok = FindPath(n, target, window, search, false, path);
+            if (!ok && ripup && *ripups < (int)m_nets.size()) {
+                if (FindPath(n, target, window, search, true, path)) {
+                    RipUpAlong(n, path, *queue);
+                    ++*ripups;
+                    ok = FindPath(n, target, window, search, false, path);
+                }
+            }
+            if (!ok) {
+                all = false;
+                continue;
+            }
+            Commit(n, path);
+            st.sinkDone[k] = 1;
+        }
+        return all;
+    }
+
+    // 㱻û߲ܶͨʱֱӷ
+    bool IsOpen(int n, int i) const {
+        if (m_reserved[i] != n) return false;
+        int x = i % m_w, y = i / m_w;
+        const int nb[4] = { x > 0 ? i - 1 : -1, x + 1 < m_w ? i + 1 : -1, y > 0 ? i - m_w : -1, y + 1 < m_h ? i + m_w : -1 };
+        for (int v : nb) {
+            if (v >= 0 && !IsBlocked(v) && (m_reserved[v] == FREE || m_reserved[v] == n)) return true;
+        }
+        return false;
+    }
+
+    bool FindPath(int n, int target, const Rect& win, Search& s, bool ripup, std::vector<int>& path) {
+        NetState& st = m_state[n];
+        int ww = win.x1 - win.x0 + 1, wh = win.y1 - win.y0 + 1;
+        size_t size = (size_t)ww * wh;
+        if (s.cost.size() < size) {
+            s.cost.resize(size);
+            s.parent.resize(size);
+            s.stamp.assign(size, 0);
+            s.dir.resize(size);
+            s.epoch = 0;
+        }
+        if (++s.epoch == 0) {
+            std::fill(s.stamp.begin(), s.stamp.end(), 0);
+            s.epoch = 1;
+        }
+        auto local = [&](int i) { return (i / m_w - win.y0) * ww + (i % m_w - win.x0); };
+        auto inside = [&](int i) {
+            int x = i % m_w, y = i / m_w;
+            return x >= win.x0 && x <= win.x1 && y >= win.y0 && y <= win.y1;
+        };
+        int tx = target % m_w, ty = target / m_w;
+        auto heuristic = [&](int i) {
+            int dx = std::abs(i % m_w - tx), dy = std::abs(i / m_w - ty);
+            return dx + dy + (dx && dy ? BEND_COST : 0);
+        };
+        auto greater = [](const std::pair<int, int>& a, const std::pair<int, int>& b) { return a.first > b.first; };
+        s.heap.clear();
+        auto push = [&](int i, int cost, int parent, int dir) {
+            int l = local(i);
+            if (s.stamp[l] == s.epoch && s.cost[l] <= cost) return;
+            s.stamp[l] = s.epoch;
+            s.cost[l] = cost;
+            s.parent[l] = parent;
+            s.dir[l] = (unsigned char)dir;
+            s.heap.push_back(std::make_pair(cost + heuristic(i), i));
+            std::push_heap(s.heap.begin(), s.heap.end(), greater);
+        };
+        if (st.tree.empty()) {
+            if (inside(st.access[0])) push(st.access[0], 0, -1, NONE);
+        }
+        else {
+            for (int i : st.tree) {
+                if (inside(i)) push(i, 0, -1, NONE);
+            }
+        }
+
+        // ĳϵռãԼпߣڲģʽ¼Ӵۣ಻
+        auto axisCost = [&](int i, bool horizontal, int& extra) {
+            int owner = horizontal ? m_hOwner[i] : m_vOwner[i];
+            if (owner == FREE || owner == n) return true;
+            if (ripup && IsRipupable(i, owner, n)) {
+                extra += RIPUP_COST;
+                return true;
+            }
+            return false;
+        };
+        static const int DX[4] = { 1, -1, 0, 0 }, DY[4] = { 0, 0, 1, -1 };
+        // ӵﲼͨӻѱڣչĸ
+        long long budget = SEARCH_BUDGET + 8LL * (std::abs(st.access[0] % m_w - tx) + std::abs(st.access[0] / m_w - ty));
+        while (!s.heap.empty() && budget-- > 0) {
+            std::pop_heap(s.heap.begin(), s.heap.end(), greater);
+            int u = s.heap.back().second, f = s.heap.back().first;
+            s.heap.pop_back();
+            int lu = local(u);
+            if (f != s.cost[lu] + heuristic(u)) continue;
+            if (u == target) {
+                path.clear();
+                for (int i = u; i >= 0; i = s.parent[local(i)]) path.push_back(i);
+                std::reverse(path.begin(), path.end());
+                return true;
+            }
+            int du = s.dir[lu], ux = u % m_w, uy = u / m_w;
+            for (int d = 0; d < 4; ++d) {
+                if (du != NONE && (d ^ 1) == du) continue;
+                int vx = ux + DX[d], vy = uy + DY[d];
+                if (vx < win.x0 || vx > win.x1 || vy < win.y0 || vy > win.y1) continue;
+                int v = Index(vx, vy);
+                if (IsBlocked(v)) continue;
+                if (m_reserved[v] != FREE && m_reserved[v] != n) continue;
+                bool h = Horizontal(d);
+                int extra = 0;
+                if (!axisCost(u, h, extra) || !axisCost(v, h, extra)) continue;
+                if (du != NONE && d != du) extra += BEND_COST;
+                // ֱǽ
+                int cross = h ? m_vOwner[v] : m_hOwner[v];
+                if (cross != FREE && cross != n) extra += CROSS_COST;
+                push(v, s.cost[lu] + 1 + extra, u, d);
+            }
+        }
+        return false;
+    }
+
+    // ·һ뿪Ѳֵ߲ĸ㿪ʼƻԼγɻ
+    void Commit(int n, std::vector<int>& path) {
+        NetState& st = m_state[n];
+        if (!st.tree.empty()) {
+            std::vector<int> tree(st.tree);
+            std::sort(tree.begin(), tree.end());
+            size_t start = 0;
+            for (size_t k = 0; k < path.size(); ++k) {
+                if (std::binary_search(tree.begin(), tree.end(), path[k])) start = k;
+            }
+            path.erase(path.begin(), path.begin() + start);
+        }
+        if (st.tree.empty() && !path.empty()) st.tree.push_back(path[0]);
+        for (size_t k = 1; k < path.size(); ++k) {
+            int a = path[k - 1], b = path[k];
+            bool h = std::abs(a - b) == 1;
+            (h ? m_hOwner : m_vOwner)[a] = n;
+            (h ? m_hOwner : m_vOwner)[b] = n;
+            st.edges.push_back(std::make_pair(a, b));
+            st.tree.push_back(b);
+        }
+    }
+
+    // ·ͻ磺·ڸϹʱռãֱʱֻн
+    void RipUpAlong(int n, const std::vector<int>& path, std::deque<int>& queue) {
+        std::vector<int> victims;
+        for (size_t k = 0; k < path.size(); ++k) {
+            int i = path[k];
+            bool h = false, v = false;
+            if (k > 0) (std::abs(path[k - 1] - i) == 1 ? h : v) = true;
+            if (k + 1 < path.size()) (std::abs(path[k + 1] - i) == 1 ? h : v) = true;
+            if (h && IsRipupable(i, m_hOwner[i], n)) victims.push_back(m_hOwner[i]);
+            if (v && IsRipupable(i, m_vOwner[i], n)) victims.push_back(m_vOwner[i]);
+        }
+        std::sort(victims.begin(), victims.end());
+        victims.erase(std::unique(victims.begin(), victims.end()), victims.end());
+        for (int m : victims) {
+            NetState& st = m_state[m];
+            for (auto& e : st.edges) {
+                for (int i : { e.first, e.second }) {
+                    if (m_reserved[i] != FREE) continue;
+                    if (m_hOwner[i] == m) m_hOwner[i] = FREE;
+                    if (m_vOwner[i] == m) m_vOwner[i] = FREE;
+                }
+            }
+            st.edges.clear();
+            st.tree.clear();
+            std::fill(st.sinkDone.begin(), st.sinkDone.end(), 0);
+            ++st.ripups;
+            queue.push_back(m);
+        }
+    }
+
+    // ĸߺϲߣڷֲŽϿյΪߵĶ
+    void EmitWires(RouteResult& result) {
+        std::unordered_map<int, unsigned char> mask;
+        std::vector<wxPoint> pts;
+        for (size_t n = 0; n < m_state.size(); ++n) {
+            NetState& st = m_state[n];
+            if (st.sinkDone.empty()) continue;
+            mask.clear();
+            for (auto& e : st.edges) {
+                int a = e.first, b = e.second;
+                int d = b == a + 1 ? RIGHT : b == a - 1 ? LEFT : b > a ? DOWN : UP;
+                mask[a] |= 1 << d;
+                mask[b] |= 1 << (d ^ 1);
+            }
+            auto isBreak = [&](int i, unsigned char m) {
+                if (std::find(st.access.begin(), st.access.end(), i) != st.access.end()) return true;
+                int degree = (m & 1) + ((m >> 1) & 1) + ((m >> 2) & 1) + ((m >> 3) & 1);
+                return degree != 2;
+            };
+            for (auto& entry : mask) {
+                int a = entry.first;
+                if (!isBreak(a, entry.second)) continue;
+                for (int d = 0; d < 4; ++d) {
+                    if (!(entry.second & (1 << d))) continue;
+                    pts.assign(1, NodePoint(a));
+                    int b = a, dir = d, bends = 0;
+                    while (true) {
+                        b += dir == RIGHT ? 1 : dir == LEFT ? -1 : dir == DOWN ? m_w : -m_w;
+                        unsigned char m = mask.find(b)->second;
+                        if (isBreak(b, m)) break;
+                        int out = 0;
+                        while (out == (dir ^ 1) || !(m & (1 << out))) ++out;
+                        if (out != dir) {
+                            pts.push_back(NodePoint(b));
+                            ++bends;
+                        }
+                        dir = out;
+                    }
+                    if (a > b) continue;
+                    pts.push_back(NodePoint(b));
+                    for (size_t k = 1; k < pts.size(); ++k) {
+                        result.length += std::abs(pts[k].x - pts[k - 1].x) + std::abs(pts[k].y - pts[k - 1].y);
+                    }
+                    result.bends += bends;
+                    result.wires.push_back(Wire(std::move(pts)));
+                }
+            }
+
+            // ŵĶߣͨŵŵֱ
+            bool anyDone = false;
+            for (size_t k = 0; k < st.sinkDone.size(); ++k) {
+                if (st.sinkDone[k]) {
+                    ++result.routed;
+                    anyDone = true;
+                    EmitStub(st.pins[k + 1], st.access[k + 1], result);
+                }
+                else {
+                    ++result.failed;
+                    result.wires.push_back(Wire(st.pins[0], st.pins[k + 1]));
+                }
+            }
+            if (anyDone) EmitStub(st.pins[0], st.access[0], result);
+        }
+    }
+
+    void EmitStub(const wxPoint& pin, int access, RouteResult& result) {
+        std::vector<wxPoint> pts(1, pin);
+        for (const wxPoint& p : { StubCorner(pin, access), NodePoint(access) }) {
+            if (p != pts.back()) pts.push_back(p);
+        }
+        if (pts.size() > 1) result.wires.push_back(Wire(std::move(pts)));
+    }
+};
+
+// ===== ߶ =====
+// ߵÿ߶εǼǵĸʰȡʱֻλΧ߶Σ
+// ߲Ҫ롣
+bool IsPointNearSegment(const wxPoint& p, const wxPoint& a, const wxPoint& b, int tolerance) {
+    // ߶γȵƽ
+    double length2 = (double)(b.x - a.x) * (b.x - a.x) + (double)(b.y - a.y) * (b.y - a.y);
+    if (length2 == 0) {
+        // ߶˻Ϊ
+        return (p.x - a.x) * (p.x - a.x) + (p.y - a.y) * (p.y - a.y) <= tolerance * tolerance;
+    }
+
+    // ͶӰͶӰ
+    double t = std::max(0.0, std::min(1.0,
+        ((double)(p.x - a.x) * (b.x - a.x) + (double)(p.y - a.y) * (b.y - a.y)) / length2));
+    double px = a.x + t * (b.x - a.x), py = a.y + t * (b.y - a.y);
+    return (p.x - px) * (p.x - px) + (p.y - py) * (p.y - py) <= tolerance * tolerance;
+}
+
+class WireSegmentIndex {
+public:
+    // ߱滻ɾźã´βѯʱؽ
+    void Invalidate() { m_valid = false; }
+
+    bool IsBuiltFor(size_t wireCount) const { return m_valid && m_wireCount == wireCount; }
+
+    void Build(const std::vector<Wire>& wires) {
+        m_cells.clear();
+        m_wireCount = 0;
+        for (size_t i = 0; i < wires.size(); ++i) Add((int)i, wires[i]);
+        m_valid = true;
+    }
+
+    // ĩβ׷һ
+    void Add(int wire, const Wire& w) {
+        for (size_t k = 1; k < w.points.size(); ++k) InsertSegment(w.points[k - 1], w.points[k], Entry{ wire, (int)k - 1 });
+        m_wireCount = std::max(m_wireCount, (size_t)wire + 1);
+    }
+
+    // ĩβ׷ߣûнʱ´βѯ幹
+    void AddRange(const std::vector<Wire>& wires, size_t first) {
+        if (!IsBuiltFor(first)) {
+            m_valid = false;
+            return;
+        }
+        for (size_t i = first; i < wires.size(); ++i) Add((int)i, wires[i]);
+    }
+
+    // еߣ󻭵棩ûʱ -1tolerance ҪСڸӵһ
+    int HitTest(const std::vector<Wire>& wires, const wxPoint& p, int tolerance) const {
+        int hit = -1;
+        int cx = FloorDiv(p.x, CELL), cy = FloorDiv(p.y, CELL);
+        for (int dx = -1; dx <= 1; ++dx) {
+            for (int dy = -1; dy <= 1; ++dy) {
+                auto it = m_cells.find(CellKey(cx + dx, cy + dy));
+                if (it == m_cells.end()) continue;
+                for (const Entry& e : it->second) {
+                    if (e.wire <= hit || e.wire >= (int)wires.size()) continue;
+                    const std::vector<wxPoint>& pts = wires[e.wire].points;
+                    if (e.segment + 1 < (int)pts.size() && IsPointNearSegment(p, pts[e.segment], pts[e.segment + 1], tolerance)) hit = e.wire;
+                }
+            }
+        }
+        return hit;
+    }
+
+private:
+    static const int CELL = 64;
+
+    struct Entry {
+        int wire;
+        int segment;
+    };
+
+    std::unordered_map<long long, std::vector<Entry>> m_cells;
+    size_t m_wireCount = 0;
+    bool m_valid = false;
+
+    static int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+    static long long CellKey(int x, int y) { return ((long long)x << 32) ^ (unsigned int)y; }
+
+    // ߶εǼǾÿӣб߰񲽳ѯʱΧ 3x3 ӣ©
+    void InsertSegment(const wxPoint& a, const wxPoint& b, const Entry& e) {
+        int ax = FloorDiv(a.x, CELL), ay = FloorDiv(a.y, CELL), bx = FloorDiv(b.x, CELL), by = FloorDiv(b.y, CELL);
+        if (ax == bx || ay == by) {
+            for (int x = std::min(ax, bx); x <= std::max(ax, bx); ++x) {
+                for (int y = std::min(ay, by); y <= std::max(ay, by); ++y) m_cells[CellKey(x, y)].push_back(e);
+            }
+            return;
+        }
+        double length = std::sqrt((double)(b.x - a.x) * (b.x - a.x) + (double)(b.y - a.y) * (b.y - a.y));
+        int steps = (int)(length / (CELL / 2)) + 1;
+        long long last = 0;
+        for (int s = 0; s <= steps; ++s) {
+            double t = (double)s / steps;
+            long long key = CellKey(FloorDiv((int)std::lround(a.x + t * (b.x - a.x)), CELL), FloorDiv((int)std::lround(a.y + t * (b.y - a.y)), CELL));
+            if (s > 0 && key == last) continue;
+            m_cells[key].push_back(e);
+            last = key;
+        }
+    }
+};
+
+// ===== λѡ =====
+// ŵķ򰴸ӵǼǣڵѡѡͲŸţűƶɾźؽ
+class GateGridIndex {
+public:
+    void Invalidate() { m_valid = false; }
+
+    bool IsBuiltFor(size_t gateCount) const { return m_valid && m_boxes.size() == gateCount; }
+
+    void Build(std::vector<wxRect>&& boxes) {
+        m_cells.clear();
+        m_boxes = std::move(boxes);
+        for (size_t i = 0; i < m_boxes.size(); ++i) Insert((int)i);
+        m_valid = true;
+    }
+
+    // ĩβ׷һ
+    void Add(const wxRect& box) {
+        m_boxes.push_back(box);
+        Insert((int)m_boxes.size() - 1);
+    }
+
+    // õţ󻭵棩ûʱ -1
+    int HitTest(const wxPoint& p) const {
+        auto it = m_cells.find(CellKey(FloorDiv(p.x, CELL), FloorDiv(p.y, CELL)));
+        if (it == m_cells.end()) return -1;
+        int hit = -1;
+        for (int g : it->second) {
+            if (g > hit && m_boxes[g].Contains(p)) hit = g;
+        }
+        return hit;
+    }
+
+    // Է area ཻÿŵһ fn򸲸ǵĸӱŻʱֱɨȫ
+    template <class Fn>
+    void Query(const wxRect& area, Fn fn) const {
+        int x0 = FloorDiv(area.x, CELL), y0 = FloorDiv(area.y, CELL);
+        int x1 = FloorDiv(area.x + area.width - 1, CELL), y1 = FloorDiv(area.y + area.height - 1, CELL);
+        if ((long long)(x1 - x0 + 1) * (y1 - y0 + 1) > (long long)m_boxes.size()) {
+            for (size_t g = 0; g < m_boxes.size(); ++g) {
+                if (m_boxes[g].Intersects(area)) fn((int)g);
+            }
+            return;
+        }
+        for (int x = x0; x <= x1; ++x) {
+            for (int y = y0; y <= y1; ++y) {
+                auto it = m_cells.find(CellKey(x, y));
+                if (it == m_cells.end()) continue;
+                for (int g : it->second) {
+                    const wxRect& box = m_boxes[g];
+                    if (!box.Intersects(area)) continue;
+                    // ӵֻڽϽڵĸӱ
+                    if (FloorDiv(std::max(box.x, area.x), CELL) == x && FloorDiv(std::max(box.y, area.y), CELL) == y) fn(g);
+                }
+            }
+        }
+    }
+
+private:
+    static const int CELL = 128;
+
+    std::unordered_map<long long, std::vector<int>> m_cells;
+    std::vector<wxRect> m_boxes;
+    bool m_valid = false;
+
+    static int FloorDiv(int a, int b) { return a >= 0 ? a / b : -((-a + b - 1) / b); }
+    static long long CellKey(int x, int y) { return ((long long)x << 32) ^ (unsigned int)y; }
+
+    void Insert(int g) {
+        const wxRect& box = m_boxes[g];
+        for (int x = FloorDiv(box.x, CELL); x <= FloorDiv(box.x + box.width - 1, CELL); ++x) {
+            for (int y = FloorDiv(box.y, CELL); y <= FloorDiv(box.y + box.height - 1, CELL); ++y) m_cells[CellKey(x, y)].push_back(g);
+        }
+    }
+};
+
+// ѡеŰżλͼÿһλʱȫ 0 
+class SelectionSet {
+public:
+    void Clear() {
+        m_bits.clear();
+        m_count = 0;
+    }
+
+    bool Empty() const { return m_count == 0; }
+    size_t Count() const { return m_count; }
+
+    bool Test(int i) const {
+        size_t w = (size_t)i >> 6;
+        return w < m_bits.size() && ((m_bits[w] >> (i & 63)) & 1);
+    }
+
+    void Set(int i) {
+        size_t w = (size_t)i >> 6;
+        if (w >= m_bits.size()) m_bits.resize(w + 1, 0);
+        uint64_t bit = 1ULL << (i & 63);
+        if (!(m_bits[w] & bit)) {
+            m_bits[w] |= bit;
+            ++m_count;
+        }
+    }
+
+    void Reset(int i) {
+        size_t w = (size_t)i >> 6;
+        uint64_t bit = 1ULL << (i & 63);
+        if (w < m_bits.size() && (m_bits[w] & bit)) {
+            m_bits[w] &= ~bit;
+            --m_count;
+        }
+    }
+
+    // ѡ [first, last) ڵ
+    void SetRange(int first, int last) {
+        for (int i = first; i < last; ++i) Set(i);
+    }
+
+    template <class Fn>
+    void ForEach(Fn fn) const {
+        for (size_t w = 0; w < m_bits.size(); ++w) {
+            uint64_t bits = m_bits[w];
+            while (bits) {
+                fn((int)(w * 64 + LowestBit(bits)));
+                bits &= bits - 1;
+            }
+        }
+    }
+
+    // Сѡûʱ -1
+    int First() const {
+        for (size_t w = 0; w < m_bits.size(); ++w) {
+            if (m_bits[w]) return (int)(w * 64 + LowestBit(m_bits[w]));
+        }
+        return -1;
+    }
+
+    std::vector<int> ToIndices() const {
+        std::vector<int> indices;
+        indices.reserve(m_count);
+        ForEach([&indices](int i) { indices.push_back(i); });
+        return indices;
+    }
+
+private:
+    std::vector<uint64_t> m_bits;
+    size_t m_count = 0;
+
+    static int LowestBit(uint64_t bits) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, bits);
+        return (int)index;
+#else
+        return __builtin_ctzll(bits);
+#endif
+    }
+};
+
+// ===== ͼ =====
+class MyDrawPanel : public wxPanel {
+public:
+    MyDrawPanel(wxWindow* parent)
+        : wxPanel(parent, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxBORDER_SIMPLE),
+        m_scale(1.0), m_isDrawingWire(false),
+        m_isDraggingGate(false), m_draggedIndex(-1),
+        m_selectedIndex(-1), m_selectedWireIndex(-1), m_isBoxSelecting(false), m_showGrid(true), m_gridSize(20),
+        m_showAnalysis(false), m_showPower(false), m_showProfiler(false)
+    {
+        SetBackgroundStyle(wxBG_STYLE_PAINT);
+        Bind(wxEVT_PAINT, &MyDrawPanel::OnPaint, this);
+        Bind(wxEVT_LEFT_DOWN, &MyDrawPanel::OnMouseDown, this);
+        Bind(wxEVT_LEFT_UP, &MyDrawPanel::OnMouseUp, this);
+        Bind(wxEVT_RIGHT_DOWN, &MyDrawPanel::OnRightClick, this);
+        Bind(wxEVT_MOTION, &MyDrawPanel::OnMouseMove, this);
+        Bind(wxEVT_MIDDLE_DOWN, &MyDrawPanel::OnMiddleDown, this);
+        Bind(wxEVT_MIDDLE_UP, &MyDrawPanel::OnMiddleUp, this);
+        Bind(wxEVT_KEY_DOWN, &MyDrawPanel::OnKeyDown, this);
+
+        if (shapeLibrary.empty()) {
+            LoadShapesFromJson("D:/code/Project1/x64/Debug/shapes4.0.json");
+        }
+
+        SetFocus(); // ȷԽռ¼
+    }
+
+    void AddShape(const wxString& shape) {
+        Gate newGate;
+        newGate.type = shape;
+        newGate.pos = wxPoint(50 + (m_gates.size() % 3) * 150, 50 + (m_gates.size() / 3) * 150);
+
+        // ΪͬĬ
+        SetDefaultProperties(newGate);
+
+        m_gates.Add(newGate);
+        if (m_gateIndex.IsBuiltFor(m_gates.size() - 1)) m_gateIndex.Add(GetGateBBox(newGate));
+        SelectOnly((int)m_gates.size() - 1);
+        m_selectedWireIndex = -1; // ȡѡ
+
+        if (m_showAnalysis) {
+            auto t0 = std::chrono::steady_clock::now();
+            m_analyzer.GateAdded(m_gates, m_selectedIndex);
+            ReportAnalysis(t0);
+        }
+
+        // ֪ͨڱ״̬ڳ
+        wxCommandEvent evt(MY_CUSTOM_EVENT);
+        evt.SetEventObject(this);
+        wxPostEvent(GetParent(), evt);
+
+        Refresh();
+    }
+
+    void RemoveLastShape() {
+        if (!m_gates.empty()) {
+            m_gates.SwapRemove(m_gates.size() - 1);
+            m_gateIndex.Invalidate();
+            SelectOnly(-1);
+            RebuildAnalysis();
+        }
+        Refresh();
+    }
+
+    // ɾѡеԼֻ֮ߣĩβɾֻѡй
+    void DeleteSelected() {
+        if (!m_selection.Empty()) {
+            // ֪ͨڱ״̬ڳ
+            wxCommandEvent evt(MY_CUSTOM_EVENT);
+            evt.SetEventObject(this);
+            wxPostEvent(GetParent(), evt);
+
+            std::vector<int> wires = CollectInternalWires(m_gates, m_wires, m_selection.ToIndices());
+            RemoveGates(m_selection.ToIndices());
+            if (!wires.empty()) {
+                RemoveWires(wires);
+                m_selectedWireIndex = -1;
+            }
+            m_gateIndex.Invalidate();
+            SelectOnly(-1);
+            // ɾŵб仯ֱؽ
+            RebuildAnalysis();
+            Refresh();
+        }
+    }
+
+    void DeleteSelectedWire() {
+        if (m_selectedWireIndex >= 0 && m_selectedWireIndex < (int)m_wires.size()) {
+            // ֪ͨڱ״̬ڳ
+            wxCommandEvent evt(MY_CUSTOM_EVENT);
+            evt.SetEventObject(this);
+            wxPostEvent(GetParent(), evt);
+
+            m_wires.erase(m_wires.begin() + m_selectedWireIndex);
+            m_wireIndex.Invalidate();
+            if (m_journal) m_journal->WiresRemoved({ (size_t)m_selectedWireIndex });
+            if (m_showAnalysis) {
+                auto t0 = std::chrono::steady_clock::now();
+                m_analyzer.WireRemoved(m_selectedWireIndex);
+                ReportAnalysis(t0);
+            }
+            m_selectedWireIndex = -1;
+            Refresh();
+        }
+    }
+
+    // ༭ѡţѡ˶ʱѸĶֵͬдͬԵ
+    void EditSelectedProperties() {
+        if (m_selectedIndex >= 0 && m_selectedIndex < (int)m_gates.size()) {
+            // ֪ͨڱ״̬ڳ
+            wxCommandEvent evt(MY_CUSTOM_EVENT);
+            evt.SetEventObject(this);
+            wxPostEvent(GetParent(), evt);
+
+            Gate gate = m_gates.Get(m_selectedIndex);
+            PropertyDialog dialog(this, gate);
+            if (dialog.ShowModal() == wxID_OK) {
+                std::vector<Property> before = m_gates.Properties(m_selectedIndex);
+                m_gates.Set(m_selectedIndex, gate);
+                if (m_selection.Count() > 1) {
+                    std::vector<const Property*> changed;
+                    for (auto& prop : gate.properties) {
+                        auto it = std::find_if(before.begin(), before.end(), [&prop](const Property& p) { return p.name == prop.name; });
+                        if (it == before.end() || !it->SameValue(prop)) changed.push_back(&prop);
+                    }
+                    m_selection.ForEach([this, &changed](int g) {
+                        if (g == m_selectedIndex) return;
+                        std::vector<Property> props = m_gates.Properties(g);
+                        for (auto& p : props) {
+                            for (const Property* c : changed) {
+                                if (p.name == c->name) p = *c;
+                            }
+                        }
+                        m_gates.SetProperties(g, std::move(props));
+                    });
+                    RebuildAnalysis();
+                }
+                // ֻ㱻༭ŵȳ׶
+                else if (m_showAnalysis) {
+                    auto t0 = std::chrono::steady_clock::now();
+                    m_analyzer.GateMoved(m_gates, m_selectedIndex);
+                    m_analyzer.GateChanged(m_gates, m_selectedIndex);
+                    ReportAnalysis(t0);
+                }
+                Refresh();
+            }
+        }
+    }
+
+    size_t GetSelectionCount() const { return m_selection.Count(); }
+
+    // ѡϵͬԣȷʱͺͳʼֵ
+    const Property* GetPrimaryProperty(int name) const {
+        if (m_selectedIndex < 0 || m_selectedIndex >= (int)m_gates.size()) return nullptr;
+        return FindProperty(m_gates.Properties(m_selectedIndex), name);
+    }
+
+    // ãһαдѡеϣֻؽһ
+    void SetPropertyOnSelection(const Property& prop) {
+        m_selection.ForEach([this, &prop](int g) {
+            std::vector<Property> props = m_gates.Properties(g);
+            SetProperty(props, prop);
+            m_gates.SetProperties(g, std::move(props));
+        });
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    void ClearShapes() {
+        // ֪ͨڱ״̬ڳ
+        wxCommandEvent evt(MY_CUSTOM_EVENT);
         evt.SetEventObject(this);
         wxPostEvent(GetParent(), evt);
 
-        m_gates.clear();
+        m_tiled.reset();
+        m_gates.Clear();
         m_wires.clear();
-        m_selectedIndex = -1;
+        if (m_journal) m_journal->WiresReplaced(m_wires);
+        m_wireIndex.Invalidate();
+        m_gateIndex.Invalidate();
+        SelectOnly(-1);
         m_selectedWireIndex = -1;
+        RebuildAnalysis();
         Refresh();
     }
 
@@ -387,122 +7176,698 @@ public:
 
     bool IsGridVisible() const { return m_showGrid; }
 
+    // ʱһȫ֮ı༭ֻ
+    void ToggleAnalysis() {
+        m_showAnalysis = !m_showAnalysis;
+        if (m_showAnalysis) {
+            RebuildAnalysis();
+        }
+        else {
+            m_analyzer.Invalidate();
+        }
+        Refresh();
+    }
+
+    bool IsAnalysisVisible() const { return m_showAnalysis; }
+
+    // ͼɫʾϵķת
+    void TogglePowerMap() {
+        m_showPower = !m_showPower;
+        if (m_showPower && m_showAnalysis && m_analyzer.IsValid()) UpdatePowerFromAnalyzer();
+        Refresh();
+    }
+
+    bool IsPowerMapVisible() const { return m_showPower; }
+
+    void ToggleProfiler() {
+        m_showProfiler = !m_showProfiler;
+        Refresh();
+    }
+
+    bool IsProfilerVisible() const { return m_showProfiler; }
+
+    // ڷͳƵķתͼʵڲڶ֮
+    // 뵼ʱͬ˵ڼ·޸Ĺ false
+    bool SetSimulatedActivity(const LevelizedNetlist& net, const std::vector<uint64_t>& toggles, size_t cycles) {
+        size_t top = net.instances.empty() ? net.kind.size() : (size_t)net.instances.front().base;
+        if (top != m_gates.size() || toggles.size() != net.kind.size()) return false;
+        EstimatePower(m_gates, net, toggles, cycles, m_power);
+        Refresh();
+        return true;
+    }
+
+    const PowerReport& GetPowerReport() const { return m_power; }
+
+    // ʱӷתһΣ棻Զ߼ʾ
+    void ClockStep() {
+        if (!m_showAnalysis) ToggleAnalysis();
+        auto t0 = std::chrono::steady_clock::now();
+        m_analyzer.ClockEdge();
+        ReportAnalysis(t0);
+        Refresh();
+    }
+
+    // ֲδʱʱһΣ
+    void ExportNetlist(LevelizedNetlist& out) {
+        if (m_showAnalysis && m_analyzer.IsValid()) {
+            m_analyzer.ExportNetlist(m_gates, out);
+        }
+        else {
+            CircuitAnalyzer analyzer;
+            analyzer.Build(m_gates, m_wires);
+            analyzer.ExportNetlist(m_gates, out);
+        }
+    }
+
     // ȡǰ״̬ڳ
     struct DrawPanelState {
-        std::vector<Gate> gates;
+        GateStore gates;
         std::vector<Wire> wires;
         int selectedIndex;
+        SelectionSet selection;
         int selectedWireIndex;
     };
 
     DrawPanelState GetState() const {
+        ScopedTimer timer(ProfileZone::Undo);
         DrawPanelState state;
         state.gates = m_gates;
         state.wires = m_wires;
         state.selectedIndex = m_selectedIndex;
+        state.selection = m_selection;
         state.selectedWireIndex = m_selectedWireIndex;
         return state;
     }
 
     void SetState(const DrawPanelState& state) {
+        m_tiled.reset();
         m_gates = state.gates;
         m_wires = state.wires;
+        if (m_journal) m_journal->WiresReplaced(m_wires);
+        m_wireIndex.Invalidate();
+        m_gateIndex.Invalidate();
         m_selectedIndex = state.selectedIndex;
+        m_selection = state.selection;
         m_selectedWireIndex = state.selectedWireIndex;
+        RebuildAnalysis();
         Refresh();
     }
 
     std::vector<wxString> GetShapes() const {
         std::vector<wxString> names;
-        for (auto& g : m_gates) names.push_back(g.type);
+        for (size_t i = 0; i < m_gates.size(); ++i) names.push_back(m_gates.Type(i));
         return names;
     }
 
     void SetShapes(const std::vector<wxString>& shapes) {
-        m_gates.clear();
+        m_tiled.reset();
+        m_gates.Clear();
         int i = 0;
         for (auto& s : shapes) {
             Gate newGate;
             newGate.type = s;
             newGate.pos = wxPoint(50 + (i % 3) * 150, 50 + (i / 3) * 150);
-            m_gates.push_back(newGate);
+            m_gates.Add(newGate);
             i++;
         }
-        m_selectedIndex = -1;
+        m_gateIndex.Invalidate();
+        SelectOnly(-1);
         m_selectedWireIndex = -1;
+        RebuildAnalysis();
         Refresh();
     }
 
     // ȡżԣڱ棩
     std::vector<Gate> GetGates() const {
+        return m_gates.ToGates();
+    }
+
+    // ֮޸Ķ༭־ŵ޸Ŵ洢ֱ֪ͨ
+    void SetJournal(EditJournal* journal) {
+        m_journal = journal;
+        m_gates.SetListener(journal);
+    }
+
+    // Ŵ洢Ŀգֻü֮󻭲ϵ޸ĲӰ
+    GateStore GetGateSnapshot() const {
         return m_gates;
     }
 
-    // żԣڼأ
-    void SetGates(const std::vector<Gate>& gates) {
-        m_gates = gates;
-        m_selectedIndex = -1;
+    // żԣڼأ
+    void SetGates(const std::vector<Gate>& gates) {
+        m_tiled.reset();
+        m_gates.Assign(gates);
+        m_gateIndex.Invalidate();
+        SelectOnly(-1);
+        m_selectedWireIndex = -1;
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    const std::vector<Wire>& GetWires() const { return m_wires; }
+
+    // ӵ·һţѡеʱȡѡ񼯣ͼΪһ飻ȡ˶ŷΧڵ
+    void CollectGroup(std::vector<int>& members, std::vector<int>& wires) const {
+        members.clear();
+        wires.clear();
+        if (m_gates.empty()) return;
+        if (m_selection.Count() > 1) {
+            members = m_selection.ToIndices();
+            wires = CollectInternalWires(m_gates, m_wires, members);
+            return;
+        }
+        wxRect area = GetGateBBox(0);
+        for (size_t i = 0; i < m_gates.size(); ++i) {
+            members.push_back((int)i);
+            area.Union(GetGateBBox(i));
+        }
+        area.Inflate(40, 40); // ڷ֮
+        for (size_t i = 0; i < m_wires.size(); ++i) {
+            const std::vector<wxPoint>& pts = m_wires[i].points;
+            if (std::all_of(pts.begin(), pts.end(), [&area](const wxPoint& p) { return area.Contains(p); })) wires.push_back((int)i);
+        }
+    }
+
+    // һź֮滻Ϊһӵ·ʵʵŵϽ
+    void ReplaceWithInstance(const std::vector<int>& members, const std::vector<int>& wires, const wxString& type) {
+        if (members.empty()) return;
+        wxPoint origin = m_gates.Pos(members[0]);
+        for (int g : members) {
+            origin.x = std::min(origin.x, m_gates.Pos(g).x);
+            origin.y = std::min(origin.y, m_gates.Pos(g).y);
+        }
+
+        RemoveGates(members);
+        RemoveWires(wires);
+        Gate instance;
+        instance.type = type;
+        instance.pos = SnapToGrid(origin);
+        m_gates.Add(instance);
+
+        m_gateIndex.Invalidate();
+        SelectOnly((int)m_gates.size() - 1);
+        m_selectedWireIndex = -1;
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    int GetGridSize() const { return m_gridSize; }
+
+    // Զֵ룺ŵλá߶Ⱥ֮ӣȡǰͨϵ
+    void GetLayoutProblem(std::vector<wxPoint>& pos, std::vector<int>& height, std::vector<LayoutEdge>& edges) const {
+        CircuitAnalyzer local;
+        const CircuitAnalyzer* analyzer = &m_analyzer;
+        if (!m_showAnalysis || !m_analyzer.IsValid()) {
+            local.Build(m_gates, m_wires);
+            analyzer = &local;
+        }
+        pos.clear();
+        height.clear();
+        edges.clear();
+        for (size_t g = 0; g < m_gates.size(); ++g) {
+            pos.push_back(m_gates.Pos(g));
+            height.push_back(GetGateBBox(g).height);
+            const std::vector<int>& fanin = analyzer->GetFanin((int)g);
+            for (size_t p = 0; p < fanin.size(); ++p) {
+                int d = fanin[p];
+                if (d < 0) continue;
+                LayoutEdge e;
+                e.from = d;
+                e.to = (int)g;
+                e.fromPin = GetPinLayout(m_gates.Type(d)).outputs[analyzer->GetDriverPort((int)g, p)];
+                e.toPin = GetPinLayout(m_gates.Type(g)).inputs[p];
+                edges.push_back(e);
+            }
+        }
+    }
+
+    // ̨ڼ·ûб޸Ĺ
+    bool IsUnchangedSince(const std::vector<wxPoint>& pos, size_t wireCount) const {
+        if (pos.size() != m_gates.size() || wireCount != m_wires.size()) return false;
+        for (size_t g = 0; g < pos.size(); ++g) {
+            if (m_gates.Pos(g) != pos[g]) return false;
+        }
+        return true;
+    }
+
+    // Ӧòֽƶţӹϵŵŵ
+    void ApplyLayout(const std::vector<wxPoint>& pos, const std::vector<LayoutEdge>& edges) {
+        for (size_t g = 0; g < m_gates.size() && g < pos.size(); ++g) m_gates.SetPos(g, pos[g]);
+        m_wires.clear();
+        m_wires.reserve(edges.size());
+        for (auto& e : edges) {
+            m_wires.push_back(Wire(m_gates.Pos(e.from) + e.fromPin, m_gates.Pos(e.to) + e.toPin));
+        }
+        if (m_journal) m_journal->WiresReplaced(m_wires);
+        m_wireIndex.Invalidate();
+        m_gateIndex.Invalidate();
+        m_selectedWireIndex = -1;
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    // Զߵ룺ŵķΪϰǰͨϵÿźŹΪһ
+    void GetRoutingProblem(std::vector<wxPoint>& pos, std::vector<wxRect>& obstacles, std::vector<RouteNet>& nets, std::vector<wxPoint>& freePins) const {
+        CircuitAnalyzer local;
+        const CircuitAnalyzer* analyzer = &m_analyzer;
+        if (!m_showAnalysis || !m_analyzer.IsValid()) {
+            local.Build(m_gates, m_wires);
+            analyzer = &local;
+        }
+        pos.clear();
+        obstacles.clear();
+        nets.clear();
+        freePins.clear();
+        std::map<std::pair<int, int>, size_t> netOf;
+        for (size_t g = 0; g < m_gates.size(); ++g) {
+            pos.push_back(m_gates.Pos(g));
+            obstacles.push_back(GetGateBBox(g));
+            const PinLayout& layout = GetPinLayout(m_gates.Type(g));
+            const std::vector<int>& fanin = analyzer->GetFanin((int)g);
+            for (size_t p = 0; p < fanin.size() && p < layout.inputs.size(); ++p) {
+                wxPoint pin = m_gates.Pos(g) + layout.inputs[p];
+                int d = fanin[p];
+                if (d < 0) {
+                    freePins.push_back(pin);
+                    continue;
+                }
+                int port = analyzer->GetDriverPort((int)g, p);
+                auto it = netOf.find(std::make_pair(d, port));
+                if (it == netOf.end()) {
+                    it = netOf.insert(std::make_pair(std::make_pair(d, port), nets.size())).first;
+                    RouteNet net;
+                    net.source = m_gates.Pos(d) + GetPinLayout(m_gates.Type(d)).outputs[port];
+                    nets.push_back(net);
+                }
+                nets[it->second].sinks.push_back(pin);
+            }
+        }
+        for (size_t g = 0; g < m_gates.size(); ++g) {
+            const PinLayout& layout = GetPinLayout(m_gates.Type(g));
+            for (size_t k = 0; k < layout.outputs.size(); ++k) {
+                if (!netOf.count(std::make_pair((int)g, (int)k))) freePins.push_back(m_gates.Pos(g) + layout.outputs[k]);
+            }
+        }
+    }
+
+    // ò߽滻ȫ
+    void ApplyRouting(std::vector<Wire>&& wires) {
+        m_wires = std::move(wires);
+        if (m_journal) m_journal->WiresReplaced(m_wires);
+        m_wireIndex.Invalidate();
+        m_selectedWireIndex = -1;
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    // ѡе֮ߣֻѡһʱ
+    bool CopySelection(ClipboardContent& clip) const {
+        std::vector<int> members, wires;
+        if (!m_selection.Empty()) {
+            members = m_selection.ToIndices();
+            wires = CollectInternalWires(m_gates, m_wires, members);
+        }
+        else if (m_selectedWireIndex >= 0) {
+            wires.push_back(m_selectedWireIndex);
+        }
+        if (members.empty() && wires.empty()) return false;
+
+        wxPoint origin(std::numeric_limits<int>::max(), std::numeric_limits<int>::max());
+        for (int g : members) {
+            origin.x = std::min(origin.x, m_gates.Pos(g).x);
+            origin.y = std::min(origin.y, m_gates.Pos(g).y);
+        }
+        for (int w : wires) {
+            for (auto& p : m_wires[w].points) {
+                origin.x = std::min(origin.x, p.x);
+                origin.y = std::min(origin.y, p.y);
+            }
+        }
+        clip.origin = origin;
+        clip.gates.clear();
+        clip.gates.reserve(members.size());
+        for (int g : members) {
+            clip.gates.push_back(m_gates.Get(g));
+            clip.gates.back().pos -= origin;
+        }
+        clip.wires.clear();
+        clip.wires.reserve(wires.size());
+        for (int w : wires) {
+            clip.wires.push_back(m_wires[w]);
+            for (auto& p : clip.wires.back().points) p -= origin;
+        }
+        clip.text = ClipboardToText(clip);
+        return true;
+    }
+
+    // ճźһ׷ӵĩβǼǣֻؽһΣճΪѡ
+    void PasteClipboard(const ClipboardContent& clip, const wxPoint& at) {
+        wxPoint origin = SnapToGrid(at);
+        size_t firstGate = m_gates.size(), firstWire = m_wires.size();
+        m_gates.Reserve(firstGate + clip.gates.size());
+        for (auto& g : clip.gates) {
+            Gate gate = g;
+            gate.pos += origin;
+            m_gates.Add(gate);
+        }
+        m_wires.reserve(firstWire + clip.wires.size());
+        m_wires.insert(m_wires.end(), clip.wires.begin(), clip.wires.end());
+        for (size_t i = firstWire; i < m_wires.size(); ++i) {
+            for (auto& p : m_wires[i].points) p += origin;
+            if (m_journal) m_journal->WireAdded(m_wires, i);
+        }
+        m_wireIndex.AddRange(m_wires, firstWire);
+        if (m_gateIndex.IsBuiltFor(firstGate)) {
+            for (size_t i = firstGate; i < m_gates.size(); ++i) m_gateIndex.Add(GetGateBBox(i));
+        }
+
+        SelectOnly(clip.gates.empty() ? -1 : (int)m_gates.size() - 1);
+        m_selection.SetRange((int)firstGate, (int)m_gates.size());
+        m_selectedWireIndex = clip.gates.empty() && !clip.wires.empty() ? (int)m_wires.size() - 1 : -1;
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    // 滻źߣڵ
+    void SetCircuit(std::vector<Gate>&& gates, std::vector<Wire>&& wires) {
+        m_tiled.reset();
+        m_gates.Assign(gates);
+        m_wires = std::move(wires);
+        if (m_journal) m_journal->WiresReplaced(m_wires);
+        m_wireIndex.Invalidate();
+        m_gateIndex.Invalidate();
+        SelectOnly(-1);
+        m_selectedWireIndex = -1;
+        RebuildAnalysis();
+        Refresh();
+    }
+
+    // ģʽգֻʾƬļӿƵһݴ
+    // 򿪡½κ滻Ĳ˳ģʽ
+    void SetTiledCircuit(std::unique_ptr<TiledCircuitFile> file) {
+        m_gates.Clear();
+        m_wires.clear();
+        if (m_journal) m_journal->WiresReplaced(m_wires);
+        m_wireIndex.Invalidate();
+        m_gateIndex.Invalidate();
+        SelectOnly(-1);
         m_selectedWireIndex = -1;
+        RebuildAnalysis();
+        m_tiled = std::move(file);
+        m_viewOrigin = m_tiled->GetFirstExtent().GetTopLeft() - wxPoint(20, 20);
         Refresh();
     }
 
+    bool IsBrowsing() const { return m_tiled != nullptr; }
+
     void ZoomIn() { m_scale *= 1.2; Refresh(); }
     void ZoomOut() { m_scale /= 1.2; if (m_scale < 0.2) m_scale = 0.2; Refresh(); }
 
 private:
-    std::vector<Gate> m_gates;
+    GateStore m_gates;
     std::vector<Wire> m_wires;
     double m_scale;
 
     // 
     bool m_isDrawingWire;
-    wxPoint m_wireStart;
+    std::vector<wxPoint> m_wirePoints;    // ڻѾȷĶ
     wxPoint m_currentMouse;
+    WireSegmentIndex m_wireIndex;
 
     // ק
     bool m_isDraggingGate;
     int m_draggedIndex;
     wxPoint m_dragOffset;
+    wxPoint m_dragStart;                  // ϶Űʱλ
+    std::vector<int> m_dragWires;         // ϶ʱ֮ƶڲ
 
-    // 
+    // ѡm_selection ѡеţm_selectedIndex ѡһ༭ʱΪ׼
     int m_selectedIndex;
+    SelectionSet m_selection;
     int m_selectedWireIndex;
+    GateGridIndex m_gateIndex;
+
+    // ѡ
+    bool m_isBoxSelecting;
+    bool m_boxAdd;                        // ס Shift ʱеѡ
+    wxPoint m_boxStart;
+
     bool m_showGrid;
     int m_gridSize;
 
+    // ߼ʱ
+    CircuitAnalyzer m_analyzer;
+    bool m_showAnalysis;
+    PowerReport m_power;
+    bool m_showPower;
+
+    // ָõı༭־ڳУΪգ
+    EditJournal* m_journal = nullptr;
+
+    // ӿϽǵ߼ꣻм϶ģʽҲԣƽ
+    wxPoint m_viewOrigin;
+    bool m_isPanning = false;
+    wxPoint m_panStart;                   // ʼƽʱ豸
+    wxPoint m_panOrigin;
+
+    // ģʽµƬļͱ֡ƵƬ
+    std::unique_ptr<TiledCircuitFile> m_tiled;
+    std::vector<const TiledCircuitFile::Tile*> m_visibleTiles;
+
+    // 壺һ֡ƺӿ
+    bool m_showProfiler;
+    size_t m_gatesDrawn = 0, m_gatesCulled = 0;
+    size_t m_wiresDrawn = 0, m_wiresCulled = 0;
+
+    void SelectOnly(int index) {
+        m_selection.Clear();
+        m_selectedIndex = index;
+        if (index >= 0) m_selection.Set(index);
+    }
+
+    // ɾһߣ߱ԭ˳
+    void RemoveWires(const std::vector<int>& indices) {
+        std::vector<char> remove(m_wires.size(), 0);
+        for (int w : indices) remove[w] = 1;
+        std::vector<size_t> removed;
+        size_t kept = 0;
+        for (size_t i = 0; i < m_wires.size(); ++i) {
+            if (remove[i]) {
+                removed.push_back(i);
+                continue;
+            }
+            if (kept != i) m_wires[kept] = std::move(m_wires[i]);
+            ++kept;
+        }
+        m_wires.resize(kept);
+        m_wireIndex.Invalidate();
+        if (m_journal && !removed.empty()) m_journal->WiresRemoved(removed);
+    }
+
+    // ɾһţȡɾʱĩβŻỻλҵǵǰ
+    void RemoveGates(const std::vector<int>& indices) {
+        std::vector<GateHandle> handles;
+        handles.reserve(indices.size());
+        for (int g : indices) handles.push_back(m_gates.Handle(g));
+        for (auto& h : handles) {
+            int index = m_gates.IndexOf(h);
+            if (index >= 0) m_gates.SwapRemove(index);
+        }
+    }
+
+    // ŵλű仯һβѯʱؽ
+    void EnsureGateIndex() {
+        if (m_gateIndex.IsBuiltFor(m_gates.size())) return;
+        std::vector<wxRect> boxes;
+        boxes.reserve(m_gates.size());
+        for (size_t i = 0; i < m_gates.size(); ++i) boxes.push_back(GetGateBBox(i));
+        m_gateIndex.Build(std::move(boxes));
+    }
+
+    int HitTestGate(const wxPoint& pos) {
+        ScopedTimer timer(ProfileZone::HitTest);
+        EnsureGateIndex();
+        return m_gateIndex.HitTest(pos);
+    }
+
+    // õ㸽Ƿţſŵķ֮⣬ѯʱѷΧŴ
+    bool IsNearPin(const wxPoint& pos) {
+        ScopedTimer timer(ProfileZone::HitTest);
+        EnsureGateIndex();
+        const int margin = 40 + PIN_TOLERANCE;
+        bool found = false;
+        m_gateIndex.Query(wxRect(pos.x - margin, pos.y - margin, 2 * margin + 1, 2 * margin + 1), [&](int g) {
+            const PinLayout& layout = GetPinLayout(m_gates.Type(g));
+            for (const std::vector<wxPoint>* pins : { &layout.inputs, &layout.outputs }) {
+                for (auto& off : *pins) {
+                    wxPoint pin = m_gates.Pos(g) + off;
+                    if (std::abs(pin.x - pos.x) <= PIN_TOLERANCE && std::abs(pin.y - pos.y) <= PIN_TOLERANCE) found = true;
+                }
+            }
+        });
+        return found;
+    }
+
+    // ѡȫھڵ
+    void SelectInBox(const wxRect& box, bool add) {
+        if (!add) SelectOnly(-1);
+        EnsureGateIndex();
+        m_gateIndex.Query(box, [this, &box](int g) {
+            if (box.Contains(GetGateBBox(g))) m_selection.Set(g);
+        });
+        if (m_selectedIndex < 0) m_selectedIndex = m_selection.First();
+    }
+
+    void RebuildAnalysis() {
+        if (!m_showAnalysis) return;
+        auto t0 = std::chrono::steady_clock::now();
+        m_analyzer.Build(m_gates, m_wires);
+        ReportAnalysis(t0);
+    }
+
+    void ReportAnalysis(std::chrono::steady_clock::time_point t0) {
+        // ӿ޷ֲʱýʧЧʱ˻ȫ
+        if (!m_analyzer.IsValid()) m_analyzer.Build(m_gates, m_wires);
+        auto t1 = std::chrono::steady_clock::now();
+        if (Profiler::IsEnabled()) Profiler::Record(ProfileZone::Analysis, t0, t1);
+        double ms = std::chrono::duration<double, std::milli>(t1 - t0).count();
+        wxLogStatus(":  %zu , ʱ %.2f ms, ·ӳ %d%s",
+            m_analyzer.GetLastEvaluated(), ms, m_analyzer.GetMaxArrival(),
+            m_analyzer.IsUnstable() ? " (ϻ·, δ)" : "");
+        if (m_showPower) UpdatePowerFromAnalyzer();
+    }
+
+    void UpdatePowerFromAnalyzer() {
+        EstimatePower(m_gates, m_analyzer.GetFanout(), m_analyzer.GetToggleCounts(),
+            m_analyzer.GetClockEdges() / 2, m_power);
+    }
+
+    // ǳƵ
+    static wxColour HeatColour(double ratio) {
+        ratio = std::max(0.0, std::min(1.0, ratio));
+        return wxColour(255, (unsigned char)(230 - 190 * ratio), (unsigned char)(160 - 160 * ratio));
+    }
+
+    bool HasPowerMap() const {
+        return m_showPower && m_power.energy.size() == m_gates.size() && m_power.maxEnergy > 0;
+    }
+
+    void DrawPowerSummary(wxDC& dc) {
+        wxString text = wxString::Format("ת %llu ,  %.1f fJ", (unsigned long long)m_power.toggles, m_power.totalEnergy);
+        if (m_power.cycles > 0) {
+            text += wxString::Format(", %zu  @ %g MHz, ̬ %.3f uW", m_power.cycles, m_power.frequency, m_power.Power());
+        }
+        dc.SetTextForeground(wxColour(180, 40, 0));
+        dc.DrawText(text, m_viewOrigin.x + 5, m_viewOrigin.y + 5);
+        dc.SetTextForeground(*wxBLACK);
+    }
+
+    // 壺ڴϽǣű仯֡ʱͳƽһ֡
+    void DrawProfilerHud(wxDC& dc) {
+        Profiler::Histogram frame = Profiler::Collect(ProfileZone::Frame);
+        Profiler::Histogram hit = Profiler::Collect(ProfileZone::HitTest);
+        Profiler::Histogram undo = Profiler::Collect(ProfileZone::Undo);
+        Profiler::Histogram io = Profiler::Collect(ProfileZone::FileIO);
+        std::vector<wxString> lines;
+        lines.push_back(wxString::Format("֡ʱ p50 %.2f ms, p99 %.2f ms (%llu ֡)",
+            frame.Percentile(0.5) / 1000, frame.Percentile(0.99) / 1000, (unsigned long long)frame.count));
+        lines.push_back(wxString::Format("  %zu /  %zu", m_gatesDrawn, m_gatesCulled));
+        lines.push_back(wxString::Format("  %zu /  %zu", m_wiresDrawn, m_wiresCulled));
+        lines.push_back(wxString::Format("ʰȡ p99 %.3f ms,  p99 %.2f ms", hit.Percentile(0.99) / 1000, undo.Percentile(0.99) / 1000));
+        if (io.count > 0) lines.push_back(wxString::Format("ļд %llu ,  %.0f ms", (unsigned long long)io.count, io.max / 1000.0));
+        if (m_tiled) {
+            lines.push_back(wxString::Format("Ƭ פ %zu / %zu, %.1f MB", m_tiled->GetResidentTiles(), m_tiled->GetTileCount(),
+                m_tiled->GetResidentBytes() / 1048576.0));
+        }
+
+        double sx, sy;
+        dc.GetUserScale(&sx, &sy);
+        dc.SetUserScale(1.0, 1.0);
+        dc.SetLogicalOrigin(0, 0);
+        wxFont smallFont(8, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+        dc.SetFont(smallFont);
+        int width = 0, height = 0;
+        for (auto& line : lines) {
+            wxSize extent = dc.GetTextExtent(line);
+            width = std::max(width, extent.x);
+            height += extent.y + 2;
+        }
+        wxRect box(GetClientSize().x - width - 16, 5, width + 10, height + 6);
+        dc.SetPen(wxPen(wxColour(120, 120, 120)));
+        dc.SetBrush(wxBrush(wxColour(255, 255, 230)));
+        dc.DrawRectangle(box);
+        dc.SetTextForeground(wxColour(40, 40, 40));
+        int y = box.y + 3;
+        for (auto& line : lines) {
+            dc.DrawText(line, box.x + 5, y);
+            y += dc.GetTextExtent(line).y + 2;
+        }
+        dc.SetFont(wxNullFont);
+        dc.SetTextForeground(*wxBLACK);
+        dc.SetPen(*wxBLACK_PEN);
+        dc.SetBrush(*wxWHITE_BRUSH);
+        dc.SetUserScale(sx, sy);
+        dc.SetLogicalOrigin(m_viewOrigin.x, m_viewOrigin.y);
+    }
+
+    // ģʽƬļȡӿڸƬƣ뻭ϵʹͬĻƴ
+    void DrawTiles(wxDC& dc, const wxRect& visible) {
+        m_tiled->Query(visible, m_visibleTiles);
+        for (const TiledCircuitFile::Tile* tile : m_visibleTiles) {
+            for (auto& g : tile->gates) {
+                if (!visible.Intersects(GetGateExtent(g.type, g.pos, g.properties.size()))) {
+                    ++m_gatesCulled;
+                    continue;
+                }
+                ++m_gatesDrawn;
+                DrawGate(dc, g.type, g.pos, g.properties);
+            }
+            for (auto& w : tile->wires) {
+                if (!visible.Intersects(GetWireExtent(w))) {
+                    ++m_wiresCulled;
+                    continue;
+                }
+                ++m_wiresDrawn;
+                dc.DrawLines((int)w.points.size(), w.points.data());
+            }
+        }
+    }
+
+public:
     // ---------- ͨû ----------
-    void DrawGate(wxDC& dc, const Gate& gate) {
-        auto it = shapeLibrary.find(gate.type);
+    // ״̬ͼƬʱ߳ҲԲʹȫֵĿ滭ʺɫ
+    static void DrawGate(wxDC& dc, const wxString& type, const wxPoint& pos, const std::vector<Property>& properties) {
+        auto it = shapeLibrary.find(type);
         if (it == shapeLibrary.end()) {
-            dc.DrawText("δ֪", gate.pos);
+            dc.DrawText("δ֪", pos);
             return;
         }
 
         // ֱӻ
         for (auto& s : it->second) {
-            DrawShape(dc, s, gate.pos);
+            DrawShape(dc, s, pos);
         }
 
         // ıУ
-        if (!gate.properties.empty()) {
+        if (!properties.empty()) {
             wxFont smallFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
             dc.SetFont(smallFont);
             dc.SetTextForeground(wxColour(100, 100, 100));
 
             int yOffset = 70; // ·ʾ
-            for (const auto& prop : gate.properties) {
-                wxString propText = wxString::Format("%s: %s", prop.name, prop.value);
-                dc.DrawText(propText, gate.pos.x, gate.pos.y + yOffset);
+            for (const auto& prop : properties) {
+                wxString propText = wxString::Format("%s: %s", prop.GetName(), prop.GetValueString());
+                dc.DrawText(propText, pos.x, pos.y + yOffset);
                 yOffset += 12;
             }
 
             // ָĬɫ
             dc.SetFont(wxNullFont);
-            dc.SetTextForeground(*wxBLACK);
+            dc.SetTextForeground(wxColour(0, 0, 0));
         }
     }
 
-    void DrawShape(wxDC& dc, const Shape& s, const wxPoint& pos) {
+    static void DrawShape(wxDC& dc, const Shape& s, const wxPoint& pos) {
         if (s.type == ShapeType::Line && s.pts.size() >= 2) {
             dc.DrawLine(pos.x + s.pts[0].x, pos.y + s.pts[0].y,
                 pos.x + s.pts[1].x, pos.y + s.pts[1].y);
@@ -524,6 +7889,7 @@ private:
         }
     }
 
+private:
     void DrawGrid(wxDC& dc) {
         if (!m_showGrid) return;
 
@@ -531,61 +7897,54 @@ private:
         wxPen gridPen(wxColour(220, 220, 220), 1, wxPENSTYLE_DOT);
         dc.SetPen(gridPen);
 
-        int logicalWidth = (int)(size.x / m_scale);
-        int logicalHeight = (int)(size.y / m_scale);
+        int left = m_viewOrigin.x, top = m_viewOrigin.y;
+        int right = left + (int)(size.x / m_scale), bottom = top + (int)(size.y / m_scale);
+        auto firstLine = [this](int v) { return v >= 0 ? v - v % m_gridSize : v - (v % m_gridSize + m_gridSize) % m_gridSize; };
 
-        for (int x = 0; x < logicalWidth; x += m_gridSize) {
-            dc.DrawLine(x, 0, x, logicalHeight);
+        for (int x = firstLine(left); x < right; x += m_gridSize) {
+            dc.DrawLine(x, top, x, bottom);
         }
-        for (int y = 0; y < logicalHeight; y += m_gridSize) {
-            dc.DrawLine(0, y, logicalWidth, y);
+        for (int y = firstLine(top); y < bottom; y += m_gridSize) {
+            dc.DrawLine(left, y, right, y);
         }
 
         dc.SetPen(*wxBLACK_PEN);
     }
 
-    wxRect GetGateBBox(const Gate& g) const {
-        int w = 80, h = 60;
-        if (g.type == "NOT" || g.type == "BUFFER") { w = 70; h = 60; }
-        else if (g.type == "LED") { w = 80; h = 90; }
-        return wxRect(g.pos.x, g.pos.y, w, h);
-    }
-
-    // Ƿ
-    bool IsPointNearLine(const wxPoint& point, const Wire& wire, int tolerance = 5) {
-        // 㵽߶εľ
-        wxPoint p = point;
-        wxPoint a = wire.start;
-        wxPoint b = wire.end;
-
-        // ߶γȵƽ
-        double length2 = (b.x - a.x) * (b.x - a.x) + (b.y - a.y) * (b.y - a.y);
-        if (length2 == 0) {
-            // ߶˻Ϊ
-            return (p.x - a.x) * (p.x - a.x) + (p.y - a.y) * (p.y - a.y) <= tolerance * tolerance;
+    // ÿŵԱע߼ֵ͵ʱ
+    void DrawAnalysis(wxDC& dc) {
+        wxFont smallFont(8, wxFONTFAMILY_DEFAULT, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL);
+        dc.SetFont(smallFont);
+        for (size_t i = 0; i < m_gates.size(); ++i) {
+            const PinLayout& layout = GetPinLayout(m_gates.Type(i));
+            if (layout.outputs.empty()) continue;
+            int value = m_analyzer.GetValue((int)i);
+            dc.SetTextForeground(value ? wxColour(0, 150, 0) : wxColour(120, 120, 120));
+            wxPoint p = m_gates.Pos(i) + layout.outputs[0];
+            dc.DrawText(wxString::Format("%d @%d", value, m_analyzer.GetArrival((int)i)), p.x + 4, p.y - 14);
         }
+        dc.SetFont(wxNullFont);
+        dc.SetTextForeground(*wxBLACK);
+    }
 
-        // ͶӰ
-        double t = std::max(0.0, std::min(1.0,
-            ((p.x - a.x) * (b.x - a.x) + (p.y - a.y) * (b.y - a.y)) / length2));
-
-        // ͶӰ
-        wxPoint projection(
-            a.x + t * (b.x - a.x),
-            a.y + t * (b.y - a.y)
-        );
+    wxRect GetGateBBox(const wxString& type, const wxPoint& pos) const {
+        return wxRect(pos, GetGateSize(type));
+    }
 
-        // ƽ
-        double distance2 = (p.x - projection.x) * (p.x - projection.x) +
-            (p.y - projection.y) * (p.y - projection.y);
+    wxRect GetGateBBox(const Gate& g) const { return GetGateBBox(g.type, g.pos); }
+    wxRect GetGateBBox(size_t i) const { return GetGateBBox(m_gates.Type(i), m_gates.Pos(i)); }
 
-        return distance2 <= tolerance * tolerance;
+    // ͨ߶ʰȡߣ߱仯һʰȡʱؽ
+    int HitTestWire(const wxPoint& pos) {
+        ScopedTimer timer(ProfileZone::HitTest);
+        if (!m_wireIndex.IsBuiltFor(m_wires.size())) m_wireIndex.Build(m_wires);
+        return m_wireIndex.HitTest(m_wires, pos, 5);
     }
 
     wxPoint ToLogical(const wxPoint& devicePt) const {
         double lx = devicePt.x / m_scale;
         double ly = devicePt.y / m_scale;
-        return wxPoint(int(lx + 0.5), int(ly + 0.5));
+        return wxPoint(int(lx + 0.5), int(ly + 0.5)) + m_viewOrigin;
     }
 
     wxPoint SnapToGrid(const wxPoint& point) {
@@ -596,12 +7955,22 @@ private:
     }
 
     void OnPaint(wxPaintEvent&) {
+        ScopedTimer frameTimer(ProfileZone::Frame);
         wxAutoBufferedPaintDC dc(this);
         dc.Clear();
         dc.SetUserScale(m_scale, m_scale);
+        dc.SetLogicalOrigin(m_viewOrigin.x, m_viewOrigin.y);
 
         // 
-        DrawGrid(dc);
+        {
+            ScopedTimer timer(ProfileZone::Grid);
+            DrawGrid(dc);
+        }
+
+        // ӿź߲ƣźֻᳬŵķ򣬷ΧſһЩ
+        wxSize clientSize = GetClientSize();
+        wxRect visible(m_viewOrigin.x, m_viewOrigin.y, (int)(clientSize.x / m_scale) + 1, (int)(clientSize.y / m_scale) + 1);
+        visible.Inflate(160, 40);
 
         wxPen redPen(wxColour(200, 0, 0), 2, wxPENSTYLE_SOLID);
         wxPen dashPen(wxColour(0, 0, 0), 1, wxPENSTYLE_SHORT_DASH);
@@ -611,13 +7980,43 @@ private:
         dc.SetPen(*wxBLACK_PEN);
 
         // 
+        bool analysis = m_showAnalysis && m_analyzer.IsValid();
+        bool heat = HasPowerMap();
+        ScopedTimer gatesTimer(ProfileZone::Gates);
+        m_gatesDrawn = m_gatesCulled = 0;
+        m_wiresDrawn = m_wiresCulled = 0;
         for (size_t i = 0; i < m_gates.size(); ++i) {
-            auto& g = m_gates[i];
-            DrawGate(dc, g);
+            const wxString& type = m_gates.Type(i);
+            const wxPoint& pos = m_gates.Pos(i);
+            const std::vector<Property>& props = m_gates.Properties(i);
+            wxRect extent = GetGateBBox(type, pos);
+            if (!props.empty()) extent.height = std::max(extent.height, 70 + 12 * (int)props.size());
+            if (!visible.Intersects(extent)) {
+                ++m_gatesCulled;
+                continue;
+            }
+            ++m_gatesDrawn;
+            //  LED úɫ
+            if (analysis && m_analyzer.GetValue((int)i) && GetGateKind(type) == GateKind::Led) {
+                dc.SetBrush(wxBrush(wxColour(255, 90, 90)));
+                DrawGate(dc, type, pos, props);
+                dc.SetBrush(*wxWHITE_BRUSH);
+            }
+            else if (heat && m_power.energy[i] > 0) {
+                dc.SetBrush(wxBrush(HeatColour(m_power.energy[i] / m_power.maxEnergy)));
+                dc.SetPen(*wxTRANSPARENT_PEN);
+                dc.DrawRectangle(GetGateBBox(type, pos));
+                dc.SetPen(*wxBLACK_PEN);
+                DrawGate(dc, type, pos, props);
+                dc.SetBrush(*wxWHITE_BRUSH);
+            }
+            else {
+                DrawGate(dc, type, pos, props);
+            }
 
             // ѡ״̬
-            if ((int)i == m_selectedIndex) {
-                wxRect r = GetGateBBox(g);
+            if (m_selection.Test((int)i)) {
+                wxRect r = GetGateBBox(type, pos);
                 dc.SetPen(selectionPen);
                 dc.SetBrush(*wxTRANSPARENT_BRUSH);
                 dc.DrawRectangle(r);
@@ -626,7 +8025,7 @@ private:
 
             // ק״̬
             if (m_isDraggingGate && (int)i == m_draggedIndex) {
-                wxRect r = GetGateBBox(g);
+                wxRect r = GetGateBBox(type, pos);
                 dc.SetPen(dashPen);
                 dc.SetBrush(*wxTRANSPARENT_BRUSH);
                 dc.DrawRectangle(r);
@@ -634,93 +8033,159 @@ private:
             }
         }
 
+        if (m_tiled) {
+            DrawTiles(dc, visible);
+        }
+        gatesTimer.Stop();
+
         // 
+        ScopedTimer wiresTimer(ProfileZone::Wires);
+        bool heatWires = heat && analysis;
         for (size_t i = 0; i < m_wires.size(); ++i) {
             auto& w = m_wires[i];
+            int left = w.points[0].x, right = left, top = w.points[0].y, bottom = top;
+            for (auto& p : w.points) {
+                left = std::min(left, p.x);
+                right = std::max(right, p.x);
+                top = std::min(top, p.y);
+                bottom = std::max(bottom, p.y);
+            }
+            if (right < visible.GetLeft() || left > visible.GetRight() || bottom < visible.GetTop() || top > visible.GetBottom()) {
+                ++m_wiresCulled;
+                continue;
+            }
+            ++m_wiresDrawn;
+            int driver = heatWires ? m_analyzer.GetWireDriver((int)i) : -1;
             if ((int)i == m_selectedWireIndex) {
                 dc.SetPen(wireSelectionPen);
             }
+            else if (driver >= 0 && m_power.energy[driver] > 0) {
+                dc.SetPen(wxPen(HeatColour(m_power.energy[driver] / m_power.maxEnergy), 3));
+            }
             else {
                 dc.SetPen(*wxBLACK_PEN);
             }
-            dc.DrawLine(w.start, w.end);
+            dc.DrawLines((int)w.points.size(), w.points.data());
             dc.SetPen(*wxBLACK_PEN);
         }
+        wiresTimer.Stop();
+
+        ScopedTimer overlayTimer(ProfileZone::Overlay);
+        if (analysis) {
+            DrawAnalysis(dc);
+        }
+        if (m_showPower && m_power.energy.size() == m_gates.size()) {
+            DrawPowerSummary(dc);
+        }
 
         // ڻ
         if (m_isDrawingWire) {
+            std::vector<wxPoint> pts(m_wirePoints);
+            pts.push_back(m_currentMouse);
             dc.SetPen(redPen);
-            dc.DrawLine(m_wireStart, m_currentMouse);
+            dc.DrawLines((int)pts.size(), pts.data());
+            dc.SetPen(*wxBLACK_PEN);
+        }
+
+        // ƿѡ
+        if (m_isBoxSelecting) {
+            dc.SetPen(wxPen(wxColour(0, 100, 200), 1, wxPENSTYLE_SHORT_DASH));
+            dc.SetBrush(*wxTRANSPARENT_BRUSH);
+            dc.DrawRectangle(wxRect(m_boxStart, m_currentMouse));
             dc.SetPen(*wxBLACK_PEN);
         }
+
+        if (m_showProfiler) {
+            DrawProfilerHud(dc);
+        }
     }
 
     void OnMouseDown(wxMouseEvent& evt) {
+        // ģʽֻƽ
+        if (m_tiled) {
+            StartPan(evt.GetPosition());
+            return;
+        }
         wxPoint pos = ToLogical(evt.GetPosition());
         if (m_showGrid) {
             pos = SnapToGrid(pos);
         }
 
         // ȼǷ
-        m_selectedWireIndex = -1;
-        for (int i = (int)m_wires.size() - 1; i >= 0; --i) {
-            if (IsPointNearLine(pos, m_wires[i])) {
-                m_selectedWireIndex = i;
-                m_selectedIndex = -1; // ȡѡ
-                Refresh();
-                return;
-            }
+        m_selectedWireIndex = HitTestWire(pos);
+        if (m_selectedWireIndex >= 0) {
+            SelectOnly(-1); // ȡѡ
+            Refresh();
+            return;
         }
 
         // Ƿ
-        int hitIndex = -1;
-        for (int i = (int)m_gates.size() - 1; i >= 0; --i) {
-            if (GetGateBBox(m_gates[i]).Contains(pos)) {
-                hitIndex = i;
-                break;
-            }
-        }
+        int hitIndex = HitTestGate(pos);
 
         if (hitIndex != -1) {
             if (evt.LeftDown()) {
+                m_selectedWireIndex = -1; // ȡѡ
+                // Shift лǷѡУѡеűѡ񼯣϶ʱһƶ
+                if (evt.ShiftDown() && m_selection.Test(hitIndex)) {
+                    m_selection.Reset(hitIndex);
+                    if (m_selectedIndex == hitIndex) m_selectedIndex = m_selection.First();
+                    Refresh();
+                    return;
+                }
+                if (evt.ShiftDown()) {
+                    m_selection.Set(hitIndex);
+                    m_selectedIndex = hitIndex;
+                }
+                else if (m_selection.Test(hitIndex)) {
+                    m_selectedIndex = hitIndex;
+                }
+                else {
+                    SelectOnly(hitIndex);
+                }
                 m_isDraggingGate = true;
                 m_draggedIndex = hitIndex;
-                m_selectedIndex = hitIndex;
-                m_selectedWireIndex = -1; // ȡѡ
-                m_dragOffset = wxPoint(pos.x - m_gates[hitIndex].pos.x, pos.y - m_gates[hitIndex].pos.y);
+                m_dragStart = m_gates.Pos(hitIndex);
+                m_dragOffset = wxPoint(pos.x - m_gates.Pos(hitIndex).x, pos.y - m_gates.Pos(hitIndex).y);
+                m_dragWires.clear();
+                if (m_selection.Count() > 1) m_dragWires = CollectInternalWires(m_gates, m_wires, m_selection.ToIndices());
                 if (!HasCapture()) CaptureMouse();
                 SetCursor(wxCursor(wxCURSOR_SIZING));
             }
         }
         else {
-            if (evt.LeftDown()) {
+            // Ŵ϶ߣڿհ״϶ѡ
+            if (evt.LeftDown() && IsNearPin(pos)) {
                 m_isDrawingWire = true;
-                m_wireStart = pos;
+                m_wirePoints.assign(1, pos);
                 m_currentMouse = pos;
-                m_selectedIndex = -1;
+                SelectOnly(-1);
                 m_selectedWireIndex = -1;
                 if (!HasCapture()) CaptureMouse();
                 SetCursor(wxCursor(wxCURSOR_CROSS));
             }
+            else if (evt.LeftDown()) {
+                m_isBoxSelecting = true;
+                m_boxAdd = evt.ShiftDown();
+                m_boxStart = pos;
+                m_currentMouse = pos;
+                if (!m_boxAdd) SelectOnly(-1);
+                m_selectedWireIndex = -1;
+                if (!HasCapture()) CaptureMouse();
+            }
         }
         Refresh();
     }
 
     void OnRightClick(wxMouseEvent& evt) {
+        if (m_tiled) return;
         wxPoint pos = ToLogical(evt.GetPosition());
 
         // ǷҼ
-        int hitWireIndex = -1;
-        for (int i = (int)m_wires.size() - 1; i >= 0; --i) {
-            if (IsPointNearLine(pos, m_wires[i])) {
-                hitWireIndex = i;
-                break;
-            }
-        }
+        int hitWireIndex = HitTestWire(pos);
 
         if (hitWireIndex != -1) {
             m_selectedWireIndex = hitWireIndex;
-            m_selectedIndex = -1;
+            SelectOnly(-1);
 
             // ʾҼ˵
             wxMenu menu;
@@ -729,16 +8194,11 @@ private:
             return;
         }
 
-        // ǷҼ
-        int hitIndex = -1;
-        for (int i = (int)m_gates.size() - 1; i >= 0; --i) {
-            if (GetGateBBox(m_gates[i]).Contains(pos)) {
-                hitIndex = i;
-                break;
-            }
-        }
+        // ǷҼѡʱ˵ѡ
+        int hitIndex = HitTestGate(pos);
 
-        m_selectedIndex = hitIndex;
+        if (hitIndex != -1 && m_selection.Test(hitIndex)) m_selectedIndex = hitIndex;
+        else SelectOnly(hitIndex);
         m_selectedWireIndex = -1;
         Refresh();
 
@@ -746,6 +8206,7 @@ private:
         if (hitIndex != -1) {
             wxMenu menu;
             menu.Append(ID_EDIT_PROPERTIES, "༭");
+            if (m_selection.Count() > 1) menu.Append(ID_BULK_EDIT_PROPERTIES, "...");
             menu.AppendSeparator();
             menu.Append(ID_DELETE_SELECTED, "ɾ");
 
@@ -754,6 +8215,12 @@ private:
     }
 
     void OnMouseMove(wxMouseEvent& evt) {
+        if (m_isPanning) {
+            wxPoint delta = evt.GetPosition() - m_panStart;
+            m_viewOrigin = m_panOrigin - wxPoint((int)(delta.x / m_scale), (int)(delta.y / m_scale));
+            Refresh();
+            return;
+        }
         wxPoint pos = ToLogical(evt.GetPosition());
         if (m_showGrid) {
             pos = SnapToGrid(pos);
@@ -761,18 +8228,53 @@ private:
 
         if (m_isDraggingGate && evt.Dragging() && evt.LeftIsDown()) {
             if (m_draggedIndex >= 0 && m_draggedIndex < (int)m_gates.size()) {
-                m_gates[m_draggedIndex].pos = wxPoint(pos.x - m_dragOffset.x, pos.y - m_dragOffset.y);
+                wxPoint target(pos.x - m_dragOffset.x, pos.y - m_dragOffset.y);
+                wxPoint delta = target - m_gates.Pos(m_draggedIndex);
+                if (delta == wxPoint(0, 0)) return;
+                // ϶ѡʱѡ񼯺ڲһƽ
+                if (m_selection.Count() > 1 && m_selection.Test(m_draggedIndex)) {
+                    m_selection.ForEach([this, &delta](int g) { m_gates.SetPos(g, m_gates.Pos(g) + delta); });
+                    for (int w : m_dragWires) {
+                        for (auto& p : m_wires[w].points) p += delta;
+                    }
+                }
+                else {
+                    m_gates.SetPos(m_draggedIndex, target);
+                }
                 Refresh();
             }
         }
-        else if (m_isDrawingWire && evt.Dragging() && evt.LeftIsDown()) {
+        else if ((m_isDrawingWire || m_isBoxSelecting) && evt.Dragging() && evt.LeftIsDown()) {
             m_currentMouse = pos;
             Refresh();
         }
     }
 
     void OnMouseUp(wxMouseEvent&) {
+        if (m_isPanning) {
+            EndPan();
+            return;
+        }
         if (m_isDraggingGate) {
+            bool moved = m_draggedIndex >= 0 && m_draggedIndex < (int)m_gates.size() && m_gates.Pos(m_draggedIndex) != m_dragStart;
+            if (moved) {
+                m_gateIndex.Invalidate();
+                if (!m_dragWires.empty()) m_wireIndex.Invalidate();
+                if (m_journal) {
+                    for (int w : m_dragWires) m_journal->WireChanged(m_wires, w);
+                }
+            }
+            if (moved && m_showAnalysis) {
+                if (m_selection.Count() > 1 && m_selection.Test(m_draggedIndex)) {
+                    RebuildAnalysis();
+                }
+                else {
+                    auto t0 = std::chrono::steady_clock::now();
+                    m_analyzer.GateMoved(m_gates, m_draggedIndex);
+                    ReportAnalysis(t0);
+                }
+            }
+            m_dragWires.clear();
             m_isDraggingGate = false;
             m_draggedIndex = -1;
             if (HasCapture()) ReleaseMouse();
@@ -791,38 +8293,503 @@ private:
             evt.SetEventObject(this);
             wxPostEvent(GetParent(), evt);
 
-            m_wires.push_back({ m_wireStart, m_currentMouse });
+            m_wirePoints.push_back(m_currentMouse);
+            m_wires.push_back(Wire(std::move(m_wirePoints)));
+            m_wirePoints.clear();
+            if (m_journal) m_journal->WireAdded(m_wires, m_wires.size() - 1);
+            if (m_wireIndex.IsBuiltFor(m_wires.size() - 1)) m_wireIndex.Add((int)m_wires.size() - 1, m_wires.back());
+            if (m_showAnalysis) {
+                auto t0 = std::chrono::steady_clock::now();
+                m_analyzer.WireAdded(m_wires, (int)m_wires.size() - 1);
+                ReportAnalysis(t0);
+            }
             m_isDrawingWire = false;
             if (HasCapture()) ReleaseMouse();
             SetCursor(wxCursor(wxCURSOR_ARROW));
             Refresh();
         }
+        else if (m_isBoxSelecting) {
+            m_isBoxSelecting = false;
+            SelectInBox(wxRect(m_boxStart, m_currentMouse), m_boxAdd);
+            if (HasCapture()) ReleaseMouse();
+            Refresh();
+        }
+    }
+
+    void OnMiddleDown(wxMouseEvent& evt) { StartPan(evt.GetPosition()); }
+    void OnMiddleUp(wxMouseEvent&) { EndPan(); }
+
+    void StartPan(const wxPoint& devicePt) {
+        m_isPanning = true;
+        m_panStart = devicePt;
+        m_panOrigin = m_viewOrigin;
+        CaptureMouse();
+        SetCursor(wxCursor(wxCURSOR_HAND));
+    }
+
+    void EndPan() {
+        if (!m_isPanning) return;
+        m_isPanning = false;
+        if (HasCapture()) ReleaseMouse();
+        SetCursor(wxCursor(wxCURSOR_ARROW));
+    }
+
+    // ÿƽķ֮һӿ
+    void PanBy(int dx, int dy) {
+        wxSize size = GetClientSize();
+        m_viewOrigin += wxPoint((int)(dx * size.x / m_scale / 4), (int)(dy * size.y / m_scale / 4));
+        Refresh();
+    }
+
+    void OnKeyDown(wxKeyEvent& evt) {
+        switch (evt.GetKeyCode()) {
+        case WXK_LEFT: PanBy(-1, 0); break;
+        case WXK_RIGHT: PanBy(1, 0); break;
+        case WXK_UP: PanBy(0, -1); break;
+        case WXK_DOWN: PanBy(0, 1); break;
+        case WXK_SPACE:
+            // ʱոڵǰλüһյ
+            if (m_isDrawingWire && m_currentMouse != m_wirePoints.back()) {
+                m_wirePoints.push_back(m_currentMouse);
+                Refresh();
+            }
+            break;
+        case WXK_DELETE:
+        case WXK_BACK:
+            if (!m_selection.Empty()) {
+                DeleteSelected();
+            }
+            else if (m_selectedWireIndex >= 0) {
+                DeleteSelectedWire();
+            }
+            break;
+        case 'P':
+        case 'p':
+            if (evt.ControlDown()) {
+                EditSelectedProperties();
+            }
+            break;
+        case 'A':
+        case 'a':
+            if (evt.ControlDown()) {
+                SelectOnly(-1);
+                m_selection.SetRange(0, (int)m_gates.size());
+                m_selectedIndex = m_selection.First();
+                m_selectedWireIndex = -1;
+                Refresh();
+            }
+            break;
+        default:
+            evt.Skip();
+            break;
+        }
+    }
+};
+
+// ===== ͼƬ =====
+// ·Ϊ PNGߴԶڴڡ·ΧűõͼƬߴ磬һƬĸ߶ȷִ
+// ͬһŵƬɸ̷ֱ߳ƵԼ wxImage ϣ wxGraphicsContextϵͳλͼ
+// õǻ DrawGate/DrawShapeһŻ˲ѹд PNGڴֻһƬ
+const int IMAGE_TILE_SIZE = 512;
+const int IMAGE_MARGIN = 20;
+const int IMAGE_MAX_SIDE = 1 << 20;
+
+uint32_t Crc32(uint32_t crc, const unsigned char* data, size_t size) {
+    static const std::vector<uint32_t> table = []() {
+        std::vector<uint32_t> t(256);
+        for (uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// д 8 λ RGB  PNG zlib ѹг IDAT 
+class PngStreamWriter {
+public:
+    ~PngStreamWriter() { m_zlib.reset(); }
+
+    bool Open(const wxString& filename, int width, int height) {
+        m_file.open(filename.ToStdString(), std::ios::binary);
+        if (!m_file.is_open()) return false;
+        m_width = width;
+        static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        m_file.write((const char*)signature, sizeof(signature));
+        std::string header;
+        AppendBigEndian(header, (uint32_t)width);
+        AppendBigEndian(header, (uint32_t)height);
+        header += (char)8;   // λ
+        header += (char)2;   // RGB
+        header.append(3, '\0');
+        WriteChunk("IHDR", header.data(), header.size());
+        m_idat.reset(new IdatStream(*this));
+        m_zlib.reset(new wxZlibOutputStream(*m_idat, wxZ_DEFAULT_COMPRESSION, wxZLIB_ZLIB));
+        m_previous.assign((size_t)width * 3, 0);
+        m_filtered.resize((size_t)width * 3 + 1);
+        return !m_file.fail();
+    }
+
+    // ÿ Sub  Up ˲ȡֵֵ֮ͽСһ
+    bool WriteRow(const unsigned char* rgb) {
+        size_t n = (size_t)m_width * 3;
+        long long subCost = 0, upCost = 0;
+        for (size_t i = 0; i < n; ++i) {
+            subCost += std::abs((signed char)(rgb[i] - (i >= 3 ? rgb[i - 3] : 0)));
+            upCost += std::abs((signed char)(rgb[i] - m_previous[i]));
+        }
+        bool up = upCost < subCost;
+        m_filtered[0] = up ? 2 : 1;
+        for (size_t i = 0; i < n; ++i) {
+            m_filtered[i + 1] = (unsigned char)(rgb[i] - (up ? m_previous[i] : i >= 3 ? rgb[i - 3] : 0));
+        }
+        std::memcpy(m_previous.data(), rgb, n);
+        m_zlib->Write(m_filtered.data(), m_filtered.size());
+        return m_zlib->IsOk() && !m_file.fail();
+    }
+
+    bool Close() {
+        bool ok = m_zlib->Close();
+        m_zlib.reset();
+        m_idat->Flush();
+        WriteChunk("IEND", nullptr, 0);
+        m_file.close();
+        return ok && !m_file.fail();
+    }
+
+private:
+    // ѹܵһСдһ IDAT 
+    class IdatStream : public wxOutputStream {
+    public:
+        explicit IdatStream(PngStreamWriter& png) : m_png(png) {}
+
+        void Flush() {
+            if (!m_buffer.empty()) m_png.WriteChunk("IDAT", m_buffer.data(), m_buffer.size());
+            m_buffer.clear();
+        }
+
+    protected:
+        size_t OnSysWrite(const void* buffer, size_t size) override {
+            m_buffer.append((const char*)buffer, size);
+            if (m_buffer.size() >= (256 << 10)) Flush();
+            return size;
+        }
+
+    private:
+        PngStreamWriter& m_png;
+        std::string m_buffer;
+    };
+
+    static void AppendBigEndian(std::string& out, uint32_t v) {
+        for (int shift = 24; shift >= 0; shift -= 8) out += (char)((v >> shift) & 0xFF);
+    }
+
+    void WriteChunk(const char* type, const char* data, size_t size) {
+        std::string head;
+        AppendBigEndian(head, (uint32_t)size);
+        head.append(type, 4);
+        uint32_t crc = Crc32(0, (const unsigned char*)type, 4);
+        crc = Crc32(crc, (const unsigned char*)data, size);
+        std::string tail;
+        AppendBigEndian(tail, crc);
+        m_file.write(head.data(), head.size());
+        m_file.write(data, size);
+        m_file.write(tail.data(), tail.size());
+    }
+
+    std::ofstream m_file;
+    int m_width = 0;
+    std::unique_ptr<IdatStream> m_idat;
+    std::unique_ptr<wxZlibOutputStream> m_zlib;
+    std::vector<unsigned char> m_previous;
+    std::vector<unsigned char> m_filtered;
+};
+
+bool IsSvgFileName(const wxString& filename) {
+    return filename.Lower().EndsWith(".svg");
+}
+
+// ΧźʵʻķΧ߾࣬յ·ؿվΣgateExtents ÿŵķΧ
+wxRect GetCircuitExtent(const CircuitSnapshot& snapshot, std::vector<wxRect>* gateExtents = nullptr) {
+    wxRect extent;
+    if (gateExtents) gateExtents->resize(snapshot.gates.size());
+    for (size_t i = 0; i < snapshot.gates.size(); ++i) {
+        wxRect r = GetGateDrawExtent(snapshot.gates.Type(i), snapshot.gates.Pos(i), snapshot.gates.Properties(i));
+        if (gateExtents) (*gateExtents)[i] = r;
+        extent = extent.IsEmpty() ? r : extent.Union(r);
+    }
+    for (const Wire& w : snapshot.wires) {
+        wxRect r = GetWireExtent(w);
+        extent = extent.IsEmpty() ? r : extent.Union(r);
+    }
+    if (!extent.IsEmpty()) extent.Inflate(IMAGE_MARGIN, IMAGE_MARGIN);
+    return extent;
+}
+
+// scale Ϊ߼λ֮ȣsize ͼƬߴ
+bool ExportCircuitImage(const CircuitSnapshot& snapshot, const wxString& filename, double scale,
+    BackgroundJob* job, wxString& error, wxSize* size = nullptr) {
+    const GateStore& gates = snapshot.gates;
+    const std::vector<Wire>& wires = snapshot.wires;
+    std::vector<wxRect> gateExtent;
+    wxRect extent = GetCircuitExtent(snapshot, &gateExtent);
+    if (extent.IsEmpty()) {
+        error = "û";
+        return false;
+    }
+    double width = std::ceil(extent.width * scale), height = std::ceil(extent.height * scale);
+    if (scale <= 0 || width > IMAGE_MAX_SIDE || height > IMAGE_MAX_SIDE) {
+        error = wxString::Format("ͼƬߴ %.0f x %.0f Χ", width, height);
+        return false;
+    }
+    int w = (int)width, h = (int)height;
+    if (size) *size = wxSize(w, h);
+
+    // ź߰طΧֵǵƬ
+    int cols = (w + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE, rows = (h + IMAGE_TILE_SIZE - 1) / IMAGE_TILE_SIZE;
+    std::vector<std::vector<uint32_t>> tileGates((size_t)cols * rows), tileWires((size_t)cols * rows);
+    auto assign = [&](const wxRect& r, uint32_t index, std::vector<std::vector<uint32_t>>& tiles) {
+        int c0 = std::max(0, (int)((r.GetLeft() - extent.x) * scale) / IMAGE_TILE_SIZE);
+        int r0 = std::max(0, (int)((r.GetTop() - extent.y) * scale) / IMAGE_TILE_SIZE);
+        int c1 = std::min(cols - 1, (int)((r.GetRight() + 1 - extent.x) * scale) / IMAGE_TILE_SIZE);
+        int r1 = std::min(rows - 1, (int)((r.GetBottom() + 1 - extent.y) * scale) / IMAGE_TILE_SIZE);
+        for (int y = r0; y <= r1; ++y) {
+            for (int x = c0; x <= c1; ++x) tiles[(size_t)y * cols + x].push_back(index);
+        }
+    };
+    for (size_t i = 0; i < gates.size(); ++i) assign(gateExtent[i], (uint32_t)i, tileGates);
+    for (size_t k = 0; k < wires.size(); ++k) assign(GetWireExtent(wires[k]), (uint32_t)k, tileWires);
+    std::vector<wxRect>().swap(gateExtent);
+
+    PngStreamWriter png;
+    if (!png.Open(filename, w, h)) {
+        error = "޷ļ: " + filename;
+        return false;
+    }
+    auto drawTile = [&](int row, int col, wxImage& image) {
+        int x0 = col * IMAGE_TILE_SIZE, y0 = row * IMAGE_TILE_SIZE;
+        int tw = std::min(IMAGE_TILE_SIZE, w - x0), th = std::min(IMAGE_TILE_SIZE, h - y0);
+        image = wxImage(tw, th, false);
+        std::memset(image.GetData(), 255, (size_t)tw * th * 3);
+        wxGCDC dc(wxGraphicsContext::Create(image));
+        dc.SetUserScale(scale, scale);
+        dc.SetLogicalOrigin(extent.x, extent.y);
+        dc.SetDeviceOrigin(-x0, -y0);
+        dc.SetPen(wxPen(wxColour(0, 0, 0)));
+        dc.SetBrush(wxBrush(wxColour(255, 255, 255)));
+        size_t t = (size_t)row * cols + col;
+        for (uint32_t i : tileGates[t]) MyDrawPanel::DrawGate(dc, gates.Type(i), gates.Pos(i), gates.Properties(i));
+        for (uint32_t k : tileWires[t]) dc.DrawLines((int)wires[k].points.size(), wires[k].points.data());
+    };
+
+    std::vector<wxImage> band(cols);
+    std::vector<unsigned char> line((size_t)w * 3);
+    unsigned threads = (unsigned)std::min<int>(std::max(1u, std::thread::hardware_concurrency()), cols);
+    for (int row = 0; row < rows; ++row) {
+        if (job && job->IsCancelled()) {
+            png.Close();
+            wxRemoveFile(filename);
+            error = "ȡ";
+            return false;
+        }
+        std::atomic<int> next(0);
+        auto worker = [&]() {
+            for (int col = next++; col < cols; col = next++) drawTile(row, col, band[col]);
+        };
+        std::vector<std::thread> pool;
+        for (unsigned t = 1; t < threads; ++t) pool.emplace_back(worker);
+        worker();
+        for (auto& t : pool) t.join();
+
+        // һƬƴд
+        int th = band[0].GetHeight();
+        for (int y = 0; y < th; ++y) {
+            for (int col = 0; col < cols; ++col) {
+                int tw = band[col].GetWidth();
+                std::memcpy(&line[(size_t)col * IMAGE_TILE_SIZE * 3], band[col].GetData() + (size_t)y * tw * 3, (size_t)tw * 3);
+            }
+            if (!png.WriteRow(line.data())) break;
+        }
+        if (job) job->ReportProgress((row + 1.0) / rows);
+    }
+    if (!png.Close()) {
+        wxRemoveFile(filename);
+        error = "дļʧ: " + filename;
+        return false;
+    }
+    return true;
+}
+
+// ʸÿõͼֻ <defs> дһ <symbol>ÿһ <use>
+//  <polyline>ļСȾֻʵйأɱд
+class SvgCircuitWriter {
+public:
+    explicit SvgCircuitWriter(std::ostream& out) : m_out(out) {
+        m_buffer.reserve(FLUSH_SIZE + 4096);
+    }
+
+    bool Write(const CircuitSnapshot& snapshot, const wxRect& extent, BackgroundJob* job) {
+        const GateStore& gates = snapshot.gates;
+        size_t n = gates.size();
+        m_buffer += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+        m_buffer += "<svg xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\"";
+        Format(" width=\"%d\" height=\"%d\" viewBox=\"%d %d %d %d\">\n",
+            extent.width, extent.height, extent.x, extent.y, extent.width, extent.height);
+        m_buffer += "<style>g{stroke:#000;fill:#fff}text{stroke:none;fill:#000;font:12px sans-serif;"
+            "dominant-baseline:hanging}.p{fill:#646464;font-size:11px}.a,polyline{fill:none}</style>\n";
+        Format("<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#fff\"/>\n",
+            extent.x, extent.y, extent.width, extent.height);
+
+        // ״γֵ˳õͱ
+        std::unordered_map<int, int> symbols;
+        m_buffer += "<defs>\n";
+        for (size_t i = 0; i < n; ++i) {
+            if (symbols.emplace(gates.TypeId(i), (int)symbols.size()).second) {
+                WriteSymbol((int)symbols.size() - 1, gates.Type(i));
+            }
+        }
+        m_buffer += "</defs>\n<g>\n";
+
+        for (size_t i = 0; i < n; ++i) {
+            const wxPoint& pos = gates.Pos(i);
+            Format("<use xlink:href=\"#s%d\" x=\"%d\" y=\"%d\"/>\n", symbols[gates.TypeId(i)], pos.x, pos.y);
+            // ı뻭һ£д·
+            int yOffset = 70;
+            for (const Property& prop : gates.Properties(i)) {
+                Format("<text class=\"p\" x=\"%d\" y=\"%d\">", pos.x, pos.y + yOffset);
+                Escape(wxString::Format("%s: %s", prop.GetName(), prop.GetValueString()));
+                m_buffer += "</text>\n";
+                yOffset += 12;
+            }
+            if (m_buffer.size() >= FLUSH_SIZE && !Flush()) return false;
+            if (job && i % 4096 == 0) {
+                if (job->IsCancelled()) return false;
+                job->ReportProgress(0.9 * i / n);
+            }
+        }
+        for (const Wire& w : snapshot.wires) {
+            m_buffer += "<polyline points=\"";
+            Points(w.points);
+            m_buffer += "\"/>\n";
+            if (m_buffer.size() >= FLUSH_SIZE && !Flush()) return false;
+        }
+        m_buffer += "</g>\n</svg>\n";
+        return Flush();
+    }
+
+private:
+    static const size_t FLUSH_SIZE = 1 << 20;
+
+    //  MyDrawPanel::DrawShape һһӦԭ㡣
+    // ڵ߳жȡ shapeLibrary readsDefinitions̲߳Ųͬʱ޸Ķ
+    void WriteSymbol(int id, const wxString& type) {
+        Format("<symbol id=\"s%d\" overflow=\"visible\">", id);
+        auto it = shapeLibrary.find(type);
+        if (it == shapeLibrary.end()) {
+            m_buffer += "<text x=\"0\" y=\"0\">δ֪</text>";
+        }
+        else {
+            for (const Shape& sh : it->second) WriteShape(sh);
+        }
+        m_buffer += "</symbol>\n";
+    }
+
+    void WriteShape(const Shape& sh) {
+        if (sh.type == ShapeType::Line && sh.pts.size() >= 2) {
+            Format("<line x1=\"%d\" y1=\"%d\" x2=\"%d\" y2=\"%d\"/>", sh.pts[0].x, sh.pts[0].y, sh.pts[1].x, sh.pts[1].y);
+        }
+        else if (sh.type == ShapeType::Polygon && sh.pts.size() >= 3) {
+            m_buffer += "<polygon points=\"";
+            Points(sh.pts);
+            m_buffer += "\"/>";
+        }
+        else if (sh.type == ShapeType::Circle) {
+            Format("<circle cx=\"%d\" cy=\"%d\" r=\"%d\"/>", sh.center.x, sh.center.y, sh.radius);
+        }
+        else if (sh.type == ShapeType::Arc) {
+            // wxDC ĽǶȴ 3 ӷʱƣy £ֹͬʱԲ
+            int sweep = ((sh.endAngle - sh.startAngle) % 360 + 360) % 360;
+            if (sweep == 0) {
+                Format("<circle cx=\"%d\" cy=\"%d\" r=\"%d\"/>", sh.center.x, sh.center.y, sh.radius);
+                return;
+            }
+            const double rad = 3.14159265358979323846 / 180;
+            Format("<path class=\"a\" d=\"M%.2f %.2fA%d %d 0 %d 0 %.2f %.2f\"/>",
+                sh.center.x + sh.radius * std::cos(sh.startAngle * rad), sh.center.y - sh.radius * std::sin(sh.startAngle * rad),
+                sh.radius, sh.radius, sweep > 180 ? 1 : 0,
+                sh.center.x + sh.radius * std::cos(sh.endAngle * rad), sh.center.y - sh.radius * std::sin(sh.endAngle * rad));
+        }
+        else if (sh.type == ShapeType::Text) {
+            Format("<text x=\"%d\" y=\"%d\">", sh.center.x, sh.center.y);
+            Escape(sh.text);
+            m_buffer += "</text>";
+        }
+    }
+
+    void Points(const std::vector<wxPoint>& pts) {
+        for (size_t k = 0; k < pts.size(); ++k) {
+            Format(k ? " %d,%d" : "%d,%d", pts[k].x, pts[k].y);
+        }
+    }
+
+    void Format(const char* format, ...) {
+        char text[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(text, sizeof(text), format, args);
+        va_end(args);
+        m_buffer.append(text, std::min<size_t>(len, sizeof(text) - 1));
     }
 
-    void OnKeyDown(wxKeyEvent& evt) {
-        switch (evt.GetKeyCode()) {
-        case WXK_DELETE:
-        case WXK_BACK:
-            if (m_selectedIndex >= 0) {
-                DeleteSelected();
-            }
-            else if (m_selectedWireIndex >= 0) {
-                DeleteSelectedWire();
+    void Escape(const wxString& text) {
+        std::string utf8(text.ToUTF8().data());
+        for (const char* c = utf8.c_str(); *c; ++c) {
+            switch (*c) {
+            case '&': m_buffer += "&amp;"; break;
+            case '<': m_buffer += "&lt;"; break;
+            case '>': m_buffer += "&gt;"; break;
+            default: m_buffer += *c;
             }
-            break;
-        case 'P':
-        case 'p':
-            if (evt.ControlDown()) {
-                EditSelectedProperties();
-            }
-            break;
-        default:
-            evt.Skip();
-            break;
         }
     }
+
+    bool Flush() {
+        m_out.write(m_buffer.data(), m_buffer.size());
+        m_buffer.clear();
+        return !m_out.fail();
+    }
+
+    std::ostream& m_out;
+    std::string m_buffer;
 };
 
+bool ExportCircuitSvg(const CircuitSnapshot& snapshot, const wxString& filename, BackgroundJob* job,
+    wxString& error, wxSize* size = nullptr) {
+    wxRect extent = GetCircuitExtent(snapshot);
+    if (extent.IsEmpty()) {
+        error = "û";
+        return false;
+    }
+    if (size) *size = extent.GetSize();
+    std::ofstream f(filename.ToStdString(), std::ios::binary);
+    if (!f.is_open()) {
+        error = "޷ļ: " + filename;
+        return false;
+    }
+    bool written = SvgCircuitWriter(f).Write(snapshot, extent, job);
+    f.close();
+    if (!written || f.fail()) {
+        wxRemoveFile(filename);
+        error = job && job->IsCancelled() ? wxString("ȡ") : "дļʧ: " + filename;
+        return false;
+    }
+    return true;
+}
+
 // =====  =====
 class MyFrame : public wxFrame {
 public:
@@ -830,15 +8797,35 @@ public:
 private:
     MyDrawPanel* m_drawPanel;
     wxTreeCtrl* m_treeCtrl;
+    wxTreeItemId m_subcircuitRoot;  // ӵ·ڵķ֧
     wxSplitterWindow* m_splitter;
     wxString m_currentFile;
 
+    // ڵĸƻ壻ճʱÿƫһ
+    ClipboardContent m_clipboard;
+    int m_pasteCount = 0;
+
+    // ǰĺ̨ͬһʱֻһ
+    std::unique_ptr<BackgroundJob> m_job;
+
+    // ̨棻ٴαʱļдٱ
+    std::unique_ptr<BackgroundJob> m_saveJob;
+    wxString m_pendingSave;
+    bool m_saveFailed = false;      // һαʧܣ˳ʱָ־
+    bool m_compactJson = false;     // JSON ļԼΪʽ֮һ
+
+    // ༭־ʱѻ޸׷ӵָĿ¼˳ʱɾ
+    std::unique_ptr<EditJournal> m_journal;
+    wxTimer m_journalTimer;
+    bool m_journalWarned = false;
+
     // ջ
     std::stack<MyDrawPanel::DrawPanelState> undoStack;
     std::stack<MyDrawPanel::DrawPanelState> redoStack;
 
     void OnNew(wxCommandEvent& event);
     void OnOpen(wxCommandEvent& event);
+    void OnOpenTiled(wxCommandEvent& event);
     void OnSave(wxCommandEvent& event);
     void OnSaveAs(wxCommandEvent& event);
     void OnQuit(wxCommandEvent& event);
@@ -852,19 +8839,47 @@ private:
     void OnZoomout(wxCommandEvent& event);
     void OnToggleStatusBar(wxCommandEvent& event);
     void OnToggleGrid(wxCommandEvent& event);
+    void OnToggleCompactJson(wxCommandEvent& event);
+    void OnTogglePower(wxCommandEvent& event);
+    void OnToggleProfiler(wxCommandEvent& event);
+    void OnExportTrace(wxCommandEvent& event);
     void OnDeleteSelected(wxCommandEvent& event);
     void OnDeleteWire(wxCommandEvent& event);
     void OnEditProperties(wxCommandEvent& event);
+    void OnBulkEditProperties(wxCommandEvent& event);
+    void OnCreateSubcircuit(wxCommandEvent& event);
+    void OnToggleAnalysis(wxCommandEvent& event);
+    void OnFaultSimulation(wxCommandEvent& event);
+    void OnCompileBenchmark(wxCommandEvent& event);
+    void OnExportNetlist(wxCommandEvent& event);
+    void OnExportImage(wxCommandEvent& event);
+    void OnImportNetlist(wxCommandEvent& event);
+    void OnAutoLayout(wxCommandEvent& event);
+    void OnAutoRoute(wxCommandEvent& event);
+    void OnClockStep(wxCommandEvent& event);
+    void OnCycleSimulation(wxCommandEvent& event);
+    void OnExportKernel(wxCommandEvent& event);
+    void OnCancelJob(wxCommandEvent& event);
+    void OnBackgroundJob(wxThreadEvent& event);
+    void OnSaveJob(wxThreadEvent& event);
+    void OnJournalTimer(wxTimerEvent& event);
+    void OnClose(wxCloseEvent& event);
+    void ShowFaultReport(const LevelizedNetlist& netlist, const FaultSimReport& report);
     void OnAbout(wxCommandEvent& event);
 
     // 浱ǰ״̬ջ
     void SaveStateForUndo();
+    // ̨ȡӵ·ʱ򴴽壬 false ʾ
+    bool CanChangeDefinitions(const wxString& title);
 
     // Զ¼
     void OnCustomEvent(wxCommandEvent& event);
 
     void DoSave(const wxString& filename);
+    void FinishSaveJob();
+    void StartJournal();
     void UpdateTitle();
+    void AddSubcircuitItems(const std::vector<wxString>& names);
 
     wxDECLARE_EVENT_TABLE();
 };
@@ -873,6 +8888,7 @@ private:
 wxBEGIN_EVENT_TABLE(MyFrame, wxFrame)
 EVT_MENU(wxID_NEW, MyFrame::OnNew)
 EVT_MENU(wxID_OPEN, MyFrame::OnOpen)
+EVT_MENU(ID_OPEN_TILED, MyFrame::OnOpenTiled)
 EVT_MENU(wxID_SAVE, MyFrame::OnSave)
 EVT_MENU(wxID_SAVEAS, MyFrame::OnSaveAs)
 EVT_MENU(wxID_EXIT, MyFrame::OnQuit)
@@ -886,11 +8902,31 @@ EVT_MENU(wxID_ZOOM_IN, MyFrame::OnZoomin)
 EVT_MENU(wxID_ZOOM_OUT, MyFrame::OnZoomout)
 EVT_MENU(ID_SHOW_STATUSBAR, MyFrame::OnToggleStatusBar)
 EVT_MENU(ID_SHOW_GRID, MyFrame::OnToggleGrid)
+EVT_MENU(ID_COMPACT_JSON, MyFrame::OnToggleCompactJson)
+EVT_MENU(ID_SHOW_POWER, MyFrame::OnTogglePower)
+EVT_MENU(ID_SHOW_PROFILER, MyFrame::OnToggleProfiler)
+EVT_MENU(ID_EXPORT_TRACE, MyFrame::OnExportTrace)
 EVT_MENU(ID_DELETE_SELECTED, MyFrame::OnDeleteSelected)
 EVT_MENU(ID_DELETE_WIRE, MyFrame::OnDeleteWire)
 EVT_MENU(ID_EDIT_PROPERTIES, MyFrame::OnEditProperties)
+EVT_MENU(ID_BULK_EDIT_PROPERTIES, MyFrame::OnBulkEditProperties)
+EVT_MENU(ID_CREATE_SUBCIRCUIT, MyFrame::OnCreateSubcircuit)
+EVT_MENU(ID_TOGGLE_ANALYSIS, MyFrame::OnToggleAnalysis)
+EVT_MENU(ID_FAULT_SIMULATION, MyFrame::OnFaultSimulation)
+EVT_MENU(ID_COMPILE_BENCHMARK, MyFrame::OnCompileBenchmark)
+EVT_MENU(ID_EXPORT_NETLIST, MyFrame::OnExportNetlist)
+EVT_MENU(ID_EXPORT_IMAGE, MyFrame::OnExportImage)
+EVT_MENU(ID_IMPORT_NETLIST, MyFrame::OnImportNetlist)
+EVT_MENU(ID_AUTO_LAYOUT, MyFrame::OnAutoLayout)
+EVT_MENU(ID_AUTO_ROUTE, MyFrame::OnAutoRoute)
+EVT_MENU(ID_CLOCK_STEP, MyFrame::OnClockStep)
+EVT_MENU(ID_CYCLE_SIMULATION, MyFrame::OnCycleSimulation)
+EVT_MENU(ID_EXPORT_KERNEL, MyFrame::OnExportKernel)
+EVT_MENU(ID_CANCEL_JOB, MyFrame::OnCancelJob)
 
 EVT_MENU(wxID_ABOUT, MyFrame::OnAbout)
+EVT_TIMER(ID_JOURNAL_TIMER, MyFrame::OnJournalTimer)
+EVT_CLOSE(MyFrame::OnClose)
 
 // Զ¼
 EVT_COMMAND(wxID_ANY, MY_CUSTOM_EVENT, MyFrame::OnCustomEvent)
@@ -906,6 +8942,11 @@ MyFrame::MyFrame(const wxString& title)
     menuFile->Append(wxID_OPEN, "&Open...\tCtrl-O");
     menuFile->Append(wxID_SAVE, "&Save\tCtrl-S");
     menuFile->Append(wxID_SAVEAS, "Save &As...");
+    menuFile->AppendCheckItem(ID_COMPACT_JSON, " JSON ()");
+    menuFile->Append(ID_OPEN_TILED, "· (Ƭļ)...\tCtrl-Shift-O");
+    menuFile->Append(ID_IMPORT_NETLIST, " (Verilog/BLIF)...");
+    menuFile->Append(ID_EXPORT_NETLIST, " (Verilog/BLIF)...");
+    menuFile->Append(ID_EXPORT_IMAGE, "ͼƬ (PNG/SVG)...");
     menuFile->AppendSeparator();
     menuFile->Append(wxID_EXIT, "E&xit\tAlt-F4");
 
@@ -917,14 +8958,32 @@ MyFrame::MyFrame(const wxString& title)
     menuEdit->Append(wxID_PASTE, "&Paste\tCtrl-V");
     menuEdit->AppendSeparator();
     menuEdit->Append(ID_EDIT_PROPERTIES, "༭\tCtrl-P");
+    menuEdit->Append(ID_BULK_EDIT_PROPERTIES, "...\tCtrl-Shift-P");
     menuEdit->Append(ID_DELETE_SELECTED, "ɾ\tDel");
     menuEdit->Append(ID_DELETE_WIRE, "ɾ\tShift-Del");
+    menuEdit->AppendSeparator();
+    menuEdit->Append(ID_CREATE_SUBCIRCUIT, "ӵ·...\tCtrl-B");
 
     wxMenu* menuView = new wxMenu;
     menuView->Append(wxID_ZOOM_IN, "Zoom &In\tCtrl-+");
     menuView->Append(wxID_ZOOM_OUT, "Zoom &Out\tCtrl--");
     menuView->AppendCheckItem(ID_SHOW_STATUSBAR, "Show Status Bar")->Check(true);
     menuView->AppendCheckItem(ID_SHOW_GRID, "Show &Grid\tCtrl-G")->Check(true);
+    menuView->AppendCheckItem(ID_SHOW_POWER, "Show &Power Heatmap\tCtrl-H");
+    menuView->AppendCheckItem(ID_SHOW_PROFILER, "\tF3");
+
+    wxMenu* menuTools = new wxMenu;
+    menuTools->AppendCheckItem(ID_TOGGLE_ANALYSIS, "߼/ʱ\tF5");
+    menuTools->Append(ID_FAULT_SIMULATION, "Ϸ...\tF6");
+    menuTools->Append(ID_COMPILE_BENCHMARK, "²\tF7");
+    menuTools->Append(ID_CLOCK_STEP, "ʱӵ\tF8");
+    menuTools->Append(ID_CYCLE_SIMULATION, "ڷ...\tF9");
+    menuTools->Append(ID_EXPORT_KERNEL, " C++ ں...");
+    menuTools->Append(ID_AUTO_LAYOUT, "Զ\tCtrl-L");
+    menuTools->Append(ID_AUTO_ROUTE, "Զ\tCtrl-R");
+    menuTools->Append(ID_EXPORT_TRACE, "׷...");
+    menuTools->AppendSeparator();
+    menuTools->Append(ID_CANCEL_JOB, "ȡ̨");
 
     wxMenu* menuHelp = new wxMenu;
     menuHelp->Append(wxID_ABOUT, "&About\tF1");
@@ -933,6 +8992,7 @@ MyFrame::MyFrame(const wxString& title)
     menuBar->Append(menuFile, "&File");
     menuBar->Append(menuEdit, "&Edit");
     menuBar->Append(menuView, "&View");
+    menuBar->Append(menuTools, "&Tools");
     menuBar->Append(menuHelp, "&Help");
     SetMenuBar(menuBar);
 
@@ -972,6 +9032,10 @@ MyFrame::MyFrame(const wxString& title)
     m_treeCtrl->AppendItem(root, "BUFFER");
     m_treeCtrl->AppendItem(root, "LED");
     m_treeCtrl->AppendItem(root, "");
+    m_treeCtrl->AppendItem(root, "CLOCK");
+    m_treeCtrl->AppendItem(root, "DFF");
+    m_treeCtrl->AppendItem(root, "LATCH");
+    m_subcircuitRoot = m_treeCtrl->AppendItem(root, "ӵ·");
     m_treeCtrl->Expand(root);
 
     // Ҳͼ
@@ -979,10 +9043,16 @@ MyFrame::MyFrame(const wxString& title)
 
     m_splitter->SplitVertically(m_treeCtrl, m_drawPanel, 200);
 
+    // ̨ĽȺ֪ͨ
+    Bind(BACKGROUND_JOB_EVENT, &MyFrame::OnBackgroundJob, this);
+
     // οؼ¼
     m_treeCtrl->Bind(wxEVT_TREE_ITEM_ACTIVATED, [this](wxTreeEvent& evt) {
         wxString itemText = m_treeCtrl->GetItemText(evt.GetItem());
-        if (itemText != "") {
+        if (m_drawPanel->IsBrowsing()) {
+            SetStatusText("ģʽ²ܱ༭");
+        }
+        else if (itemText != "" && evt.GetItem() != m_subcircuitRoot) {
             // ״̬ڳ
             SaveStateForUndo();
             m_drawPanel->AddShape(itemText);
@@ -990,6 +9060,9 @@ MyFrame::MyFrame(const wxString& title)
         });
 
     UpdateTitle();
+
+    // ʾѯǷָ
+    CallAfter([this]() { StartJournal(); });
 }
 
 void MyFrame::SaveStateForUndo() {
@@ -1018,200 +9091,860 @@ void MyFrame::OnNew(wxCommandEvent& event) {
     UpdateTitle();
 }
 
-void MyFrame::OnOpen(wxCommandEvent& event) {
-    SaveStateForUndo();
+void MyFrame::OnOpen(wxCommandEvent& event) {
+    if (!CanChangeDefinitions("򿪵·ͼ")) return;
+    SaveStateForUndo();
+
+    wxFileDialog openFileDialog(this, "򿪵·ͼ", "", "",
+        "Circuit files (*.json;*.ctb;*.gz)|*.json;*.ctb;*.gz", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (openFileDialog.ShowModal() == wxID_CANCEL) return;
+
+    wxString filename = openFileDialog.GetPath();
+    auto t0 = std::chrono::steady_clock::now();
+    ScopedTimer timer(ProfileZone::FileIO);
+    std::vector<Gate> gates;
+    std::vector<Wire> wires;
+    std::vector<wxString> added;
+    wxString error;
+    bool ok = ReadCircuitFile(filename, gates, wires, added, error);
+    AddSubcircuitItems(added);
+    if (!ok) {
+        wxLogError("%s", error);
+        return;
+    }
+
+    size_t count = gates.size();
+    m_drawPanel->SetCircuit(std::move(gates), std::move(wires));
+    m_currentFile = filename;
+    UpdateTitle();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    SetStatusText(wxString::Format("Ѵ %zu , ʱ %.0f ms", count, ms));
+}
+
+// ֻƬļȫƽʱȡݲ볷ջ
+void MyFrame::OnOpenTiled(wxCommandEvent& event) {
+    if (!CanChangeDefinitions("·")) return;
+    wxFileDialog openFileDialog(this, "·", "", "",
+        "Tiled circuit files (*.ctb;*.ctb.gz)|*.ctb;*.ctb.gz", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (openFileDialog.ShowModal() == wxID_CANCEL) return;
+
+    wxString filename = openFileDialog.GetPath();
+    auto t0 = std::chrono::steady_clock::now();
+    ScopedTimer timer(ProfileZone::FileIO);
+    std::unique_ptr<TiledCircuitFile> file(new TiledCircuitFile);
+    std::vector<wxString> added;
+    wxString error;
+    bool ok = file->Open(filename, added, error);
+    AddSubcircuitItems(added);
+    if (!ok) {
+        wxLogError("%s", error);
+        return;
+    }
+
+    size_t gates = file->GetGateCount(), tiles = file->GetTileCount();
+    // 뿪ģʽصǰϵĵ·Ѿʱѹջ
+    if (!m_drawPanel->IsBrowsing()) SaveStateForUndo();
+    m_drawPanel->SetTiledCircuit(std::move(file));
+    m_currentFile.clear();
+    UpdateTitle();
+    SetTitle("·ͼ༭ -  " + filename);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    SetStatusText(wxString::Format("ģʽ(ֻ, ϶ƽ): %zu , %zu Ƭ, ʱ %.0f ms", gates, tiles, ms));
+}
+
+void MyFrame::OnSave(wxCommandEvent& event) {
+    if (m_currentFile.empty()) {
+        OnSaveAs(event);
+    }
+    else {
+        DoSave(m_currentFile);
+    }
+}
+
+void MyFrame::OnSaveAs(wxCommandEvent& event) {
+    wxFileDialog saveFileDialog(this, "·ͼ", "", "",
+        "Circuit files (*.json)|*.json|Tiled circuit files (*.ctb)|*.ctb|"
+        "Compressed circuit files (*.json.gz)|*.json.gz|Compressed tiled circuit files (*.ctb.gz)|*.ctb.gz",
+        wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog.ShowModal() == wxID_CANCEL) return;
+
+    wxString filename = saveFileDialog.GetPath();
+    wxString format = StripCompressedExtension(filename).Lower();
+    if (!format.EndsWith(".json") && !format.EndsWith(".ctb")) {
+        const char* extensions[] = { ".json", ".ctb", ".json.gz", ".ctb.gz" };
+        int index = saveFileDialog.GetFilterIndex();
+        filename += extensions[index >= 0 && index < 4 ? index : 0];
+    }
+
+    DoSave(filename);
+}
+
+// ȡպں̨дļ治ȴʾ״̬
+void MyFrame::DoSave(const wxString& filename) {
+    if (m_drawPanel->IsBrowsing()) {
+        SetStatusText("ģʽµĵ·ֻ, \"\"ܱ༭ͱ");
+        return;
+    }
+    if (m_saveJob) {
+        m_pendingSave = filename;
+        SetStatusText("ڱ, ɺٱһ");
+        return;
+    }
+
+    auto snapshot = std::make_shared<CircuitSnapshot>();
+    {
+        ScopedTimer timer(ProfileZone::Undo);
+        snapshot->gates = m_drawPanel->GetGateSnapshot();
+        snapshot->wires = m_drawPanel->GetWires();
+        snapshot->subcircuits = GetSubcircuitDefinitions();
+    }
+    auto ok = std::make_shared<bool>(false);
+    auto error = std::make_shared<wxString>();
+
+    m_saveJob.reset(new BackgroundJob(this, "", ID_SAVE_JOB));
+    m_saveJob->onFinished = [this, filename, ok, error]() {
+        m_saveFailed = !*ok;
+        if (!*ok) {
+            wxLogError("%s", *error);
+            return;
+        }
+        m_currentFile = filename;
+        UpdateTitle();
+        SetStatusText("ѱ: " + filename);
+    };
+    bool compact = m_compactJson;
+    m_saveJob->Start([snapshot, filename, compact, ok, error](BackgroundJob& job) {
+        ScopedTimer timer(ProfileZone::FileIO);
+        if (StripCompressedExtension(filename).Lower().EndsWith(".ctb")) *ok = WriteTiledCircuitFile(*snapshot, filename, &job, *error);
+        else *ok = WriteCircuitFile(*snapshot, filename, &job, *error, compact);
+    });
+    SetStatusText(": 0%");
+}
+
+void MyFrame::OnSaveJob(wxThreadEvent& event) {
+    if (!m_saveJob) return;
+    if (!m_saveJob->IsDone()) {
+        SetStatusText(wxString::Format(": %d%%", event.GetInt()));
+        return;
+    }
+    FinishSaveJob();
+}
+
+// ȴǰٿʼŶӵı
+void MyFrame::FinishSaveJob() {
+    std::unique_ptr<BackgroundJob> job(std::move(m_saveJob));
+    job->Join();
+    if (job->onFinished) job->onFinished();
+    if (!m_pendingSave.empty()) {
+        wxString next;
+        next.swap(m_pendingSave);
+        DoSave(next);
+    }
+}
+
+void MyFrame::OnQuit(wxCommandEvent& event) { Close(true); }
+
+// ָĿ¼ϴµļʱѯǷָȻʼµı༭־
+void MyFrame::StartJournal() {
+    wxString dir = wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "recovery";
+    if (!wxFileName::DirExists(dir) && !wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL)) {
+        SetStatusText("޷ָĿ¼, Զδ");
+        return;
+    }
+
+    std::vector<Gate> gates;
+    std::vector<Wire> wires;
+    wxString file;
+    bool recovered = false;
+    if (EditJournal::HasRecoveryData(dir) &&
+        wxMessageBox("ϴδ˳ʱı༭¼, Ƿָ?", "ָ", wxYES_NO | wxICON_QUESTION, this) == wxYES) {
+        ScopedTimer timer(ProfileZone::FileIO);
+        std::vector<wxString> added;
+        wxString error;
+        recovered = EditJournal::Recover(dir, gates, wires, file, added, error);
+        AddSubcircuitItems(added);
+        if (!recovered) wxLogError("ָʧ: %s", error);
+    }
+
+    m_journal.reset(new EditJournal(dir));
+    m_drawPanel->SetJournal(m_journal.get());
+    if (recovered) {
+        m_drawPanel->SetCircuit(std::move(gates), std::move(wires));
+        m_currentFile = file;
+        SetStatusText("ѻָϴεı༭");
+    }
+    UpdateTitle();
+    m_journalTimer.SetOwner(this, ID_JOURNAL_TIMER);
+    m_journalTimer.Start(1000);
+}
+
+void MyFrame::OnJournalTimer(wxTimerEvent& event) {
+    if (!m_journal) return;
+    m_journal->Commit(m_drawPanel->GetGateSnapshot(), m_drawPanel->GetWires());
+    if (m_journal->HasFailed() && !m_journalWarned) {
+        m_journalWarned = true;
+        SetStatusText("дָļʧ, ޷ָ");
+    }
+}
+
+// ˳ʱҪָɾ༭־
+void MyFrame::OnClose(wxCloseEvent& event) {
+    // ̨ûдʱŶӵıҲһɣʧʱɾָ־
+    if (m_saveJob) {
+        wxBusyCursor wait;
+        SetStatusText("ڵȴ...");
+        while (m_saveJob) FinishSaveJob();
+    }
+    bool keepJournal = false;
+    if (m_saveFailed) {
+        wxLog::FlushActive();
+        if (event.CanVeto() && wxMessageBox("һαʧ, Ȼ˳?\nָ־ᱣ, ´ʱԻָ",
+            "˳", wxYES_NO | wxICON_WARNING, this) != wxYES) {
+            event.Veto();
+            return;
+        }
+        keepJournal = true;
+    }
+
+    m_journalTimer.Stop();
+    if (m_journal) {
+        m_drawPanel->SetJournal(nullptr);
+        // ־ʱȽʱûдһ޸ģд߳ʱд˳
+        if (keepJournal) m_journal->Commit(m_drawPanel->GetGateSnapshot(), m_drawPanel->GetWires());
+        else m_journal->Discard();
+        m_journal.reset();
+    }
+    event.Skip();
+}
+
+void MyFrame::OnUndo(wxCommandEvent& event) {
+    if (!undoStack.empty()) {
+        // 浱ǰ״̬ջģʽĵ·ڻ״̬ȥ
+        bool browsing = m_drawPanel->IsBrowsing();
+        if (!browsing) redoStack.push(m_drawPanel->GetState());
+        // ָһ״̬
+        m_drawPanel->SetState(undoStack.top());
+        undoStack.pop();
+        if (browsing) UpdateTitle();
+
+        // ²˵״̬
+        wxMenuBar* mb = GetMenuBar();
+        if (mb) {
+            mb->Enable(wxID_UNDO, !undoStack.empty());
+            mb->Enable(wxID_REDO, !redoStack.empty());
+        }
+
+        SetStatusText("ɹ");
+    }
+    else {
+        SetStatusText("ûпɳĲ");
+    }
+}
+
+void MyFrame::OnRedo(wxCommandEvent& event) {
+    if (!redoStack.empty()) {
+        // 浱ǰ״̬ջ
+        undoStack.push(m_drawPanel->GetState());
+        // ָ״̬
+        m_drawPanel->SetState(redoStack.top());
+        redoStack.pop();
+
+        // ²˵״̬
+        wxMenuBar* mb = GetMenuBar();
+        if (mb) {
+            mb->Enable(wxID_UNDO, !undoStack.empty());
+            mb->Enable(wxID_REDO, !redoStack.empty());
+        }
+
+        SetStatusText("ɹ");
+    }
+    else {
+        SetStatusText("ûпĲ");
+    }
+}
+
+void MyFrame::OnCopy(wxCommandEvent& event) {
+    if (!m_drawPanel->CopySelection(m_clipboard)) {
+        SetStatusText("ûѡе");
+        return;
+    }
+    m_pasteCount = 0;
+    if (wxTheClipboard->Open()) {
+        wxTheClipboard->SetData(new wxTextDataObject(wxString(m_clipboard.text)));
+        wxTheClipboard->Close();
+    }
+    SetStatusText(wxString::Format("Ѹ %zu , %zu ", m_clipboard.gates.size(), m_clipboard.wires.size()));
+}
+
+void MyFrame::OnPaste(wxCommandEvent& event) {
+    // ϵͳıڻͬʱֱʹû壬壨һڣ
+    if (wxTheClipboard->Open()) {
+        std::string text;
+        if (wxTheClipboard->IsSupported(wxDF_TEXT)) {
+            wxTextDataObject data;
+            wxTheClipboard->GetData(data);
+            text = data.GetText().ToStdString();
+        }
+        wxTheClipboard->Close();
+        if (!text.empty() && text != m_clipboard.text) {
+            // ⲿܴӵ·
+            if (!CanChangeDefinitions("ճ")) return;
+            ClipboardContent clip;
+            std::vector<wxString> added;
+            wxString error;
+            bool ok = ClipboardFromText(text, clip, added, error);
+            AddSubcircuitItems(added);
+            if (!ok) {
+                SetStatusText(error);
+                return;
+            }
+            m_clipboard = std::move(clip);
+            m_pasteCount = 0;
+        }
+    }
+    if (m_clipboard.gates.empty() && m_clipboard.wires.empty()) {
+        SetStatusText("ûе·");
+        return;
+    }
+    if (m_drawPanel->IsBrowsing()) {
+        SetStatusText("ģʽ²ܱ༭");
+        return;
+    }
+
+    // ճֻ¼һγ
+    SaveStateForUndo();
+    int step = 2 * m_drawPanel->GetGridSize() * ++m_pasteCount;
+    m_drawPanel->PasteClipboard(m_clipboard, m_clipboard.origin + wxPoint(step, step));
+    SetStatusText(wxString::Format("ճ %zu , %zu ", m_clipboard.gates.size(), m_clipboard.wires.size()));
+}
+
+void MyFrame::OnZoomin(wxCommandEvent& event) { m_drawPanel->ZoomIn(); }
+void MyFrame::OnZoomout(wxCommandEvent& event) { m_drawPanel->ZoomOut(); }
+
+void MyFrame::OnToggleStatusBar(wxCommandEvent& event) {
+    wxMenuBar* mb = GetMenuBar();
+    wxMenuItem* item = mb->FindItem(ID_SHOW_STATUSBAR);
+    bool show = item->IsChecked();
+    GetStatusBar()->Show(show);
+    Layout();
+}
+
+void MyFrame::OnToggleGrid(wxCommandEvent& event) {
+    wxMenuBar* mb = GetMenuBar();
+    wxMenuItem* item = mb->FindItem(ID_SHOW_GRID);
+    bool show = item->IsChecked();
+    m_drawPanel->ToggleGrid();
+    item->Check(m_drawPanel->IsGridVisible());
+}
+
+void MyFrame::OnToggleCompactJson(wxCommandEvent& event) {
+    m_compactJson = event.IsChecked();
+    SetStatusText(m_compactJson ? " JSON ʱ" : " JSON ʱ 4 ");
+}
+
+void MyFrame::OnTogglePower(wxCommandEvent& event) {
+    m_drawPanel->TogglePowerMap();
+    wxMenuBar* mb = GetMenuBar();
+    if (mb) mb->Check(ID_SHOW_POWER, m_drawPanel->IsPowerMapVisible());
+}
+
+void MyFrame::OnToggleProfiler(wxCommandEvent& event) {
+    m_drawPanel->ToggleProfiler();
+    wxMenuBar* mb = GetMenuBar();
+    if (mb) mb->Check(ID_SHOW_PROFILER, m_drawPanel->IsProfilerVisible());
+}
+
+// ̼߳¼ļʱ¼ chrome://tracing  Perfetto в鿴
+void MyFrame::OnExportTrace(wxCommandEvent& event) {
+    wxFileDialog saveFileDialog(this, "׷", "", "circuit_trace.json",
+        "Chrome trace (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog.ShowModal() == wxID_CANCEL) return;
+
+    wxString error;
+    if (!Profiler::WriteChromeTrace(saveFileDialog.GetPath(), error)) {
+        wxLogError("׷ʧ: %s", error);
+        return;
+    }
+    SetStatusText("ѵ׷: " + saveFileDialog.GetPath());
+}
+
+void MyFrame::OnDeleteSelected(wxCommandEvent& event) {
+    SaveStateForUndo();
+    m_drawPanel->DeleteSelected();
+}
+
+void MyFrame::OnDeleteWire(wxCommandEvent& event) {
+    SaveStateForUndo();
+    m_drawPanel->DeleteSelectedWire();
+}
+
+void MyFrame::OnEditProperties(wxCommandEvent& event) {
+    SaveStateForUndo();
+    m_drawPanel->EditSelectedProperties();
+}
+
+// ѡеͬһֵһ޸ŵĴӳ
+void MyFrame::OnBulkEditProperties(wxCommandEvent& event) {
+    size_t count = m_drawPanel->GetSelectionCount();
+    if (count == 0) {
+        SetStatusText("ûѡе");
+        return;
+    }
+    wxString name = wxGetTextFromUser(":", "", "ӳ", this);
+    if (name.empty()) return;
+    const Property* current = nullptr;
+    try {
+        current = m_drawPanel->GetPrimaryProperty(PropertyStrings::Intern(name));
+    }
+    catch (const std::exception& e) {
+        wxLogError("%s", e.what());
+        return;
+    }
+    wxString value = wxGetTextFromUser(wxString::Format("Ϊ %zu  %s:", count, name), "",
+        current ? current->GetValueString() : wxString(), this);
+    if (value.empty()) return;
+
+    // ѡеͬԣûʱıƶϣֵֻһ
+    Property prop;
+    try {
+        prop = Property::Parse(name, value, current ? wxString(current->GetTypeName()) : GuessPropertyType(value));
+    }
+    catch (const std::exception& e) {
+        wxLogError("%s", e.what());
+        return;
+    }
+    SaveStateForUndo();
+    auto t0 = std::chrono::steady_clock::now();
+    m_drawPanel->SetPropertyOnSelection(prop);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    SetStatusText(wxString::Format("Ϊ %zu  %s = %s, ʱ %.1f ms", count, name, prop.GetValueString(), ms));
+}
+
+// ѻϵĵ·Ϊӵ·⣬һʵ滻ԭ
+void MyFrame::OnCreateSubcircuit(wxCommandEvent& event) {
+    if (!CanChangeDefinitions("ӵ·")) return;
+    std::vector<int> members, wireIndices;
+    m_drawPanel->CollectGroup(members, wireIndices);
+    if (members.empty()) {
+        SetStatusText("û");
+        return;
+    }
+    wxString name = wxGetTextFromUser("ӵ·:", "ӵ·", "", this);
+    if (name.empty()) return;
+
+    const std::vector<Gate>& allGates = m_drawPanel->GetGates();
+    const std::vector<Wire>& allWires = m_drawPanel->GetWires();
+    std::vector<Gate> gates;
+    std::vector<Wire> wires;
+    for (int g : members) gates.push_back(allGates[g]);
+    for (int w : wireIndices) wires.push_back(allWires[w]);
+
+    wxString error;
+    if (!DefineSubcircuit(name, gates, wires, false, error)) {
+        wxLogError("ӵ·ʧ: %s", error);
+        return;
+    }
+    AddSubcircuitItems(std::vector<wxString>(1, name));
+
+    SaveStateForUndo();
+    m_drawPanel->ReplaceWithInstance(members, wireIndices, name);
+    const SubcircuitDef& def = *subcircuitLibrary[name];
+    SetStatusText(wxString::Format("Ѵӵ· %s: %zu , %zu , %zu ",
+        name, def.net.kind.size(), def.inputs.size(), def.outputs.size()));
+}
+
+void MyFrame::AddSubcircuitItems(const std::vector<wxString>& names) {
+    for (auto& name : names) m_treeCtrl->AppendItem(m_subcircuitRoot, name);
+    if (!names.empty()) m_treeCtrl->Expand(m_subcircuitRoot);
+}
 
-    wxFileDialog openFileDialog(this, "򿪵·ͼ", "", "",
-        "Circuit files (*.json)|*.json", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
-    if (openFileDialog.ShowModal() == wxID_CANCEL) return;
+void MyFrame::OnToggleAnalysis(wxCommandEvent& event) {
+    m_drawPanel->ToggleAnalysis();
+    wxMenuBar* mb = GetMenuBar();
+    if (mb) mb->Check(ID_TOGGLE_ANALYSIS, m_drawPanel->IsAnalysisVisible());
+}
 
-    wxString filename = openFileDialog.GetPath();
-    std::ifstream f(filename.ToStdString());
-    if (!f.is_open()) {
-        wxLogError("޷ļ: %s", filename);
+void MyFrame::OnFaultSimulation(wxCommandEvent& event) {
+    if (m_job) {
+        wxMessageBox("к̨: " + m_job->GetName(), "Ϸ", wxOK | wxICON_INFORMATION, this);
         return;
     }
 
-    try {
-        json j;
-        f >> j;
+    wxFileDialog openFileDialog(this, "ѡļ", "", "",
+        "Vector files (*.vec;*.txt)|*.vec;*.txt", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (openFileDialog.ShowModal() == wxID_CANCEL) return;
 
-        std::vector<Gate> gates;
-        for (auto& gateJson : j["gates"]) {
-            Gate gate;
-            gate.type = gateJson["type"].get<std::string>();
-            gate.pos.x = gateJson["x"];
-            gate.pos.y = gateJson["y"];
-
-            // 
-            if (gateJson.find("properties") != gateJson.end()) {
-                for (auto& propJson : gateJson["properties"]) {
-                    Property prop;
-                    prop.name = propJson["name"].get<std::string>();
-                    prop.value = propJson["value"].get<std::string>();
-                    prop.type = propJson["type"].get<std::string>();
-                    gate.properties.push_back(prop);
-                }
-            }
+    auto vectors = std::make_shared<std::vector<std::vector<unsigned char>>>();
+    if (!LoadTestVectors(openFileDialog.GetPath(), *vectors) || vectors->empty()) {
+        wxLogError("޷ȡ: %s", openFileDialog.GetPath());
+        return;
+    }
 
-            gates.push_back(gate);
-        }
+    // չ鹤߳УڼԼ༭
+    auto netlist = std::make_shared<LevelizedNetlist>();
+    m_drawPanel->ExportNetlist(*netlist);
+    auto report = std::make_shared<FaultSimReport>();
 
-        m_drawPanel->SetGates(gates);
-        m_currentFile = filename;
-        UpdateTitle();
-    }
-    catch (const std::exception& e) {
-        wxLogError("ļʧ: %s", e.what());
-    }
+    m_job.reset(new BackgroundJob(this, "Ϸ"));
+    m_job->onFinished = [this, netlist, report]() {
+        ShowFaultReport(*netlist, *report);
+    };
+    m_job->Start([netlist, vectors, report](BackgroundJob& job) {
+        FaultSimulator simulator(*netlist);
+        simulator.EnumerateFaults();
+        *report = simulator.Run(*vectors, &job);
+    });
+    SetStatusText("Ϸ: 0%");
 }
 
-void MyFrame::OnSave(wxCommandEvent& event) {
-    if (m_currentFile.empty()) {
-        OnSaveAs(event);
-    }
-    else {
-        DoSave(m_currentFile);
+void MyFrame::OnCompileBenchmark(wxCommandEvent& event) {
+    if (m_job) {
+        wxMessageBox("к̨: " + m_job->GetName(), "", wxOK | wxICON_INFORMATION, this);
+        return;
     }
+
+    auto netlist = std::make_shared<LevelizedNetlist>();
+    m_drawPanel->ExportNetlist(*netlist);
+    // ÿֵʽԼǧ
+    size_t cycles = std::max<size_t>(100, std::min<size_t>(1000000, 20000000 / (netlist->kind.size() + 1)));
+    auto report = std::make_shared<CompileBenchReport>();
+
+    m_job.reset(new BackgroundJob(this, "²"));
+    m_job->onFinished = [this, report]() {
+        double speedup = report->interpretedCyclesPerSec > 0
+            ? report->compiledCyclesPerSec / report->interpretedCyclesPerSec : 0;
+        wxMessageBox(wxString::Format("ָ: %zu\nʱ: %.2f ms\n: %zu\n\n"
+            ": %.0f /\nŽ: %.0f /\nٱ: %.1fx%s",
+            report->instructions, report->compileMs, report->cycles,
+            report->compiledCyclesPerSec, report->interpretedCyclesPerSec, speedup,
+            report->cancelled ? "\n(ȡ)" : ""),
+            "", wxOK | wxICON_INFORMATION, this);
+    };
+    m_job->Start([netlist, cycles, report](BackgroundJob& job) {
+        *report = RunCompileBenchmark(*netlist, cycles, &job);
+    });
 }
 
-void MyFrame::OnSaveAs(wxCommandEvent& event) {
-    wxFileDialog saveFileDialog(this, "·ͼ", "", "",
-        "Circuit files (*.json)|*.json", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
-    if (saveFileDialog.ShowModal() == wxID_CANCEL) return;
+void MyFrame::OnClockStep(wxCommandEvent& event) {
+    m_drawPanel->ClockStep();
+    wxMenuBar* mb = GetMenuBar();
+    if (mb) mb->Check(ID_TOGGLE_ANALYSIS, m_drawPanel->IsAnalysisVisible());
+}
 
-    wxString filename = saveFileDialog.GetPath();
-    if (!filename.Lower().EndsWith(".json")) {
-        filename += ".json";
+void MyFrame::OnCycleSimulation(wxCommandEvent& event) {
+    if (m_job) {
+        wxMessageBox("к̨: " + m_job->GetName(), "ڷ", wxOK | wxICON_INFORMATION, this);
+        return;
     }
 
-    DoSave(filename);
+    long cycles = wxGetNumberFromUser("ӵǰ״̬ʼеʱ", ":", "ڷ",
+        1000000, 1, 100000000, this);
+    if (cycles <= 0) return;
+
+    auto netlist = std::make_shared<LevelizedNetlist>();
+    m_drawPanel->ExportNetlist(*netlist);
+    auto outputs = std::make_shared<std::vector<unsigned char>>();
+    auto toggles = std::make_shared<std::vector<uint64_t>>();
+    auto done = std::make_shared<long>(0);
+    auto seconds = std::make_shared<double>(0);
+
+    m_job.reset(new BackgroundJob(this, "ڷ"));
+    m_job->onFinished = [this, netlist, outputs, toggles, done, seconds]() {
+        wxString values;
+        for (unsigned char v : *outputs) values += v ? "1" : "0";
+        wxString message = wxString::Format(": %ld\nʱ: %.3f s\nٶ: %.0f /\n\n (˳): %s\n\n",
+            *done, *seconds, *seconds > 0 ? *done / *seconds : 0.0, values.empty() ? wxString("") : values);
+        if (m_drawPanel->SetSimulatedActivity(*netlist, *toggles, (size_t)*done)) {
+            const PowerReport& power = m_drawPanel->GetPowerReport();
+            message += wxString::Format("ת: %llu\n̬: %.3f uW (%g MHz, %.1f V)",
+                (unsigned long long)power.toggles, power.Power(), power.frequency, SUPPLY_VOLTAGE);
+        }
+        else {
+            message += "ڼ·ѱ޸, ûи¹Ĺƺͼ";
+        }
+        wxMessageBox(message, "ڷ", wxOK | wxICON_INFORMATION, this);
+    };
+    m_job->Start([netlist, cycles, outputs, toggles, done, seconds](BackgroundJob& job) {
+        CompiledCircuit circuit;
+        circuit.Compile(*netlist);
+        circuit.EnableActivity(true);
+        for (size_t i = 0; i < netlist->inputs.size(); ++i) {
+            circuit.SetInput(i, netlist->init[netlist->inputs[i]] != 0);
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        for (; *done < cycles; ++*done) {
+            if ((*done & 1023) == 0) {
+                if (job.IsCancelled()) break;
+                job.ReportProgress((double)*done / cycles);
+            }
+            circuit.Cycle();
+        }
+        *seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        for (size_t i = 0; i < circuit.GetOutputCount(); ++i) outputs->push_back(circuit.GetOutput(i) ? 1 : 0);
+        circuit.GetToggleCounts(*toggles);
+    });
 }
 
-void MyFrame::DoSave(const wxString& filename) {
-    json j;
-    j["version"] = "1.0";
-    j["type"] = "circuit";
-
-    std::vector<json> gatesJson;
-    for (auto& gate : m_drawPanel->GetGates()) {
-        json gateJson;
-        gateJson["type"] = gate.type.ToStdString();
-        gateJson["x"] = gate.pos.x;
-        gateJson["y"] = gate.pos.y;
-
-        // 
-        std::vector<json> propsJson;
-        for (auto& prop : gate.properties) {
-            json propJson;
-            propJson["name"] = prop.name.ToStdString();
-            propJson["value"] = prop.value.ToStdString();
-            propJson["type"] = prop.type.ToStdString();
-            propsJson.push_back(propJson);
-        }
-        gateJson["properties"] = propsJson;
+void MyFrame::OnExportKernel(wxCommandEvent& event) {
+    wxFileDialog saveFileDialog(this, " C++ ں", "", "circuit_kernel.cpp",
+        "C++ files (*.cpp)|*.cpp", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog.ShowModal() == wxID_CANCEL) return;
 
-        gatesJson.push_back(gateJson);
-    }
-    j["gates"] = gatesJson;
+    LevelizedNetlist netlist;
+    m_drawPanel->ExportNetlist(netlist);
+    CompiledCircuit circuit;
+    circuit.Compile(netlist);
 
+    wxString filename = saveFileDialog.GetPath();
     std::ofstream f(filename.ToStdString());
     if (!f.is_open()) {
         wxLogError("޷ļ: %s", filename);
         return;
     }
-
-    f << j.dump(4);
-    m_currentFile = filename;
-    UpdateTitle();
+    circuit.EmitCpp(f);
+    SetStatusText(wxString::Format("ѵں: %zu ָ", circuit.GetInstructionCount()));
 }
 
-void MyFrame::OnQuit(wxCommandEvent& event) { Close(true); }
+void MyFrame::OnExportNetlist(wxCommandEvent& event) {
+    wxFileDialog saveFileDialog(this, "", "", "circuit.v",
+        "Verilog files (*.v)|*.v|BLIF files (*.blif)|*.blif", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog.ShowModal() == wxID_CANCEL) return;
 
-void MyFrame::OnUndo(wxCommandEvent& event) {
-    if (!undoStack.empty()) {
-        // 浱ǰ״̬ջ
-        redoStack.push(m_drawPanel->GetState());
-        // ָһ״̬
-        m_drawPanel->SetState(undoStack.top());
-        undoStack.pop();
+    wxString filename = saveFileDialog.GetPath();
+    bool blif = filename.Lower().EndsWith(".blif") ||
+        (!filename.Lower().EndsWith(".v") && saveFileDialog.GetFilterIndex() == 1);
 
-        // ²˵״̬
-        wxMenuBar* mb = GetMenuBar();
-        if (mb) {
-            mb->Enable(wxID_UNDO, !undoStack.empty());
-            mb->Enable(wxID_REDO, !redoStack.empty());
-        }
+    auto t0 = std::chrono::steady_clock::now();
+    ScopedTimer timer(ProfileZone::FileIO);
+    LevelizedNetlist netlist;
+    m_drawPanel->ExportNetlist(netlist);
 
-        SetStatusText("ɹ");
+    std::ofstream f(filename.ToStdString(), std::ios::binary);
+    if (!f.is_open()) {
+        wxLogError("޷ļ: %s", filename);
+        return;
     }
-    else {
-        SetStatusText("ûпɳĲ");
+    std::string module = NetlistModuleName(wxFileName(filename).GetName());
+    if (blif) WriteBlif(netlist, module, f);
+    else WriteVerilog(netlist, module, f);
+    f.close();
+    if (f.fail()) {
+        wxLogError("дļʧ: %s", filename);
+        return;
     }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    SetStatusText(wxString::Format("ѵ %s : %zu , ʱ %.0f ms", blif ? "BLIF" : "Verilog", netlist.kind.size(), ms));
 }
 
-void MyFrame::OnRedo(wxCommandEvent& event) {
-    if (!redoStack.empty()) {
-        // 浱ǰ״̬ջ
-        undoStack.push(m_drawPanel->GetState());
-        // ָ״̬
-        m_drawPanel->SetState(redoStack.top());
-        redoStack.pop();
+// ں̨ƬƣͼƬߴ粻ܴںڴ
+void MyFrame::OnExportImage(wxCommandEvent& event) {
+    if (m_drawPanel->IsBrowsing()) {
+        SetStatusText("ģʽµĵ·ܵͼƬ, \"\"ٵ");
+        return;
+    }
+    if (m_job) {
+        wxMessageBox("к̨: " + m_job->GetName(), "ͼƬ", wxOK | wxICON_INFORMATION, this);
+        return;
+    }
 
-        // ²˵״̬
-        wxMenuBar* mb = GetMenuBar();
-        if (mb) {
-            mb->Enable(wxID_UNDO, !undoStack.empty());
-            mb->Enable(wxID_REDO, !redoStack.empty());
-        }
+    wxFileDialog saveFileDialog(this, "ͼƬ", "", "circuit",
+        "PNG files (*.png)|*.png|SVG files (*.svg)|*.svg", wxFD_SAVE | wxFD_OVERWRITE_PROMPT);
+    if (saveFileDialog.ShowModal() == wxID_CANCEL) return;
 
-        SetStatusText("ɹ");
+    wxString filename = saveFileDialog.GetPath();
+    if (!filename.Lower().EndsWith(".png") && !IsSvgFileName(filename)) {
+        filename += saveFileDialog.GetFilterIndex() == 1 ? ".svg" : ".png";
     }
-    else {
-        SetStatusText("ûпĲ");
+    // ʸͼҪű
+    bool svg = IsSvgFileName(filename);
+    long percent = 100;
+    if (!svg) {
+        percent = wxGetNumberFromUser("ͼƬ뻭߼ı", " (%):", "ͼƬ", 100, 10, 1000, this);
+        if (percent <= 0) return;
+    }
+    auto snapshot = std::make_shared<CircuitSnapshot>();
+    {
+        ScopedTimer timer(ProfileZone::Undo);
+        snapshot->gates = m_drawPanel->GetGateSnapshot();
+        snapshot->wires = m_drawPanel->GetWires();
     }
+    auto ok = std::make_shared<bool>(false);
+    auto error = std::make_shared<wxString>();
+    auto size = std::make_shared<wxSize>();
+    auto t0 = std::chrono::steady_clock::now();
+
+    m_job.reset(new BackgroundJob(this, "ͼƬ"));
+    m_job->readsDefinitions = true;
+    m_job->onFinished = [this, filename, ok, error, size, t0]() {
+        if (!*ok) {
+            wxLogError("%s", *error);
+            return;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        SetStatusText(wxString::Format("ѵͼƬ %s: %d x %d, ʱ %.0f ms", filename, size->x, size->y, ms));
+    };
+    m_job->Start([snapshot, filename, svg, percent, ok, error, size](BackgroundJob& job) {
+        ScopedTimer timer(ProfileZone::FileIO);
+        *ok = svg ? ExportCircuitSvg(*snapshot, filename, &job, *error, size.get())
+            : ExportCircuitImage(*snapshot, filename, percent / 100.0, &job, *error, size.get());
+    });
+    SetStatusText("ͼƬ: 0%");
 }
 
-void MyFrame::OnCopy(wxCommandEvent& event) {
-    // ʵ
+void MyFrame::OnImportNetlist(wxCommandEvent& event) {
+    wxFileDialog openFileDialog(this, "", "", "",
+        "Netlist files (*.v;*.blif)|*.v;*.blif", wxFD_OPEN | wxFD_FILE_MUST_EXIST);
+    if (openFileDialog.ShowModal() == wxID_CANCEL) return;
+
+    auto t0 = std::chrono::steady_clock::now();
+    ScopedTimer timer(ProfileZone::FileIO);
+    std::vector<Gate> gates;
+    std::vector<Wire> wires;
+    wxString error;
+    if (!ImportNetlist(openFileDialog.GetPath(), gates, wires, error)) {
+        wxLogError("ʧ: %s", error);
+        return;
+    }
+    SaveStateForUndo();
+    size_t count = gates.size();
+    m_drawPanel->SetCircuit(std::move(gates), std::move(wires));
+    m_currentFile.clear();
+    UpdateTitle();
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    SetStatusText(wxString::Format("ѵ %zu , ʱ %.0f ms", count, ms));
 }
 
-void MyFrame::OnPaste(wxCommandEvent& event) {
-    // ʵ
+void MyFrame::OnAutoLayout(wxCommandEvent& event) {
+    if (m_job) {
+        wxMessageBox("к̨: " + m_job->GetName(), "Զ", wxOK | wxICON_INFORMATION, this);
+        return;
+    }
+
+    auto pos = std::make_shared<std::vector<wxPoint>>();
+    auto height = std::make_shared<std::vector<int>>();
+    auto edges = std::make_shared<std::vector<LayoutEdge>>();
+    m_drawPanel->GetLayoutProblem(*pos, *height, *edges);
+    if (pos->empty()) {
+        SetStatusText("û");
+        return;
+    }
+    size_t wireCount = m_drawPanel->GetWires().size();
+    int gridSize = m_drawPanel->GetGridSize();
+    auto result = std::make_shared<LayoutResult>();
+    auto finished = std::make_shared<bool>(false);
+
+    // ڼԼ༭ʱ·ѱ޸
+    m_job.reset(new BackgroundJob(this, "Զ"));
+    m_job->onFinished = [this, pos, edges, result, finished, wireCount]() {
+        if (!*finished) return;
+        if (!m_drawPanel->IsUnchangedSince(*pos, wireCount)) {
+            SetStatusText("Զڼ·ѱ޸ģѷ");
+            return;
+        }
+        SaveStateForUndo();
+        m_drawPanel->ApplyLayout(result->pos, *edges);
+        SetStatusText(wxString::Format("Զ: %zu , ܳ %.0f -> %.0f",
+            pos->size(), result->wireLengthBefore, result->wireLengthAfter));
+    };
+    m_job->Start([pos, height, edges, result, finished, gridSize](BackgroundJob& job) {
+        AutoPlacer placer(*pos, *height, *edges, gridSize);
+        *finished = placer.Run(&job, *result);
+    });
+    SetStatusText("Զ: 0%");
 }
 
-void MyFrame::OnZoomin(wxCommandEvent& event) { m_drawPanel->ZoomIn(); }
-void MyFrame::OnZoomout(wxCommandEvent& event) { m_drawPanel->ZoomOut(); }
+void MyFrame::OnAutoRoute(wxCommandEvent& event) {
+    if (m_job) {
+        wxMessageBox("к̨: " + m_job->GetName(), "Զ", wxOK | wxICON_INFORMATION, this);
+        return;
+    }
 
-void MyFrame::OnToggleStatusBar(wxCommandEvent& event) {
-    wxMenuBar* mb = GetMenuBar();
-    wxMenuItem* item = mb->FindItem(ID_SHOW_STATUSBAR);
-    bool show = item->IsChecked();
-    GetStatusBar()->Show(show);
-    Layout();
+    auto pos = std::make_shared<std::vector<wxPoint>>();
+    auto obstacles = std::make_shared<std::vector<wxRect>>();
+    auto nets = std::make_shared<std::vector<RouteNet>>();
+    auto freePins = std::make_shared<std::vector<wxPoint>>();
+    m_drawPanel->GetRoutingProblem(*pos, *obstacles, *nets, *freePins);
+    if (nets->empty()) {
+        SetStatusText("ûҪߵ");
+        return;
+    }
+    size_t wireCount = m_drawPanel->GetWires().size();
+    int gridSize = m_drawPanel->GetGridSize();
+    auto result = std::make_shared<RouteResult>();
+    auto finished = std::make_shared<bool>(false);
+
+    // Զͬʱ·ѱ޸
+    m_job.reset(new BackgroundJob(this, "Զ"));
+    m_job->onFinished = [this, pos, nets, result, finished, wireCount]() {
+        if (!*finished) return;
+        if (!m_drawPanel->IsUnchangedSince(*pos, wireCount)) {
+            SetStatusText("Զڼ·ѱ޸ģѷ");
+            return;
+        }
+        SaveStateForUndo();
+        m_drawPanel->ApplyRouting(std::move(result->wires));
+        SetStatusText(wxString::Format("Զ: %zu , %zu Ѳͨ, %zu ֱ, յ %d, ز %d ",
+            nets->size(), result->routed, result->failed, result->bends, result->ripups));
+    };
+    m_job->Start([obstacles, nets, freePins, result, finished, gridSize](BackgroundJob& job) {
+        WireRouter router(*obstacles, *nets, *freePins, gridSize);
+        *finished = router.Run(&job, *result);
+    });
+    SetStatusText("Զ: 0%");
 }
 
-void MyFrame::OnToggleGrid(wxCommandEvent& event) {
-    wxMenuBar* mb = GetMenuBar();
-    wxMenuItem* item = mb->FindItem(ID_SHOW_GRID);
-    bool show = item->IsChecked();
-    m_drawPanel->ToggleGrid();
-    item->Check(m_drawPanel->IsGridVisible());
+void MyFrame::OnCancelJob(wxCommandEvent& event) {
+    if (m_job) {
+        m_job->Cancel();
+        SetStatusText("ȡ: " + m_job->GetName());
+    }
 }
 
-void MyFrame::OnDeleteSelected(wxCommandEvent& event) {
-    SaveStateForUndo();
-    m_drawPanel->DeleteSelected();
+bool MyFrame::CanChangeDefinitions(const wxString& title) {
+    if (!m_job || !m_job->readsDefinitions) return true;
+    wxMessageBox("̨ʹӵ·, ɻȡ: " + m_job->GetName(), title, wxOK | wxICON_INFORMATION, this);
+    return false;
 }
 
-void MyFrame::OnDeleteWire(wxCommandEvent& event) {
-    SaveStateForUndo();
-    m_drawPanel->DeleteSelectedWire();
+void MyFrame::OnBackgroundJob(wxThreadEvent& event) {
+    if (event.GetId() == ID_SAVE_JOB) {
+        OnSaveJob(event);
+        return;
+    }
+    if (!m_job) return;
+    if (!m_job->IsDone()) {
+        SetStatusText(wxString::Format("%s: %d%%", m_job->GetName(), event.GetInt()));
+        return;
+    }
+
+    // Ƴ m_jobɻصµ
+    std::unique_ptr<BackgroundJob> job(std::move(m_job));
+    job->Join();
+    SetStatusText(job->GetName() + (job->IsCancelled() ? " ȡ" : " "));
+    if (job->onFinished) job->onFinished();
 }
 
-void MyFrame::OnEditProperties(wxCommandEvent& event) {
-    SaveStateForUndo();
-    m_drawPanel->EditSelectedProperties();
+void MyFrame::ShowFaultReport(const LevelizedNetlist& netlist, const FaultSimReport& report) {
+    wxString msg = wxString::Format(": %zu\n: %zu\n: %zu\nϸ: %.2f%%",
+        report.patterns, report.totalFaults, report.detectedFaults, report.Coverage());
+    if (report.cancelled) {
+        msg += "\n(ȡֻ˲)";
+    }
+
+    if (!report.undetected.empty()) {
+        const size_t maxListed = 20;
+        msg += wxString::Format("\n\nδ (%zu):", report.undetected.size());
+        for (size_t i = 0; i < report.undetected.size() && i < maxListed; ++i) {
+            const StuckAtFault& f = report.undetected[i];
+            wxString pin = f.pin < 0 ? wxString("") : wxString::Format("%d", f.pin + 1);
+            msg += wxString::Format("\n%s#%d %s ̶%d", netlist.type[f.gate], f.gate, pin, f.stuckValue);
+        }
+        if (report.undetected.size() > maxListed) {
+            msg += "\n...";
+        }
+    }
+
+    wxMessageBox(msg, "Ϸ", wxOK | wxICON_INFORMATION, this);
 }
 
 void MyFrame::OnAbout(wxCommandEvent& event) {
@@ -1225,9 +9958,30 @@ void MyFrame::OnAbout(wxCommandEvent& event) {
         "- Ctrl+Z \n"
         "- Ctrl+Y \n"
         "- Ctrl+P ༭\n"
+        "- Ctrl+B ѡеĶΪΪӵ·/ʱΪ, LED Ϊ\n"
+        "- Ŵ϶, ڿհ״϶ѡ; Shift+ѡѡ, Ctrl+A ȫѡ\n"
+        "- Ctrl+Shift+P ѡе\n"
         "- Del ɾѡ\n"
         "- Shift+Del ɾѡ\n"
-        "- Ctrl+G ʾ/", "", wxOK | wxICON_INFORMATION, this);
+        "- Ctrl+G ʾ/\n"
+        "- Ctrl+H ʾ/عͼ\n"
+        "- F3 ʾ/壨֡ʱ\n"
+        "- F5 ߼/ʱ༭£\n"
+        "- F6 ̶͹Ϸ棨̨У\n"
+        "- F7 ²\n"
+        "- F8 ʱӵʱӷתһΣ\n"
+        "- F9 ڷ棨̨У\n"
+        "- Ctrl+L Զ̨֣Уȡ\n"
+        "- Ctrl+R Զߣƽֱߣܿ\n"
+        "- ʱոӹյ\n"
+        "- м϶ƽƻ\n"
+        "- Ctrl+Shift+O ֻƬʽ(.ctb)Ĵ·, ֻȡӿڸĲ\n"
+        "- ļ˵пѡ JSON, ʱд, ռöڴ\n"
+        "- Ϊ .json.gz / .ctb.gz ʱ߳ѹ, ʱԶʶѹļ\n"
+        "- м --batch 򿪴//, --batch --help 鿴\n"
+        "- ͼƬʱֿ鲢л, ԵԶڴڵ PNG\n"
+        "-  SVG ʱÿֻһͼ, ʵ\n"
+        "- ༭ʱ¼ָĿ¼, 쳣˳´ɻָ", "", wxOK | wxICON_INFORMATION, this);
 }
 
 void MyFrame::UpdateTitle() {
@@ -1236,16 +9990,382 @@ void MyFrame::UpdateTitle() {
         title += " - " + m_currentFile;
     }
     SetTitle(title);
+    if (m_journal) m_journal->FileChanged(m_currentFile);
+}
+
+// =====  =====
+//  --batch ʱڣ·󰴲Ⱥ˳桢Ȼ˳
+// ֻģͲĴ룬ʼͼν棬ûʾĻҲС
+// ˳룺0 ɹ1 ļ2 δͨʱ޻ϸʲ㣩
+enum { BATCH_OK = 0, BATCH_ERROR = 1, BATCH_CHECK_FAILED = 2 };
+
+const char* BATCH_USAGE =
+    "÷: --batch <·ļ> [...]\n"
+    "  ·ļ: .json / .ctb (ɴ .gz)  .v / .blif \n"
+    "˳ִ:\n"
+    "  --simulate <ļ>    ʩ (ذ˳), ÿһ LED ֵ\n"
+    "  --cycles <N>             ӳʼ״̬ N ʱ,  LED ֵ\n"
+    "  --timing                 ·ӳ\n"
+    "  --max-delay <D>          ·ӳٳ D ʱ˳Ϊ 2\n"
+    "  --fault <ļ>       ̶͹Ϸ, ϸ\n"
+    "  --min-coverage <P>       ֮ĹϷ渲ʵ P% ʱ˳Ϊ 2\n"
+    "  --export-verilog <ļ>  ṹ Verilog\n"
+    "  --export-blif <ļ>      BLIF\n"
+    "  --export-kernel <ļ>    C++ ں\n"
+    "  --shapes <ļ>          ͼƬõͼο (ĬΪǰĿ¼µ shapes4.0.json)\n"
+    "  --image-scale <S>        ֮󵼳ͼƬÿ߼λ S  (Ĭ 1)\n"
+    "  --export-image <ļ>     PNG  SVG ͼƬ (PNG Ҫͼλ, ûʾʱ xvfb-run)\n"
+    "  --compact                ֮󱣴 JSON \n"
+    "  --save <ļ>            չΪ .json / .ctb (ɴ .gz)\n";
+
+inline bool IsBatchCommandLine(const std::vector<wxString>& args) {
+    return !args.empty() && args[0] == "--batch";
+}
+
+class BatchRunner {
+public:
+    int Run(const std::vector<wxString>& args) {
+        // ȼȫƴѡһ빤֮ű
+        std::vector<std::pair<wxString, wxString>> ops;
+        wxString circuit;
+        for (size_t i = 1; i < args.size(); ++i) {
+            const wxString& arg = args[i];
+            if (arg == "--help" || arg == "-h") {
+                Print(stdout, BATCH_USAGE);
+                return BATCH_OK;
+            }
+            if (!arg.StartsWith("--")) {
+                if (!circuit.empty()) return Usage("Ĳ: " + arg);
+                circuit = arg;
+                continue;
+            }
+            bool flag = arg == "--timing" || arg == "--compact";
+            bool known = flag || arg == "--simulate" || arg == "--cycles" || arg == "--max-delay" || arg == "--fault" ||
+                arg == "--min-coverage" || arg == "--export-verilog" || arg == "--export-blif" ||
+                arg == "--export-kernel" || arg == "--shapes" || arg == "--image-scale" || arg == "--export-image" || arg == "--save";
+            if (!known) return Usage("δ֪ѡ: " + arg);
+            if (flag) {
+                ops.push_back(std::make_pair(arg, wxString()));
+                continue;
+            }
+            if (i + 1 >= args.size()) return Usage(arg + " ȱٲ");
+            ops.push_back(std::make_pair(arg, args[++i]));
+        }
+        if (circuit.empty()) return Usage("ûָ·ļ");
+        for (auto& op : ops) {
+            double number;
+            bool numeric = op.first == "--cycles" || op.first == "--max-delay" || op.first == "--min-coverage" ||
+                op.first == "--image-scale";
+            if (numeric && (!op.second.ToDouble(&number) || number < 0)) return Usage(op.first + " ĲǷǸ: " + op.second);
+        }
+
+        // ŵͼֻеͼƬʱõҲͼοʱڿʼ֮ǰͱ
+        wxString shapes;
+        bool exportsImage = false;
+        for (auto& op : ops) {
+            if (op.first == "--shapes") shapes = op.second;
+            if (op.first == "--export-image") exportsImage = true;
+        }
+        if (exportsImage && !LoadShapes(shapes)) return BATCH_ERROR;
+
+        if (!Load(circuit)) return BATCH_ERROR;
+        for (auto& op : ops) {
+            const wxString& name = op.first;
+            const wxString& value = op.second;
+            bool ok = true;
+            if (name == "--simulate") ok = Simulate(value);
+            else if (name == "--cycles") ok = RunCycles(value);
+            else if (name == "--timing") Timing(-1);
+            else if (name == "--max-delay") Timing(wxAtoi(value));
+            else if (name == "--fault") ok = FaultSimulation(value);
+            else if (name == "--min-coverage") value.ToDouble(&m_minCoverage);
+            else if (name == "--export-verilog" || name == "--export-blif") ok = ExportNetlist(value, name == "--export-blif");
+            else if (name == "--export-kernel") ok = ExportKernel(value);
+            else if (name == "--image-scale") value.ToDouble(&m_imageScale);
+            else if (name == "--export-image") ok = ExportImage(value);
+            else if (name == "--compact") m_compact = true;
+            else if (name == "--save") ok = Save(value);
+            if (!ok) return BATCH_ERROR;
+        }
+        return m_checkFailed ? BATCH_CHECK_FAILED : BATCH_OK;
+    }
+
+private:
+    std::vector<Gate> m_gates;
+    std::vector<Wire> m_wires;
+    std::unique_ptr<LevelizedNetlist> m_netlist;
+    double m_minCoverage = -1;
+    double m_imageScale = 1;
+    std::unique_ptr<wxInitializer> m_graphics;
+    bool m_compact = false;
+    bool m_checkFailed = false;
+
+    static void Print(FILE* out, const wxString& text) {
+        fputs(text.mb_str(), out);
+        fflush(out);
+    }
+
+    static int Usage(const wxString& message) {
+        Print(stderr, message + "\n\n" + BATCH_USAGE);
+        return BATCH_ERROR;
+    }
+
+    static int Error(const wxString& message) {
+        Print(stderr, ": " + message + "\n");
+        return BATCH_ERROR;
+    }
+
+    static double Since(std::chrono::steady_clock::time_point t0) {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+    }
+
+    // ڴ wxApp ֮ǰУ wxStandardPaths ҳĿ¼
+    bool LoadShapes(wxString filename) {
+        if (filename.empty()) filename = "shapes4.0.json";
+        if (!wxFileExists(filename)) {
+            Error("Ҳͼοļ " + filename + ",  --shapes ָ");
+            return false;
+        }
+        if (!LoadShapesFromJson(filename.ToStdString()) || shapeLibrary.empty()) {
+            Error("޷ͼοļ: " + filename);
+            return false;
+        }
+        return true;
+    }
+
+    bool Load(const wxString& filename) {
+        auto t0 = std::chrono::steady_clock::now();
+        wxString error;
+        wxString lower = filename.Lower();
+        bool ok;
+        if (lower.EndsWith(".v") || lower.EndsWith(".blif")) {
+            ok = ImportNetlist(filename, m_gates, m_wires, error);
+        }
+        else {
+            std::vector<wxString> added;
+            ok = ReadCircuitFile(filename, m_gates, m_wires, added, error);
+        }
+        if (!ok) {
+            Error(error);
+            return false;
+        }
+        Print(stdout, wxString::Format(": %s, %zu , %zu , ʱ %.0f ms\n",
+            filename, m_gates.size(), m_wires.size(), Since(t0)));
+        return true;
+    }
+
+    // ӹϵֻڵһõʱ
+    const LevelizedNetlist& Netlist() {
+        if (!m_netlist) {
+            m_netlist.reset(new LevelizedNetlist);
+            CircuitAnalyzer analyzer;
+            analyzer.Build(m_gates, m_wires);
+            analyzer.ExportNetlist(m_gates, *m_netlist);
+        }
+        return *m_netlist;
+    }
+
+    static wxString Outputs(const CompiledCircuit& circuit) {
+        wxString values;
+        for (size_t i = 0; i < circuit.GetOutputCount(); ++i) values += circuit.GetOutput(i) ? "1" : "0";
+        return values;
+    }
+
+    // ϵ·ÿֵһ飻дʱÿ֮һʱ
+    bool Simulate(const wxString& filename) {
+        std::vector<std::vector<unsigned char>> vectors;
+        if (!LoadTestVectors(filename, vectors)) {
+            Error("޷ȡ: " + filename);
+            return false;
+        }
+        CompiledCircuit circuit;
+        circuit.Compile(Netlist());
+        bool sequential = circuit.GetFlipFlopCount() > 0;
+        for (auto& vec : vectors) {
+            for (size_t i = 0; i < vec.size() && i < circuit.GetInputCount(); ++i) circuit.SetInput(i, vec[i] != 0);
+            if (sequential) circuit.Cycle();
+            else circuit.Run();
+            Print(stdout, Outputs(circuit) + "\n");
+        }
+        return true;
+    }
+
+    bool RunCycles(const wxString& value) {
+        double number = 0;
+        value.ToDouble(&number);
+        unsigned long long cycles = (unsigned long long)number;
+        CompiledCircuit circuit;
+        circuit.Compile(Netlist());
+        auto t0 = std::chrono::steady_clock::now();
+        for (unsigned long long c = 0; c < cycles; ++c) circuit.Cycle();
+        double ms = Since(t0);
+        Print(stdout, wxString::Format(": %llu, ʱ %.0f ms, : %s\n", cycles, ms, Outputs(circuit)));
+        return true;
+    }
+
+    // limit < 0 ʱֻ
+    void Timing(int limit) {
+        CircuitAnalyzer analyzer;
+        analyzer.Build(m_gates, m_wires);
+        int delay = analyzer.GetMaxArrival();
+        Print(stdout, wxString::Format("·ӳ: %d%s\n", delay,
+            analyzer.IsUnstable() ? " (ϻ·, δ)" : ""));
+        if (limit >= 0 && delay > limit) {
+            Print(stderr, wxString::Format("δͨ: ·ӳ %d  %d\n", delay, limit));
+            m_checkFailed = true;
+        }
+    }
+
+    bool FaultSimulation(const wxString& filename) {
+        std::vector<std::vector<unsigned char>> vectors;
+        if (!LoadTestVectors(filename, vectors) || vectors.empty()) {
+            Error("޷ȡ: " + filename);
+            return false;
+        }
+        auto t0 = std::chrono::steady_clock::now();
+        FaultSimulator simulator(Netlist());
+        simulator.EnumerateFaults();
+        FaultSimReport report = simulator.Run(vectors, nullptr);
+        Print(stdout, wxString::Format("Ϸ: %zu ,  %zu,  %zu,  %.2f%%, ʱ %.0f ms\n",
+            report.patterns, report.totalFaults, report.detectedFaults, report.Coverage(), Since(t0)));
+        if (m_minCoverage >= 0 && report.Coverage() < m_minCoverage) {
+            Print(stderr, wxString::Format("δͨ: ϸ %.2f%%  %g%%\n", report.Coverage(), m_minCoverage));
+            m_checkFailed = true;
+        }
+        return true;
+    }
+
+    bool ExportNetlist(const wxString& filename, bool blif) {
+        std::ofstream f(filename.ToStdString(), std::ios::binary);
+        if (!f.is_open()) {
+            Error("޷ļ: " + filename);
+            return false;
+        }
+        std::string module = NetlistModuleName(wxFileName(filename).GetName());
+        if (blif) WriteBlif(Netlist(), module, f);
+        else WriteVerilog(Netlist(), module, f);
+        f.close();
+        if (f.fail()) {
+            Error("дļʧ: " + filename);
+            return false;
+        }
+        Print(stdout, wxString::Format(" %s : %s\n", blif ? "BLIF" : "Verilog", filename));
+        return true;
+    }
+
+    bool ExportKernel(const wxString& filename) {
+        CompiledCircuit circuit;
+        circuit.Compile(Netlist());
+        std::ofstream f(filename.ToStdString());
+        if (!f.is_open()) {
+            Error("޷ļ: " + filename);
+            return false;
+        }
+        circuit.EmitCpp(f);
+        f.close();
+        if (f.fail()) {
+            Error("дļʧ: " + filename);
+            return false;
+        }
+        Print(stdout, wxString::Format("ں: %s, %zu ָ\n", filename, circuit.GetInstructionCount()));
+        return true;
+    }
+
+    //  PNG ҪõͼοԴһεʱųʼWindows ʱѾʼ
+    // SVG ֻдıҪʾ
+    bool ExportImage(const wxString& filename) {
+        bool svg = IsSvgFileName(filename);
+#ifndef __WXMSW__
+        if (!svg && !m_graphics) {
+            m_graphics.reset(new wxInitializer);
+            if (!m_graphics->IsOk()) {
+                Error("޷ʼͼο, ͼƬҪʾ ( xvfb-run)");
+                return false;
+            }
+        }
+#endif
+        auto t0 = std::chrono::steady_clock::now();
+        CircuitSnapshot snapshot;
+        snapshot.gates.Assign(m_gates);
+        snapshot.wires = m_wires;
+        wxString error;
+        wxSize size;
+        bool ok = svg ? ExportCircuitSvg(snapshot, filename, nullptr, error, &size)
+            : ExportCircuitImage(snapshot, filename, m_imageScale, nullptr, error, &size);
+        if (!ok) {
+            Error(error);
+            return false;
+        }
+        Print(stdout, wxString::Format("ͼƬ: %s, %d x %d, ʱ %.0f ms\n", filename, size.x, size.y, Since(t0)));
+        return true;
+    }
+
+    bool Save(const wxString& filename) {
+        CircuitSnapshot snapshot;
+        snapshot.gates.Assign(m_gates);
+        snapshot.wires = m_wires;
+        snapshot.subcircuits = GetSubcircuitDefinitions();
+        wxString error;
+        bool ok = StripCompressedExtension(filename).Lower().EndsWith(".ctb")
+            ? WriteTiledCircuitFile(snapshot, filename, nullptr, error)
+            : WriteCircuitFile(snapshot, filename, nullptr, error, m_compact);
+        if (!ok) {
+            Error(error);
+            return false;
+        }
+        Print(stdout, ": " + filename + "\n");
+        return true;
+    }
+};
+
+int RunBatch(const std::vector<wxString>& args) {
+    setlocale(LC_CTYPE, "");
+    return BatchRunner().Run(args);
 }
 
 // ===== Ӧó =====
 class MyApp : public wxApp {
 public:
     bool OnInit() override {
+#ifdef __WXMSW__
+        // Windows ͼνĳʼҪʾʶӵĿ̨
+        std::vector<wxString> args;
+        for (int i = 1; i < argc; ++i) args.push_back(argv[i]);
+        if (IsBatchCommandLine(args)) {
+            if (::AttachConsole(ATTACH_PARENT_PROCESS)) {
+                freopen("CONOUT$", "w", stdout);
+                freopen("CONOUT$", "w", stderr);
+            }
+            m_batchArgs = args;
+            return true;
+        }
+#endif
         MyFrame* frame = new MyFrame("·ͼ༭");
         frame->Show(true);
         return true;
     }
+
+    int OnRun() override {
+        if (IsBatchCommandLine(m_batchArgs)) return RunBatch(m_batchArgs);
+        return wxApp::OnRun();
+    }
+
+private:
+    std::vector<wxString> m_batchArgs;
 };
 
-wxIMPLEMENT_APP(MyApp);
\ No newline at end of file
+#ifdef __WXMSW__
+wxIMPLEMENT_APP(MyApp);
+#else
+wxIMPLEMENT_APP_NO_MAIN(MyApp);
+
+// ڳʼͼν֮ǰҪ X 
+int main(int argc, char** argv) {
+    // ȰıУ ASCII ļת wxString 
+    setlocale(LC_CTYPE, "");
+    std::vector<wxString> args;
+    for (int i = 1; i < argc; ++i) args.push_back(wxString(argv[i]));
+    if (IsBatchCommandLine(args)) return RunBatch(args);
+    return wxEntry(argc, argv);
+}
+#endif
\ No newline at end of file